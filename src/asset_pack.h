@@ -0,0 +1,217 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "embedded_resource.h"
+#include "job_system.h"
+#include "lz4.h"
+#include "mapped_file.h"
+
+// on disk layout: PackHeader, PackEntry[entry_count] sorted by name hash, then the entry data.
+// every entry starts on a kPackAlignment boundary so mapped spir-v can be handed to vulkan as is
+constexpr uint32_t kPackMagic = 0x4b50564b; // "KVPK"
+constexpr uint32_t kPackVersion = 1;
+constexpr uint64_t kPackAlignment = 16;
+
+enum class PackCompression : uint32_t {
+    None = 0,
+    LZ4 = 1,
+};
+
+struct PackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t reserved;
+};
+
+struct PackEntry {
+    uint64_t name_hash; // fnv-1a of the file name
+    uint64_t offset;    // from the start of the file
+    uint64_t size;      // decoded size
+    uint64_t stored_size;
+    PackCompression compression;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(PackHeader) == 16, "pack header layout changed");
+static_assert(sizeof(PackEntry) == 40, "pack entry layout changed");
+
+inline uint64_t pack_name_hash(const char *name) {
+    return fnv1a_64(reinterpret_cast<const uint8_t *>(name), strlen(name));
+}
+
+// non-owning bytes of an asset, valid for the lifetime of whatever provided it
+struct AssetView final {
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+
+    const uint8_t *data() const { return data_; }
+    size_t size() const { return size_; }
+    bool valid() const { return data_ != nullptr; }
+};
+
+// read only asset archive mapped into memory, only the pages of entries that are touched get loaded
+class AssetPack final {
+private:
+    std::unique_ptr<MappedFile> file_;
+    const uint8_t *base_;
+    size_t size_;
+
+    const PackEntry *entries_;
+    uint32_t entry_count_;
+
+    // compressed entries are decoded once, on a worker thread, and kept until the pack closes
+    JobSystem *jobs_;
+    std::mutex mutex_;
+    std::vector<std::shared_future<AssetView>> decoded_;
+    std::vector<std::unique_ptr<uint8_t[]>> decoded_storage_;
+
+    AssetPack() : base_{nullptr}, size_{0}, entries_{nullptr}, entry_count_{0}, jobs_{nullptr} {}
+
+    bool validate(std::string &error) {
+        if (size_ < sizeof(PackHeader)) {
+            error = "truncated pack header";
+            return false;
+        }
+
+        PackHeader header;
+        memcpy(&header, base_, sizeof(header));
+
+        if (header.magic != kPackMagic || header.version != kPackVersion) {
+            error = "not an asset pack or unsupported version";
+            return false;
+        }
+
+        if (header.entry_count > (size_ - sizeof(PackHeader)) / sizeof(PackEntry)) {
+            error = "truncated table of contents";
+            return false;
+        }
+
+        entries_ = reinterpret_cast<const PackEntry *>(base_ + sizeof(PackHeader));
+        entry_count_ = header.entry_count;
+
+        for (uint32_t i = 0; i < entry_count_; ++i) {
+            const auto &entry = entries_[i];
+            if (entry.offset > size_ || entry.stored_size > size_ - entry.offset) {
+                error = "entry " + std::to_string(i) + " is out of bounds";
+                return false;
+            }
+
+            if (entry.compression == PackCompression::None && entry.stored_size != entry.size) {
+                error = "entry " + std::to_string(i) + " has inconsistent size";
+                return false;
+            }
+
+            if (entry.compression != PackCompression::None && entry.compression != PackCompression::LZ4) {
+                error = "entry " + std::to_string(i) + " uses unknown compression";
+                return false;
+            }
+
+            if (i > 0 && entries_[i - 1].name_hash >= entry.name_hash) {
+                error = "table of contents is not sorted";
+                return false;
+            }
+        }
+
+        decoded_.resize(entry_count_);
+        decoded_storage_.resize(entry_count_);
+        return true;
+    }
+
+public:
+    AssetPack(const AssetPack &) = delete;
+    AssetPack &operator=(const AssetPack &) = delete;
+
+    ~AssetPack() {
+        // decoders write into storage owned by this pack
+        for (auto &future : decoded_) {
+            if (future.valid()) {
+                future.wait();
+            }
+        }
+    }
+
+    uint32_t entry_count() const { return entry_count_; }
+
+    const PackEntry *find(const char *name) const {
+        uint64_t hash = pack_name_hash(name);
+        auto end = entries_ + entry_count_;
+        auto it = std::lower_bound(
+            entries_, end, hash, [](const PackEntry &entry, uint64_t value) { return entry.name_hash < value; });
+
+        return (it != end && it->name_hash == hash) ? it : nullptr;
+    }
+
+    // uncompressed entries resolve immediately to a span of the mapping, compressed ones are decoded in the
+    // background. an invalid view means the asset is missing or corrupt
+    std::shared_future<AssetView> load(const char *name) {
+        const PackEntry *entry = find(name);
+        if (!entry) {
+            std::promise<AssetView> missing;
+            missing.set_value({});
+            return missing.get_future().share();
+        }
+
+        if (entry->compression == PackCompression::None) {
+            std::promise<AssetView> mapped;
+            mapped.set_value({base_ + entry->offset, static_cast<size_t>(entry->size)});
+            return mapped.get_future().share();
+        }
+
+        size_t index = static_cast<size_t>(entry - entries_);
+
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (!decoded_[index].valid()) {
+            auto decode = [this, entry, index]() -> AssetView {
+                auto size = static_cast<size_t>(entry->size);
+                std::unique_ptr<uint8_t[]> data{new uint8_t[size > 0 ? size : 1]};
+
+                if (!lz4::decompress(base_ + entry->offset, static_cast<size_t>(entry->stored_size), data.get(), size)) {
+                    return {};
+                }
+
+                AssetView view{data.get(), size};
+                decoded_storage_[index] = std::move(data);
+                return view;
+            };
+
+            if (jobs_) {
+                auto task = std::make_shared<std::packaged_task<AssetView()>>(decode);
+                decoded_[index] = task->get_future().share();
+                jobs_->submit([task]() { (*task)(); });
+            } else {
+                decoded_[index] = std::async(std::launch::async, decode).share();
+            }
+        }
+
+        return decoded_[index];
+    }
+
+    // decodes are queued on the job system if one is given, otherwise every decode gets its own thread
+    static std::unique_ptr<AssetPack> open(const std::string &path, std::string &error, JobSystem *jobs = nullptr) {
+        std::unique_ptr<AssetPack> pack{new AssetPack()};
+        pack->jobs_ = jobs;
+
+        pack->file_ = MappedFile::open(path, error);
+        if (!pack->file_) {
+            return {};
+        }
+
+        pack->base_ = pack->file_->data();
+        pack->size_ = pack->file_->size();
+
+        if (!pack->validate(error)) {
+            return {};
+        }
+
+        return pack;
+    }
+};
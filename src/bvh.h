@@ -0,0 +1,650 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "culling.h"
+
+struct Aabb {
+    float min[3];
+    float max[3];
+
+    static Aabb merge(const Aabb &a, const Aabb &b) {
+        Aabb merged;
+        for (size_t axis = 0; axis < 3; ++axis) {
+            merged.min[axis] = std::min(a.min[axis], b.min[axis]);
+            merged.max[axis] = std::max(a.max[axis], b.max[axis]);
+        }
+
+        return merged;
+    }
+
+    // half the surface area, only ever compared against other areas
+    float area() const {
+        float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+        return dx * dy + dy * dz + dz * dx;
+    }
+
+    float center(size_t axis) const { return (min[axis] + max[axis]) * 0.5f; }
+
+    bool contains(const Aabb &other) const {
+        for (size_t axis = 0; axis < 3; ++axis) {
+            if (other.min[axis] < min[axis] || other.max[axis] > max[axis]) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool overlaps(const Aabb &other) const {
+        for (size_t axis = 0; axis < 3; ++axis) {
+            if (other.max[axis] < min[axis] || other.min[axis] > max[axis]) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // grown by a fraction of its size on every axis
+    Aabb expanded(float fraction) const {
+        Aabb grown;
+        for (size_t axis = 0; axis < 3; ++axis) {
+            float margin = (max[axis] - min[axis]) * fraction + 1e-4f;
+            grown.min[axis] = min[axis] - margin;
+            grown.max[axis] = max[axis] + margin;
+        }
+
+        return grown;
+    }
+};
+
+// dynamic bounding volume hierarchy over boxes identified by small dense ids, such as scene object slots. leaves
+// store a box enlarged by kMargin so objects moving a little only refit their ancestors, an object that leaves its
+// enlarged box is reinserted where the surface area heuristic is cheapest. query results are always tested against
+// the exact boxes. rebuild() or optimize() restore a full binned sah tree once enough changes have piled up
+class Bvh final {
+public:
+    static constexpr int32_t kNull = -1;
+
+private:
+    static constexpr float kMargin = 0.1f;
+    static constexpr size_t kBins = 16;
+
+    struct Node {
+        Aabb box;
+        int32_t parent;
+        int32_t left, right;
+        uint32_t id;
+
+        bool leaf() const { return left == kNull; }
+    };
+
+    std::vector<Node> nodes_;
+    int32_t root_;
+    int32_t free_;
+
+    // node and exact box of every id, kNull when the id is not in the tree
+    std::vector<int32_t> leaf_of_;
+    std::vector<Aabb> boxes_;
+    size_t size_;
+
+    // inserts, removals and refits since the last full build
+    size_t changes_;
+
+    int32_t allocate() {
+        if (free_ != kNull) {
+            int32_t node = free_;
+            free_ = nodes_[node].parent;
+            return node;
+        }
+
+        nodes_.push_back({});
+        return static_cast<int32_t>(nodes_.size() - 1);
+    }
+
+    void release(int32_t node) {
+        nodes_[node].parent = free_;
+        nodes_[node].left = kNull;
+        nodes_[node].right = kNull;
+        free_ = node;
+    }
+
+    void refit_from(int32_t node) {
+        for (; node != kNull; node = nodes_[node].parent) {
+            nodes_[node].box = Aabb::merge(nodes_[nodes_[node].left].box, nodes_[nodes_[node].right].box);
+        }
+    }
+
+    // descends towards the sibling that adds the least surface area, counting the growth of every ancestor
+    void insert_leaf(int32_t leaf) {
+        if (root_ == kNull) {
+            root_ = leaf;
+            nodes_[leaf].parent = kNull;
+            return;
+        }
+
+        Aabb box = nodes_[leaf].box;
+        int32_t index = root_;
+        while (!nodes_[index].leaf()) {
+            const Node &node = nodes_[index];
+
+            float area = node.box.area();
+            float combined = Aabb::merge(node.box, box).area();
+
+            // making a new parent of this node here, versus pushing the leaf further down
+            float cost = 2.0f * combined;
+            float inherited = 2.0f * (combined - area);
+
+            auto descend_cost = [&](int32_t child) {
+                float grown = Aabb::merge(nodes_[child].box, box).area();
+                return nodes_[child].leaf() ? grown + inherited : grown - nodes_[child].box.area() + inherited;
+            };
+
+            float left_cost = descend_cost(node.left), right_cost = descend_cost(node.right);
+            if (cost < left_cost && cost < right_cost) {
+                break;
+            }
+
+            index = left_cost < right_cost ? node.left : node.right;
+        }
+
+        int32_t sibling = index;
+        int32_t old_parent = nodes_[sibling].parent;
+        int32_t parent = allocate();
+
+        nodes_[parent].parent = old_parent;
+        nodes_[parent].left = sibling;
+        nodes_[parent].right = leaf;
+        nodes_[parent].box = Aabb::merge(nodes_[sibling].box, box);
+        nodes_[sibling].parent = parent;
+        nodes_[leaf].parent = parent;
+
+        if (old_parent == kNull) {
+            root_ = parent;
+        } else if (nodes_[old_parent].left == sibling) {
+            nodes_[old_parent].left = parent;
+        } else {
+            nodes_[old_parent].right = parent;
+        }
+
+        refit_from(old_parent);
+    }
+
+    // the sibling of the leaf takes the place of their parent
+    void remove_leaf(int32_t leaf) {
+        if (leaf == root_) {
+            root_ = kNull;
+            return;
+        }
+
+        int32_t parent = nodes_[leaf].parent;
+        int32_t grand_parent = nodes_[parent].parent;
+        int32_t sibling = nodes_[parent].left == leaf ? nodes_[parent].right : nodes_[parent].left;
+
+        nodes_[sibling].parent = grand_parent;
+        if (grand_parent == kNull) {
+            root_ = sibling;
+        } else {
+            if (nodes_[grand_parent].left == parent) {
+                nodes_[grand_parent].left = sibling;
+            } else {
+                nodes_[grand_parent].right = sibling;
+            }
+
+            refit_from(grand_parent);
+        }
+
+        release(parent);
+    }
+
+    // top down binned sah build over leaf nodes that already exist, with an explicit stack
+    int32_t build(std::vector<int32_t> &leaves) {
+        if (leaves.empty()) {
+            return kNull;
+        }
+
+        struct Range {
+            int32_t node;
+            size_t begin, end;
+        };
+
+        auto centroid_bounds = [&](size_t begin, size_t end) {
+            Aabb bounds{{std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                            std::numeric_limits<float>::max()},
+                {std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(),
+                    std::numeric_limits<float>::lowest()}};
+
+            for (size_t i = begin; i < end; ++i) {
+                const Aabb &box = nodes_[leaves[i]].box;
+                for (size_t axis = 0; axis < 3; ++axis) {
+                    bounds.min[axis] = std::min(bounds.min[axis], box.center(axis));
+                    bounds.max[axis] = std::max(bounds.max[axis], box.center(axis));
+                }
+            }
+
+            return bounds;
+        };
+
+        int32_t root = leaves.size() == 1 ? leaves[0] : allocate();
+        nodes_[root].parent = kNull;
+
+        std::vector<Range> stack;
+        if (leaves.size() > 1) {
+            stack.push_back({root, 0, leaves.size()});
+        }
+
+        while (!stack.empty()) {
+            Range range = stack.back();
+            stack.pop_back();
+
+            Aabb centroids = centroid_bounds(range.begin, range.end);
+            size_t axis = 0;
+            for (size_t i = 1; i < 3; ++i) {
+                if (centroids.max[i] - centroids.min[i] > centroids.max[axis] - centroids.min[axis]) {
+                    axis = i;
+                }
+            }
+
+            float low = centroids.min[axis], extent = centroids.max[axis] - centroids.min[axis];
+            size_t middle = range.begin;
+
+            if (extent > 0.0f) {
+                auto bin_of = [&](int32_t leaf) {
+                    auto bin = static_cast<size_t>((nodes_[leaf].box.center(axis) - low) / extent * kBins);
+                    return std::min(bin, kBins - 1);
+                };
+
+                size_t counts[kBins] = {};
+                Aabb boxes[kBins];
+                for (size_t i = range.begin; i < range.end; ++i) {
+                    size_t bin = bin_of(leaves[i]);
+                    boxes[bin] = counts[bin]++ == 0 ? nodes_[leaves[i]].box
+                                                    : Aabb::merge(boxes[bin], nodes_[leaves[i]].box);
+                }
+
+                // cost of splitting after every bin, swept from both ends
+                float right_cost[kBins] = {};
+                size_t right_count = 0;
+                Aabb right_box{};
+                for (size_t bin = kBins - 1; bin > 0; --bin) {
+                    if (counts[bin] > 0) {
+                        right_box = right_count == 0 ? boxes[bin] : Aabb::merge(right_box, boxes[bin]);
+                        right_count += counts[bin];
+                    }
+
+                    right_cost[bin - 1] = right_count > 0 ? right_box.area() * static_cast<float>(right_count) : 0.0f;
+                }
+
+                float best_cost = std::numeric_limits<float>::max();
+                size_t best_split = kBins;
+                size_t left_count = 0;
+                Aabb left_box{};
+                for (size_t bin = 0; bin + 1 < kBins; ++bin) {
+                    if (counts[bin] > 0) {
+                        left_box = left_count == 0 ? boxes[bin] : Aabb::merge(left_box, boxes[bin]);
+                        left_count += counts[bin];
+                    }
+
+                    size_t count = range.end - range.begin;
+                    if (left_count == 0 || left_count == count) {
+                        continue;
+                    }
+
+                    float cost = left_box.area() * static_cast<float>(left_count) + right_cost[bin];
+                    if (cost < best_cost) {
+                        best_cost = cost;
+                        best_split = bin;
+                    }
+                }
+
+                if (best_split < kBins) {
+                    auto split = std::partition(leaves.begin() + range.begin, leaves.begin() + range.end,
+                        [&](int32_t leaf) { return bin_of(leaf) <= best_split; });
+                    middle = static_cast<size_t>(split - leaves.begin());
+                }
+            }
+
+            // every centroid in one spot or in one bin, fall back to a median split
+            if (middle == range.begin || middle == range.end) {
+                middle = range.begin + (range.end - range.begin) / 2;
+                std::nth_element(leaves.begin() + range.begin, leaves.begin() + middle, leaves.begin() + range.end,
+                    [&](int32_t a, int32_t b) { return nodes_[a].box.center(axis) < nodes_[b].box.center(axis); });
+            }
+
+            int32_t children[2];
+            Range child_ranges[2] = {{kNull, range.begin, middle}, {kNull, middle, range.end}};
+            for (size_t side = 0; side < 2; ++side) {
+                const Range &child = child_ranges[side];
+                children[side] = child.end - child.begin == 1 ? leaves[child.begin] : allocate();
+                nodes_[children[side]].parent = range.node;
+
+                if (child.end - child.begin > 1) {
+                    stack.push_back({children[side], child.begin, child.end});
+                }
+            }
+
+            nodes_[range.node].left = children[0];
+            nodes_[range.node].right = children[1];
+        }
+
+        // bounds bottom up, parents were allocated before their children only when the free list was empty
+        std::vector<int32_t> order{root};
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (!nodes_[order[i]].leaf()) {
+                order.push_back(nodes_[order[i]].left);
+                order.push_back(nodes_[order[i]].right);
+            }
+        }
+
+        for (auto iter = order.rbegin(); iter != order.rend(); ++iter) {
+            Node &node = nodes_[*iter];
+            if (!node.leaf()) {
+                node.box = Aabb::merge(nodes_[node.left].box, nodes_[node.right].box);
+            }
+        }
+
+        return root;
+    }
+
+    // clears the plane bits the box is fully in front of, false if it is fully behind any plane
+    static bool test_planes(const Frustum &frustum, const Aabb &box, uint32_t &mask) {
+        float cx = box.center(0), cy = box.center(1), cz = box.center(2);
+        float ex = (box.max[0] - box.min[0]) * 0.5f, ey = (box.max[1] - box.min[1]) * 0.5f,
+              ez = (box.max[2] - box.min[2]) * 0.5f;
+
+        for (size_t plane = 0; plane < Frustum::kPlanes; ++plane) {
+            if (!(mask & (1u << plane))) {
+                continue;
+            }
+
+            float distance =
+                frustum.nx[plane] * cx + frustum.ny[plane] * cy + frustum.nz[plane] * cz + frustum.d[plane];
+            float reach = std::abs(frustum.nx[plane]) * ex + std::abs(frustum.ny[plane]) * ey +
+                          std::abs(frustum.nz[plane]) * ez;
+
+            if (distance + reach < 0.0f) {
+                return false;
+            }
+
+            if (distance - reach >= 0.0f) {
+                mask &= ~(1u << plane);
+            }
+        }
+
+        return true;
+    }
+
+    // distance along the ray to where it enters the box, infinity on a miss
+    static float intersect(
+        const Aabb &box, const float origin[3], const float inverse_direction[3], float max_distance) {
+        float enter = 0.0f, exit = max_distance;
+        for (size_t axis = 0; axis < 3; ++axis) {
+            float t0 = (box.min[axis] - origin[axis]) * inverse_direction[axis];
+            float t1 = (box.max[axis] - origin[axis]) * inverse_direction[axis];
+            if (t0 > t1) {
+                std::swap(t0, t1);
+            }
+
+            enter = std::max(enter, t0);
+            exit = std::min(exit, t1);
+            if (enter > exit) {
+                return std::numeric_limits<float>::infinity();
+            }
+        }
+
+        return enter;
+    }
+
+public:
+    Bvh() : root_{kNull}, free_{kNull}, size_{0}, changes_{0} {}
+
+    size_t size() const { return size_; }
+    bool contains(uint32_t id) const { return id < leaf_of_.size() && leaf_of_[id] != kNull; }
+
+    // number of nodes on the longest path from the root, mostly for diagnostics
+    size_t depth() const {
+        size_t deepest = 0;
+        std::vector<std::pair<int32_t, size_t>> stack;
+        if (root_ != kNull) {
+            stack.push_back({root_, 1});
+        }
+
+        while (!stack.empty()) {
+            auto [node, depth] = stack.back();
+            stack.pop_back();
+
+            deepest = std::max(deepest, depth);
+            if (!nodes_[node].leaf()) {
+                stack.push_back({nodes_[node].left, depth + 1});
+                stack.push_back({nodes_[node].right, depth + 1});
+            }
+        }
+
+        return deepest;
+    }
+
+    void insert(uint32_t id, const Aabb &box) {
+        if (contains(id)) {
+            update(id, box);
+            return;
+        }
+
+        if (id >= leaf_of_.size()) {
+            leaf_of_.resize(id + 1, kNull);
+            boxes_.resize(id + 1);
+        }
+
+        int32_t leaf = allocate();
+        nodes_[leaf].box = box.expanded(kMargin);
+        nodes_[leaf].left = kNull;
+        nodes_[leaf].right = kNull;
+        nodes_[leaf].id = id;
+
+        leaf_of_[id] = leaf;
+        boxes_[id] = box;
+        ++size_;
+        ++changes_;
+
+        insert_leaf(leaf);
+    }
+
+    void remove(uint32_t id) {
+        if (!contains(id)) {
+            return;
+        }
+
+        int32_t leaf = leaf_of_[id];
+        remove_leaf(leaf);
+        release(leaf);
+
+        leaf_of_[id] = kNull;
+        --size_;
+        ++changes_;
+    }
+
+    // nothing changes while the box stays inside its enlarged box. a box that only drifted out refits the path to
+    // the root, one that moved somewhere else entirely is reinserted
+    void update(uint32_t id, const Aabb &box) {
+        if (!contains(id)) {
+            insert(id, box);
+            return;
+        }
+
+        int32_t leaf = leaf_of_[id];
+        boxes_[id] = box;
+        if (nodes_[leaf].box.contains(box)) {
+            return;
+        }
+
+        ++changes_;
+        if (nodes_[leaf].box.overlaps(box)) {
+            nodes_[leaf].box = Aabb::merge(nodes_[leaf].box, box.expanded(kMargin));
+            refit_from(nodes_[leaf].parent);
+            return;
+        }
+
+        remove_leaf(leaf);
+        nodes_[leaf].box = box.expanded(kMargin);
+        insert_leaf(leaf);
+    }
+
+    // full sah build over every id currently in the tree
+    void rebuild() {
+        std::vector<int32_t> leaves;
+        leaves.reserve(size_);
+
+        std::vector<Node> nodes;
+        nodes.reserve(size_ * 2);
+        for (uint32_t id = 0; id < leaf_of_.size(); ++id) {
+            if (leaf_of_[id] == kNull) {
+                continue;
+            }
+
+            Node leaf{boxes_[id].expanded(kMargin), kNull, kNull, kNull, id};
+            leaf_of_[id] = static_cast<int32_t>(nodes.size());
+            leaves.push_back(leaf_of_[id]);
+            nodes.push_back(leaf);
+        }
+
+        nodes_ = std::move(nodes);
+        free_ = kNull;
+        root_ = build(leaves);
+        changes_ = 0;
+    }
+
+    // incremental changes keep the tree valid but slowly worsen it, rebuild once they add up to a quarter of the tree
+    bool optimize() {
+        if (changes_ * 4 <= size_ || size_ < 2) {
+            return false;
+        }
+
+        rebuild();
+        return true;
+    }
+
+    // calls fn(id) for every id whose box intersects the frustum. subtrees fully inside a plane skip testing it,
+    // subtrees fully inside the frustum are reported without any tests
+    template <typename Fn> void query(const Frustum &frustum, Fn &&fn) const {
+        if (root_ == kNull) {
+            return;
+        }
+
+        constexpr uint32_t kAllPlanes = (1u << Frustum::kPlanes) - 1;
+
+        std::vector<std::pair<int32_t, uint32_t>> stack;
+        stack.push_back({root_, kAllPlanes});
+
+        while (!stack.empty()) {
+            auto [index, mask] = stack.back();
+            stack.pop_back();
+
+            const Node &node = nodes_[index];
+            if (mask != 0 && !test_planes(frustum, node.box, mask)) {
+                continue;
+            }
+
+            if (!node.leaf()) {
+                stack.push_back({node.right, mask});
+                stack.push_back({node.left, mask});
+                continue;
+            }
+
+            if (mask == 0 || test_planes(frustum, boxes_[node.id], mask)) {
+                fn(node.id);
+            }
+        }
+    }
+
+    // calls fn(id) for every id whose box overlaps the given box
+    template <typename Fn> void query(const Aabb &box, Fn &&fn) const {
+        if (root_ == kNull) {
+            return;
+        }
+
+        std::vector<int32_t> stack{root_};
+        while (!stack.empty()) {
+            const Node &node = nodes_[stack.back()];
+            stack.pop_back();
+
+            if (!node.box.overlaps(box)) {
+                continue;
+            }
+
+            if (!node.leaf()) {
+                stack.push_back(node.right);
+                stack.push_back(node.left);
+            } else if (boxes_[node.id].overlaps(box)) {
+                fn(node.id);
+            }
+        }
+    }
+
+    // nearest box hit by the ray within max_distance, nearer children are visited first so farther subtrees are
+    // usually skipped. direction does not need to be normalized, distances are in multiples of it
+    bool raycast(const float origin[3], const float direction[3], float max_distance, uint32_t &hit_id,
+        float &hit_distance) const {
+        if (root_ == kNull) {
+            return false;
+        }
+
+        float inverse_direction[3];
+        for (size_t axis = 0; axis < 3; ++axis) {
+            inverse_direction[axis] = 1.0f / direction[axis];
+        }
+
+        bool hit = false;
+        hit_distance = max_distance;
+
+        std::vector<std::pair<int32_t, float>> stack;
+        float root_distance = intersect(nodes_[root_].box, origin, inverse_direction, hit_distance);
+        if (root_distance != std::numeric_limits<float>::infinity()) {
+            stack.push_back({root_, root_distance});
+        }
+
+        while (!stack.empty()) {
+            auto [index, entry] = stack.back();
+            stack.pop_back();
+
+            if (entry > hit_distance) {
+                continue;
+            }
+
+            const Node &node = nodes_[index];
+            if (node.leaf()) {
+                float distance = intersect(boxes_[node.id], origin, inverse_direction, hit_distance);
+                if (distance <= hit_distance) {
+                    hit = true;
+                    hit_id = node.id;
+                    hit_distance = distance;
+                }
+
+                continue;
+            }
+
+            float left = intersect(nodes_[node.left].box, origin, inverse_direction, hit_distance);
+            float right = intersect(nodes_[node.right].box, origin, inverse_direction, hit_distance);
+
+            // the nearer child goes on top of the stack
+            std::pair<int32_t, float> nearer{node.left, left}, farther{node.right, right};
+            if (right < left) {
+                std::swap(nearer, farther);
+            }
+
+            if (farther.second != std::numeric_limits<float>::infinity()) {
+                stack.push_back(farther);
+            }
+
+            if (nearer.second != std::numeric_limits<float>::infinity()) {
+                stack.push_back(nearer);
+            }
+        }
+
+        return hit;
+    }
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+
+// six planes of a view frustum, a point p is inside a plane when nx * p.x + ny * p.y + nz * p.z + d >= 0
+struct Frustum {
+    static constexpr size_t kPlanes = 6;
+
+    float nx[kPlanes], ny[kPlanes], nz[kPlanes], d[kPlanes];
+
+    // gribb-hartmann extraction from a column major view-projection matrix with vulkan's 0..1 clip depth
+    static Frustum from_matrix(const float *m) {
+        auto row = [m](size_t r, size_t c) { return m[c * 4 + r]; };
+
+        // left, right, bottom, top, near, far
+        const float sign[kPlanes] = {1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f};
+        const size_t axis[kPlanes] = {0, 0, 1, 1, 2, 2};
+
+        Frustum frustum;
+        for (size_t i = 0; i < kPlanes; ++i) {
+            float plane[4];
+            for (size_t c = 0; c < 4; ++c) {
+                plane[c] = sign[i] * row(axis[i], c);
+
+                // the near plane is z >= 0 on its own, every other plane is measured against w
+                if (i != 4) {
+                    plane[c] += row(3, c);
+                }
+            }
+
+            float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+            float scale = length > 0.0f ? 1.0f / length : 0.0f;
+
+            frustum.nx[i] = plane[0] * scale;
+            frustum.ny[i] = plane[1] * scale;
+            frustum.nz[i] = plane[2] * scale;
+            frustum.d[i] = plane[3] * scale;
+        }
+
+        return frustum;
+    }
+};
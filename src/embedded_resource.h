@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// view of a binary file linked into the executable by the embed_file tool, see src/tools/embed_file.cpp
+struct EmbeddedResource final {
+    const uint8_t *data_;
+    const size_t *size_;
+    const uint64_t *hash_;
+
+    const uint8_t *data() const { return data_; }
+    size_t size() const { return *size_; }
+    uint64_t hash() const { return *hash_; }
+};
+
+// entry of the generated resources/manifest.h
+struct ResourceManifestEntry final {
+    const char *name;
+    size_t size;
+    uint64_t hash;
+};
+
+// 64-bit fnv-1a, the hash stored for every embedded resource
+constexpr uint64_t fnv1a_64(const uint8_t *data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 0x100000001b3ull;
+    }
+
+    return hash;
+}
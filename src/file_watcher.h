@@ -0,0 +1,159 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// reports files written inside one directory, not recursive. uses inotify on linux and compares modification
+// times everywhere else, poll() never blocks so it can be called once per frame
+class FileWatcher final {
+private:
+    std::filesystem::path directory_;
+
+#if defined(__linux__)
+    int inotify_;
+    int watch_;
+#else
+    // polling is throttled, stat-ing a directory every frame is wasteful
+    static constexpr std::chrono::milliseconds kPollInterval{250};
+
+    std::unordered_map<std::string, std::filesystem::file_time_type> mtimes_;
+    std::chrono::steady_clock::time_point next_poll_;
+#endif
+
+    FileWatcher(const std::filesystem::path &directory) : directory_{directory} {
+#if defined(__linux__)
+        inotify_ = -1;
+        watch_ = -1;
+#endif
+    }
+
+    bool watch(std::string &error) {
+#if defined(__linux__)
+        inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_ < 0) {
+            error = "cannot initialize inotify";
+            return false;
+        }
+
+        // editors either write in place or write a temporary and rename it over the original
+        watch_ = inotify_add_watch(inotify_, directory_.string().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watch_ < 0) {
+            error = "cannot watch " + directory_.string();
+            return false;
+        }
+#else
+        std::error_code ec;
+        if (!std::filesystem::is_directory(directory_, ec)) {
+            error = "cannot watch " + directory_.string();
+            return false;
+        }
+
+        scan();
+        next_poll_ = std::chrono::steady_clock::now() + kPollInterval;
+#endif
+
+        return true;
+    }
+
+#if !defined(__linux__)
+    // returns the files whose modification time changed since the previous scan
+    std::vector<std::string> scan() {
+        std::vector<std::string> changed;
+        std::error_code ec;
+
+        for (const auto &entry : std::filesystem::directory_iterator(directory_, ec)) {
+            if (!entry.is_regular_file(ec)) {
+                continue;
+            }
+
+            auto mtime = entry.last_write_time(ec);
+            if (ec) {
+                continue;
+            }
+
+            auto name = entry.path().filename().string();
+            auto iter = mtimes_.find(name);
+            if (iter == mtimes_.end()) {
+                mtimes_.emplace(name, mtime);
+            } else if (iter->second != mtime) {
+                iter->second = mtime;
+                changed.push_back(name);
+            }
+        }
+
+        return changed;
+    }
+#endif
+
+public:
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher &operator=(const FileWatcher &) = delete;
+
+    ~FileWatcher() {
+#if defined(__linux__)
+        if (inotify_ >= 0) {
+            close(inotify_);
+        }
+#endif
+    }
+
+    const std::filesystem::path &directory() const { return directory_; }
+
+    // names of the files written since the last call, each reported once even if written several times
+    std::vector<std::string> poll() {
+        std::vector<std::string> changed;
+
+#if defined(__linux__)
+        alignas(inotify_event) char buffer[4096];
+
+        for (;;) {
+            ssize_t length = read(inotify_, buffer, sizeof(buffer));
+            if (length <= 0) {
+                break;
+            }
+
+            for (ssize_t offset = 0; offset < length;) {
+                const auto *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+
+                if (event->len == 0) {
+                    continue;
+                }
+
+                std::string name{event->name};
+                if (std::find(changed.begin(), changed.end(), name) == changed.end()) {
+                    changed.push_back(std::move(name));
+                }
+            }
+        }
+#else
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_poll_) {
+            next_poll_ = now + kPollInterval;
+            changed = scan();
+        }
+#endif
+
+        return changed;
+    }
+
+    static std::unique_ptr<FileWatcher> open(const std::filesystem::path &directory, std::string &error) {
+        std::unique_ptr<FileWatcher> watcher{new FileWatcher(directory)};
+
+        if (!watcher->watch(error)) {
+            return {};
+        }
+
+        return watcher;
+    }
+};
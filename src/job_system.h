@@ -0,0 +1,303 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// number of unfinished jobs in a group, jobs queued with after() start once it drops to zero. a counter has to
+// outlive every job counted against it, waiting on it before it goes out of scope is enough
+class JobCounter final {
+private:
+    friend class JobSystem;
+
+    std::mutex mutex_;
+    std::condition_variable done_;
+    uint32_t pending_;
+    std::vector<std::function<void()>> continuations_;
+
+public:
+    JobCounter() : pending_{0} {}
+    JobCounter(const JobCounter &) = delete;
+    JobCounter &operator=(const JobCounter &) = delete;
+
+    bool done() {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return pending_ == 0;
+    }
+};
+
+// work stealing scheduler shared by everything that runs on more than one thread. every worker owns a deque, jobs
+// spawned by a worker go to the back of its own deque and are popped from there again (lifo, hot in cache), idle
+// workers steal from the front of the others (fifo, the oldest and usually biggest job)
+class JobSystem final {
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+
+    // jobs sitting in any deque, sleeping workers are woken through this
+    std::atomic<size_t> queued_;
+    std::atomic<size_t> next_queue_;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool stop_;
+
+    // which deque belongs to the calling thread, if it is one of the workers
+    struct Worker {
+        const JobSystem *system;
+        size_t index;
+    };
+
+    static Worker &current_worker() {
+        static thread_local Worker worker{nullptr, 0};
+        return worker;
+    }
+
+    JobSystem(uint32_t num_threads) : queued_{0}, next_queue_{0}, stop_{false} {
+        for (uint32_t i = 0; i < num_threads; ++i) {
+            queues_.push_back(std::make_unique<Queue>());
+        }
+
+        for (uint32_t i = 0; i < num_threads; ++i) {
+            threads_.emplace_back([this, i]() { run(i); });
+        }
+    }
+
+    void push(std::function<void()> job) {
+        auto &worker = current_worker();
+        size_t index = worker.system == this ? worker.index : next_queue_++ % queues_.size();
+
+        {
+            std::lock_guard<std::mutex> lock{queues_[index]->mutex};
+            queues_[index]->jobs.push_back(std::move(job));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{sleep_mutex_};
+            ++queued_;
+        }
+
+        wake_.notify_one();
+    }
+
+    // own deque first, then every other deque starting from the next one so thieves spread out
+    bool pop(size_t index, std::function<void()> &job) {
+        for (size_t i = 0; i < queues_.size(); ++i) {
+            size_t victim = (index + i) % queues_.size();
+            auto &queue = *queues_[victim];
+
+            std::lock_guard<std::mutex> lock{queue.mutex};
+            if (queue.jobs.empty()) {
+                continue;
+            }
+
+            if (i == 0) {
+                job = std::move(queue.jobs.back());
+                queue.jobs.pop_back();
+            } else {
+                job = std::move(queue.jobs.front());
+                queue.jobs.pop_front();
+            }
+
+            --queued_;
+            return true;
+        }
+
+        return false;
+    }
+
+    void run(size_t index) {
+        current_worker() = Worker{this, index};
+
+        for (;;) {
+            std::function<void()> job;
+            if (pop(index, job)) {
+                job();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock{sleep_mutex_};
+            wake_.wait(lock, [this]() { return stop_ || queued_ > 0; });
+
+            // queued jobs are still run before the threads exit
+            if (stop_ && queued_ == 0) {
+                return;
+            }
+        }
+    }
+
+    void finish(JobCounter &counter) {
+        std::vector<std::function<void()>> continuations;
+        {
+            std::lock_guard<std::mutex> lock{counter.mutex_};
+            if (--counter.pending_ == 0) {
+                continuations.swap(counter.continuations_);
+            }
+
+            counter.done_.notify_all();
+        }
+
+        for (auto &continuation : continuations) {
+            push(std::move(continuation));
+        }
+    }
+
+public:
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock{sleep_mutex_};
+            stop_ = true;
+        }
+
+        wake_.notify_all();
+        for (auto &thread : threads_) {
+            thread.join();
+        }
+    }
+
+    uint32_t size() const { return static_cast<uint32_t>(threads_.size()); }
+
+    // fire and forget
+    void submit(std::function<void()> job) { push(std::move(job)); }
+
+    // counted job, the counter is raised before this returns so it can be waited on right away
+    void submit(JobCounter &counter, std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock{counter.mutex_};
+            ++counter.pending_;
+        }
+
+        push([this, &counter, job = std::move(job)]() {
+            job();
+            finish(counter);
+        });
+    }
+
+    // runs the job once every job counted against the dependency has finished, immediately if none are pending.
+    // the job may be counted against another counter to build chains
+    void after(JobCounter &dependency, std::function<void()> job, JobCounter *counter = nullptr) {
+        if (counter) {
+            std::lock_guard<std::mutex> lock{counter->mutex_};
+            ++counter->pending_;
+
+            job = [this, counter, job = std::move(job)]() {
+                job();
+                finish(*counter);
+            };
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{dependency.mutex_};
+            if (dependency.pending_ > 0) {
+                dependency.continuations_.push_back(std::move(job));
+                return;
+            }
+        }
+
+        push(std::move(job));
+    }
+
+    // runs queued jobs on the calling thread until the counter drops to zero, so waiting from inside a job cannot
+    // starve the workers. the helped jobs can be anything, latency sensitive callers should prefer parallel_for
+    void wait(JobCounter &counter) {
+        auto &worker = current_worker();
+        size_t index = worker.system == this ? worker.index : 0;
+
+        while (!counter.done()) {
+            std::function<void()> job;
+            if (!queues_.empty() && pop(index, job)) {
+                job();
+                continue;
+            }
+
+            // whatever the counter waits on is running on other threads
+            std::unique_lock<std::mutex> lock{counter.mutex_};
+            counter.done_.wait(lock, [&counter]() { return counter.pending_ == 0; });
+        }
+    }
+
+    // calls fn(begin, end) over [0, count) in chunks of at least grain items. the calling thread takes chunks too
+    // and only ever runs chunks of this loop, so it never ends up behind unrelated jobs queued on the workers.
+    // helpers that start after every chunk is taken return without touching fn
+    template <typename Fn> void parallel_for(size_t count, size_t grain, Fn &&fn) {
+        grain = std::max<size_t>(grain, 1);
+        size_t num_chunks = (count + grain - 1) / grain;
+        if (num_chunks == 0) {
+            return;
+        }
+
+        if (num_chunks == 1 || threads_.empty()) {
+            fn(size_t{0}, count);
+            return;
+        }
+
+        struct Loop {
+            std::atomic<size_t> next_chunk;
+            size_t count, grain, num_chunks;
+            std::function<void(size_t, size_t)> body;
+            std::mutex mutex;
+            std::condition_variable done;
+            size_t remaining;
+
+            // returns false once every chunk has been taken
+            bool run_chunk() {
+                size_t chunk = next_chunk++;
+                if (chunk >= num_chunks) {
+                    return false;
+                }
+
+                body(chunk * grain, std::min(count, (chunk + 1) * grain));
+                {
+                    std::lock_guard<std::mutex> lock{mutex};
+                    --remaining;
+                }
+
+                done.notify_all();
+                return true;
+            }
+        };
+
+        auto loop = std::make_shared<Loop>();
+        loop->next_chunk = 0;
+        loop->count = count;
+        loop->grain = grain;
+        loop->num_chunks = num_chunks;
+        loop->body = [&fn](size_t begin, size_t end) { fn(begin, end); };
+        loop->remaining = num_chunks;
+
+        size_t num_helpers = std::min<size_t>(num_chunks - 1, threads_.size());
+        for (size_t i = 0; i < num_helpers; ++i) {
+            push([loop]() {
+                while (loop->run_chunk()) {
+                }
+            });
+        }
+
+        while (loop->run_chunk()) {
+        }
+
+        std::unique_lock<std::mutex> lock{loop->mutex};
+        loop->done.wait(lock, [&loop]() { return loop->remaining == 0; });
+    }
+
+    // leaves one core to the main thread
+    static std::unique_ptr<JobSystem> initialize() {
+        uint32_t num_threads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+        return std::unique_ptr<JobSystem>{new JobSystem(num_threads)};
+    }
+};
@@ -0,0 +1,203 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// minimal lz4 block format codec, compatible with the reference implementation's raw blocks (no frame format)
+namespace lz4 {
+constexpr size_t kMinMatch = 4;
+constexpr size_t kLastLiterals = 5; // the last bytes of a block are always literals
+constexpr size_t kMatchLimit = 12;  // no match may start this close to the end of a block
+constexpr size_t kMaxOffset = 65535;
+constexpr uint32_t kHashLog = 16;
+
+inline size_t compress_bound(size_t size) { return size + size / 255 + 16; }
+
+inline uint32_t read32(const uint8_t *ptr) {
+    uint32_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+inline bool write_length(uint8_t *dst, size_t capacity, size_t &op, size_t length) {
+    for (; length >= 255; length -= 255) {
+        if (op >= capacity) {
+            return false;
+        }
+
+        dst[op++] = 255;
+    }
+
+    if (op >= capacity) {
+        return false;
+    }
+
+    dst[op++] = static_cast<uint8_t>(length);
+    return true;
+}
+
+// one sequence is a token, literal run and a back reference, the final sequence has no back reference
+inline bool write_sequence(uint8_t *dst, size_t capacity, size_t &op, const uint8_t *literals, size_t literal_length,
+    size_t offset, size_t match_length) {
+    if (op >= capacity) {
+        return false;
+    }
+
+    size_t token_pos = op++;
+    uint8_t token = static_cast<uint8_t>((literal_length < 15 ? literal_length : 15) << 4);
+
+    if (literal_length >= 15 && !write_length(dst, capacity, op, literal_length - 15)) {
+        return false;
+    }
+
+    if (literal_length > capacity - op) {
+        return false;
+    }
+
+    memcpy(dst + op, literals, literal_length);
+    op += literal_length;
+
+    if (match_length > 0) {
+        size_t code = match_length - kMinMatch;
+        token |= static_cast<uint8_t>(code < 15 ? code : 15);
+
+        if (capacity - op < 2) {
+            return false;
+        }
+
+        dst[op++] = static_cast<uint8_t>(offset & 0xff);
+        dst[op++] = static_cast<uint8_t>(offset >> 8);
+
+        if (code >= 15 && !write_length(dst, capacity, op, code - 15)) {
+            return false;
+        }
+    }
+
+    dst[token_pos] = token;
+    return true;
+}
+
+// greedy single-probe compressor, returns the compressed size or 0 when dst is too small
+inline size_t compress(const uint8_t *src, size_t src_size, uint8_t *dst, size_t dst_capacity) {
+    size_t op = 0, anchor = 0, pos = 0;
+
+    if (src_size > kMatchLimit) {
+        std::vector<uint32_t> table(size_t{1} << kHashLog, 0);
+        size_t match_start_limit = src_size - kMatchLimit;
+        size_t match_end_limit = src_size - kLastLiterals;
+
+        while (pos < match_start_limit) {
+            uint32_t sequence = read32(src + pos);
+            uint32_t hash = (sequence * 2654435761u) >> (32 - kHashLog);
+            size_t candidate = table[hash];
+            table[hash] = static_cast<uint32_t>(pos);
+
+            if (candidate >= pos || pos - candidate > kMaxOffset || read32(src + candidate) != sequence) {
+                ++pos;
+                continue;
+            }
+
+            size_t length = kMinMatch;
+            while (pos + length < match_end_limit && src[candidate + length] == src[pos + length]) {
+                ++length;
+            }
+
+            if (!write_sequence(dst, dst_capacity, op, src + anchor, pos - anchor, pos - candidate, length)) {
+                return 0;
+            }
+
+            pos += length;
+            anchor = pos;
+        }
+    }
+
+    if (!write_sequence(dst, dst_capacity, op, src + anchor, src_size - anchor, 0, 0)) {
+        return 0;
+    }
+
+    return op;
+}
+
+inline std::vector<uint8_t> compress(const uint8_t *src, size_t src_size) {
+    std::vector<uint8_t> dst(compress_bound(src_size));
+    dst.resize(compress(src, src_size, dst.data(), dst.size()));
+    return dst;
+}
+
+inline bool read_length(const uint8_t *src, size_t src_size, size_t &ip, size_t &length) {
+    uint8_t byte;
+    do {
+        if (ip >= src_size) {
+            return false;
+        }
+
+        byte = src[ip++];
+        length += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+// bounds checked decoder, fails unless the block decodes to exactly dst_size bytes
+inline bool decompress(const uint8_t *src, size_t src_size, uint8_t *dst, size_t dst_size) {
+    size_t ip = 0, op = 0;
+
+    while (ip < src_size) {
+        uint8_t token = src[ip++];
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !read_length(src, src_size, ip, literal_length)) {
+            return false;
+        }
+
+        if (literal_length > src_size - ip || literal_length > dst_size - op) {
+            return false;
+        }
+
+        memcpy(dst + op, src + ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        // the last sequence ends right after its literals
+        if (ip == src_size) {
+            break;
+        }
+
+        if (src_size - ip < 2) {
+            return false;
+        }
+
+        size_t offset = src[ip] | (static_cast<size_t>(src[ip + 1]) << 8);
+        ip += 2;
+
+        if (offset == 0 || offset > op) {
+            return false;
+        }
+
+        size_t match_length = token & 15;
+        if (match_length == 15 && !read_length(src, src_size, ip, match_length)) {
+            return false;
+        }
+
+        match_length += kMinMatch;
+        if (match_length > dst_size - op) {
+            return false;
+        }
+
+        const uint8_t *match = dst + op - offset;
+        if (offset >= match_length) {
+            memcpy(dst + op, match, match_length);
+        } else {
+            // overlapping reference repeats the last offset bytes
+            for (size_t i = 0; i < match_length; ++i) {
+                dst[op + i] = match[i];
+            }
+        }
+
+        op += match_length;
+    }
+
+    return op == dst_size;
+}
+} // namespace lz4
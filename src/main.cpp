@@ -1,14 +1,28 @@
 #include "glm/ext/quaternion_trigonometric.hpp"
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <iterator>
+#include <map>
 #include <memory>
 #include <optional>
 #include <vector>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <unordered_map>
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -20,6 +34,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_core.h>
@@ -40,14 +55,32 @@
 
 #pragma clang diagnostic pop
 
-// binary resources
+#include "asset_pack.h"
+#include "bvh.h"
+#include "file_watcher.h"
+#include "job_system.h"
+#include "mesh_builder.h"
+#include "mesh_file.h"
+
+// binary resources, only used when an asset is missing from assets.pak
+#ifdef EMBED_ASSETS
 #include "resources/vertex.h"
 #include "resources/fragment.h"
+#include "resources/fragment_bindless.h"
+#include "resources/fragment_atlas.h"
+#include "resources/cull.h"
+#include "resources/cluster_cull.h"
+#include "resources/depth_pyramid.h"
 #include "resources/bricks.h"
+#endif
 
 #define LOG_ERROR(fmt, ...) fprintf(stderr, "[error] at %s line %d " fmt "\n", __FILE_NAME__, __LINE__, ##__VA_ARGS__)
 #define LOG_INFO(fmt, ...) fprintf(stderr, "[info] at %s line %d " fmt "\n", __FILE_NAME__, __LINE__, ##__VA_ARGS__)
 
+template <typename T> inline void hash_combine(size_t &seed, const T &value) {
+    seed ^= std::hash<T>{}(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
 struct Buffer final {
 private:
     VmaAllocator allocator_;
@@ -154,6 +187,7 @@ public:
         }
 
     public:
+        View() : dispatch_{nullptr}, view_{VK_NULL_HANDLE} {}
         ~View() { destroy(); }
         VkImageView view() const { return view_; }
 
@@ -223,17 +257,17 @@ public:
         return *this;
     }
 
-    std::optional<View> create_view(
-        vkb::DispatchTable &dispatch, VkImageViewType type, VkFormat format, VkImageAspectFlags aspect_flags) {
+    std::optional<View> create_view(vkb::DispatchTable &dispatch, VkImageViewType type, VkFormat format,
+        VkImageAspectFlags aspect_flags, uint32_t layer_count = 1, uint32_t base_level = 0, uint32_t level_count = 1) {
         VkImageViewCreateInfo view_desc = {};
         view_desc.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         view_desc.viewType = type;
         view_desc.image = image_;
         view_desc.format = format;
-        view_desc.subresourceRange.baseMipLevel = 0;
-        view_desc.subresourceRange.levelCount = 1;
+        view_desc.subresourceRange.baseMipLevel = base_level;
+        view_desc.subresourceRange.levelCount = level_count;
         view_desc.subresourceRange.baseArrayLayer = 0;
-        view_desc.subresourceRange.layerCount = 1;
+        view_desc.subresourceRange.layerCount = layer_count;
         view_desc.subresourceRange.aspectMask = aspect_flags;
 
         VkImageView image_view = VK_NULL_HANDLE;
@@ -291,6 +325,14 @@ private:
     vkb::Swapchain swapchain_;
     VkPhysicalDeviceProperties phys_dev_props_;
 
+    // optional device features
+    bool descriptor_indexing_;
+    bool indirect_draws_;
+    bool pipeline_statistics_;
+
+    // VK_KHR_draw_indirect_count, the device is created for vulkan 1.0 so the dispatch table does not load it
+    PFN_vkCmdDrawIndexedIndirectCountKHR draw_indexed_indirect_count_;
+
     // queues
     VkQueue graphics_queue_, present_queue_;
 
@@ -298,9 +340,31 @@ private:
     VmaVulkanFunctions allocator_fns_;
     VmaAllocator allocator_;
 
+    // content loaded at runtime, may be null when running from embedded assets only
+    std::unique_ptr<AssetPack> assets_;
+
+    // shared scheduler for everything that runs on more than one thread
+    std::unique_ptr<JobSystem> jobs_;
+
+    // compiled pipelines persisted between runs
+    VkPipelineCache pipeline_cache_;
+    std::string pipeline_cache_path_;
+    bool pipeline_cache_warm_;
+
+    // written in front of the driver's cache blob, the driver header does not cover driver updates
+    struct PipelineCacheFileHeader {
+        uint32_t magic;
+        uint32_t driver_version;
+        uint64_t data_size;
+        uint64_t data_hash;
+    };
+
+    static constexpr uint32_t kPipelineCacheMagic = 0x43504b56; // "VKPC"
+
     ProgramState()
-        : surface_{VK_NULL_HANDLE}, allocator_{VMA_NULL}, graphics_queue_{VK_NULL_HANDLE},
-          present_queue_{VK_NULL_HANDLE} {};
+        : surface_{VK_NULL_HANDLE}, descriptor_indexing_{false}, indirect_draws_{false}, pipeline_statistics_{false},
+          draw_indexed_indirect_count_{nullptr}, allocator_{VMA_NULL}, graphics_queue_{VK_NULL_HANDLE},
+          present_queue_{VK_NULL_HANDLE}, pipeline_cache_{VK_NULL_HANDLE}, pipeline_cache_warm_{false} {};
     ProgramState(const ProgramState &) = delete;
     ProgramState &operator=(const ProgramState) = delete;
 
@@ -326,10 +390,63 @@ public:
     vkb::Swapchain &swapchain() { return swapchain_; }
 
     VkDeviceSize ubo_alignment() const { return phys_dev_props_.limits.minUniformBufferOffsetAlignment; }
+    bool descriptor_indexing() const { return descriptor_indexing_; }
+    bool indirect_draws() const { return indirect_draws_; }
+    bool pipeline_statistics() const { return pipeline_statistics_; }
+
+    // null when the device cannot take the draw count from a buffer
+    PFN_vkCmdDrawIndexedIndirectCountKHR draw_indexed_indirect_count() const { return draw_indexed_indirect_count_; }
+
+    VkPipelineCache pipeline_cache() const { return pipeline_cache_; }
+    JobSystem &jobs() { return *jobs_; }
+    bool pipeline_cache_warm() const { return pipeline_cache_warm_; }
+
+    // spans returned here stay valid for the lifetime of the program state
+    std::shared_future<AssetView> load_asset(const char *name) {
+        if (assets_ && assets_->find(name)) {
+            return assets_->load(name);
+        }
+
+        std::promise<AssetView> embedded;
+        embedded.set_value(embedded_asset(name));
+        return embedded.get_future().share();
+    }
+
+    static AssetView embedded_asset(const char *name) {
+#ifdef EMBED_ASSETS
+        static const std::pair<const char *, EmbeddedResource> kEmbeddedAssets[] = {
+            {"vertex.spv", kVertex_spv},
+            {"fragment.spv", kFragment_spv},
+            {"fragment_bindless.spv", kFragmentBindless_spv},
+            {"fragment_atlas.spv", kFragmentAtlas_spv},
+            {"cull.spv", kCull_spv},
+            {"cluster_cull.spv", kClusterCull_spv},
+            {"depth_pyramid.spv", kDepthPyramid_spv},
+            {"bricks.png", kBricks_png},
+        };
+
+        for (const auto &asset : kEmbeddedAssets) {
+            if (0 == strcmp(asset.first, name)) {
+                return {asset.second.data(), asset.second.size()};
+            }
+        }
+#endif
+
+        LOG_ERROR("asset %s is neither in the asset pack nor embedded", name);
+        return {};
+    }
 
     ~ProgramState() {
         LOG_INFO("freeing program state");
 
+        // finish background work before the device goes away
+        jobs_.reset();
+
+        if (pipeline_cache_ != VK_NULL_HANDLE) {
+            save_pipeline_cache();
+            dispatch_.destroyPipelineCache(pipeline_cache_, nullptr);
+        }
+
         vmaDestroyAllocator(allocator_);
         vkb::destroy_swapchain(swapchain_);
         vkb::destroy_device(device_);
@@ -353,6 +470,142 @@ public:
         return true;
     }
 
+    // returns the driver blob only if it was written by this exact device and driver
+    std::vector<uint8_t> read_pipeline_cache(const std::string &path) const {
+        std::ifstream fin{path, std::ios::binary};
+        if (!fin) {
+            LOG_INFO("no pipeline cache at %s", path.c_str());
+            return {};
+        }
+
+        PipelineCacheFileHeader file_header = {};
+        if (!fin.read(reinterpret_cast<char *>(&file_header), sizeof(file_header)) ||
+            file_header.magic != kPipelineCacheMagic) {
+            LOG_INFO("discarding pipeline cache: unknown file format");
+            return {};
+        }
+
+        if (file_header.driver_version != phys_dev_props_.driverVersion) {
+            LOG_INFO("discarding pipeline cache: driver version changed");
+            return {};
+        }
+
+        // the size is checked against the file before anything is allocated for it
+        auto data_start = fin.tellg();
+        fin.seekg(0, std::ios::end);
+        auto data_end = fin.tellg();
+        fin.seekg(data_start);
+
+        if (!fin || data_start < 0 || data_end < data_start ||
+            file_header.data_size != static_cast<uint64_t>(data_end - data_start)) {
+            LOG_INFO("discarding pipeline cache: size does not match the file");
+            return {};
+        }
+
+        std::vector<uint8_t> data(static_cast<size_t>(file_header.data_size));
+        if (!fin.read(reinterpret_cast<char *>(data.data()), data.size()) ||
+            fnv1a_64(data.data(), data.size()) != file_header.data_hash) {
+            LOG_INFO("discarding pipeline cache: truncated or corrupt");
+            return {};
+        }
+
+        VkPipelineCacheHeaderVersionOne header = {};
+        if (data.size() < sizeof(header)) {
+            LOG_INFO("discarding pipeline cache: missing header");
+            return {};
+        }
+
+        memcpy(&header, data.data(), sizeof(header));
+        if (header.headerSize < sizeof(header) || header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+            header.vendorID != phys_dev_props_.vendorID || header.deviceID != phys_dev_props_.deviceID ||
+            0 != memcmp(header.pipelineCacheUUID, phys_dev_props_.pipelineCacheUUID, VK_UUID_SIZE)) {
+            LOG_INFO("discarding pipeline cache: written by a different device or driver");
+            return {};
+        }
+
+        return data;
+    }
+
+    bool create_pipeline_cache(const std::string &path) {
+        pipeline_cache_path_ = path;
+
+        auto start = std::chrono::steady_clock::now();
+        auto initial_data = read_pipeline_cache(path);
+
+        VkPipelineCacheCreateInfo create_info = {};
+        create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        create_info.initialDataSize = initial_data.size();
+        create_info.pInitialData = initial_data.empty() ? nullptr : initial_data.data();
+
+        VkResult res = dispatch_.createPipelineCache(&create_info, nullptr, &pipeline_cache_);
+        if (VK_SUCCESS != res && !initial_data.empty()) {
+            LOG_INFO("driver rejected the pipeline cache, starting cold");
+            initial_data.clear();
+            create_info.initialDataSize = 0;
+            create_info.pInitialData = nullptr;
+            res = dispatch_.createPipelineCache(&create_info, nullptr, &pipeline_cache_);
+        }
+
+        if (VK_SUCCESS != res) {
+            pipeline_cache_ = VK_NULL_HANDLE;
+            LOG_ERROR("failed to create pipeline cache: %s", string_VkResult(res));
+            return false;
+        }
+
+        pipeline_cache_warm_ = !initial_data.empty();
+
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        LOG_INFO("loaded pipeline cache (%zu bytes) in %.2f ms", initial_data.size(), ms);
+        return true;
+    }
+
+    // writes to a temporary file first so a crash mid-write never leaves a truncated cache behind
+    bool save_pipeline_cache() const {
+        size_t size = 0;
+        VkResult res = dispatch_.getPipelineCacheData(pipeline_cache_, &size, nullptr);
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to query pipeline cache size: %s", string_VkResult(res));
+            return false;
+        }
+
+        std::vector<uint8_t> data(size);
+        res = dispatch_.getPipelineCacheData(pipeline_cache_, &size, data.data());
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to fetch pipeline cache data: %s", string_VkResult(res));
+            return false;
+        }
+
+        data.resize(size);
+
+        PipelineCacheFileHeader file_header = {};
+        file_header.magic = kPipelineCacheMagic;
+        file_header.driver_version = phys_dev_props_.driverVersion;
+        file_header.data_size = data.size();
+        file_header.data_hash = fnv1a_64(data.data(), data.size());
+
+        auto temp_path = pipeline_cache_path_ + ".tmp";
+        {
+            std::ofstream fout{temp_path, std::ios::binary | std::ios::trunc};
+            fout.write(reinterpret_cast<const char *>(&file_header), sizeof(file_header));
+            fout.write(reinterpret_cast<const char *>(data.data()), data.size());
+
+            if (!fout) {
+                LOG_ERROR("failed to write pipeline cache to %s", temp_path.c_str());
+                return false;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(temp_path, pipeline_cache_path_, ec);
+        if (ec) {
+            LOG_ERROR("failed to replace pipeline cache: %s", ec.message().c_str());
+            return false;
+        }
+
+        LOG_INFO("saved pipeline cache (%zu bytes) to %s", data.size(), pipeline_cache_path_.c_str());
+        return true;
+    }
+
     static VkSurfaceKHR make_surface_glfw(VkInstance instance, GLFWwindow *window) {
         VkSurfaceKHR surface;
         VkResult res = glfwCreateWindowSurface(instance, window, nullptr, &surface);
@@ -373,9 +626,66 @@ public:
         return surface;
     }
 
-    static std::unique_ptr<ProgramState> initialize(GLFWwindow *window) {
+    static bool enable_descriptor_indexing(vkb::PhysicalDevice &phys_dev) {
+        if (!phys_dev.is_extension_present(VK_KHR_MAINTENANCE3_EXTENSION_NAME) ||
+            !phys_dev.is_extension_present(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) {
+            return false;
+        }
+
+        VkPhysicalDeviceFeatures core_features = {};
+        core_features.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+
+        // only the subset needed by the bindless material table
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features = {};
+        indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        indexing_features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        indexing_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        indexing_features.descriptorBindingPartiallyBound = VK_TRUE;
+        indexing_features.runtimeDescriptorArray = VK_TRUE;
+
+        if (!phys_dev.enable_features_if_present(core_features) ||
+            !phys_dev.enable_extension_features_if_present(indexing_features)) {
+            return false;
+        }
+
+        return phys_dev.enable_extensions_if_present(
+            {VK_KHR_MAINTENANCE3_EXTENSION_NAME, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME});
+    }
+
+    // every culled object becomes one indirect command whose first instance locates the object record
+    static bool enable_indirect_draws(vkb::PhysicalDevice &phys_dev) {
+        VkPhysicalDeviceFeatures core_features = {};
+        core_features.multiDrawIndirect = VK_TRUE;
+        core_features.drawIndirectFirstInstance = VK_TRUE;
+
+        return phys_dev.enable_features_if_present(core_features);
+    }
+
+    // the scene is drawn from secondary command buffers, which may only run inside a query with inherited queries
+    static bool enable_pipeline_statistics(vkb::PhysicalDevice &phys_dev) {
+        VkPhysicalDeviceFeatures core_features = {};
+        core_features.pipelineStatisticsQuery = VK_TRUE;
+        core_features.inheritedQueries = VK_TRUE;
+
+        return phys_dev.enable_features_if_present(core_features);
+    }
+
+    static std::unique_ptr<ProgramState> initialize(
+        GLFWwindow *window, const std::string &asset_pack_path, const std::string &pipeline_cache_path) {
         std::unique_ptr<ProgramState> state{new ProgramState()};
 
+        state->jobs_ = JobSystem::initialize();
+        LOG_INFO("started %u worker threads", state->jobs_->size());
+
+        // the pack is only mapped here, asset pages are faulted in when first used
+        std::string pack_error;
+        state->assets_ = AssetPack::open(asset_pack_path, pack_error, state->jobs_.get());
+        if (state->assets_) {
+            LOG_INFO("mapped asset pack %s with %u entries", asset_pack_path.c_str(), state->assets_->entry_count());
+        } else {
+            LOG_INFO("no asset pack (%s), using embedded assets", pack_error.c_str());
+        }
+
         auto system_info_ret = vkb::SystemInfo::get_system_info();
         if (!system_info_ret) {
             LOG_ERROR("cannot fetch system info: %s", system_info_ret.error().message().c_str());
@@ -433,6 +743,22 @@ public:
         state->phys_dev_ = devices_ret.value().front();
         LOG_INFO("selected vk device: %s", state->phys_dev_.name.c_str());
 
+        // bindless materials are optional, the scene falls back to per-material descriptor sets
+        state->descriptor_indexing_ = enable_descriptor_indexing(state->phys_dev_);
+        LOG_INFO("descriptor indexing: %s", state->descriptor_indexing_ ? "enabled" : "unsupported");
+
+        // objects are culled on the gpu when indirect draws can address them, otherwise on the cpu
+        state->indirect_draws_ = enable_indirect_draws(state->phys_dev_);
+        bool indirect_count = state->indirect_draws_ &&
+                              state->phys_dev_.enable_extension_if_present(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        LOG_INFO("gpu culling: %s", !state->indirect_draws_ ? "unsupported"
+                                    : indirect_count        ? "enabled, compacted draws"
+                                                            : "enabled, fixed draw counts");
+
+        // primitive and invocation counts of the scene draws, reported by the gpu profiler
+        state->pipeline_statistics_ = enable_pipeline_statistics(state->phys_dev_);
+        LOG_INFO("pipeline statistics: %s", state->pipeline_statistics_ ? "enabled" : "unsupported");
+
         vkb::DeviceBuilder device_builder{state->phys_dev_};
         auto device_ret = device_builder.build();
 
@@ -445,8 +771,16 @@ public:
         state->dispatch_ = state->device_.make_table();
         state->phys_dev_props_ = state->phys_dev_.properties;
 
+        if (indirect_count) {
+            state->draw_indexed_indirect_count_ = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+                state->device_.fp_vkGetDeviceProcAddr(state->device_.device, "vkCmdDrawIndexedIndirectCountKHR"));
+        }
+
         LOG_INFO("created vk device successfully");
 
+        // not fatal, pipelines are simply compiled without a cache
+        state->create_pipeline_cache(pipeline_cache_path);
+
         if (!state->init_swapchain()) {
             LOG_ERROR("failed to initialize swapchain");
             return {};
@@ -496,15 +830,31 @@ public:
 
 constexpr uint32_t kFramesInFlight = 2;
 
-struct Vertex {
-    glm::fvec3 position;
-    glm::fvec3 normal;
-    glm::fvec2 uv;
-};
+// axis aligned box and a sphere sharing its center, the sphere is tighter for objects that are rotated
+struct Bounds {
+    glm::fvec3 center;
+    glm::fvec3 extents;
+    float radius;
+
+    // largest factor the transform scales a length by
+    static float max_scale(const glm::fmat4 &transform) {
+        return std::max({glm::length(glm::fvec3{transform[0]}), glm::length(glm::fvec3{transform[1]}),
+            glm::length(glm::fvec3{transform[2]})});
+    }
+
+    // the box is re-fitted around the transformed box, the sphere grows with the largest axis scale
+    Bounds transformed(const glm::fmat4 &transform) const {
+        glm::fmat3 linear{transform};
+        glm::fmat3 absolute{glm::abs(linear[0]), glm::abs(linear[1]), glm::abs(linear[2])};
 
-struct Geometry {
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
+        return Bounds{
+            glm::fvec3{transform * glm::fvec4{center, 1.0f}}, absolute * extents, radius * max_scale(transform)};
+    }
+
+    Aabb box() const {
+        return Aabb{{center.x - extents.x, center.y - extents.y, center.z - extents.z},
+            {center.x + extents.x, center.y + extents.y, center.z + extents.z}};
+    }
 };
 
 struct Bitmap final {
@@ -535,6 +885,66 @@ struct cbPerFrame {
 
 struct cbPerObject {
     glm::fmat4 world;
+    glm::fvec4 uv_rect; // xy offset and zw scale of the texture inside an atlas layer
+    uint32_t material_index;
+    uint32_t texture_layer;
+    uint32_t uv_wrap;
+    uint32_t padding_;
+};
+
+// cull pass input of one object slot, see shaders/cull.glsl
+struct CullObject {
+    glm::fvec4 sphere;  // center and radius, slots with a negative radius are never drawn
+    glm::fvec4 extents; // half size of the world space box, w is the largest axis scale of the object
+    uint32_t mesh;
+    uint32_t batch;
+    uint32_t command; // first command of the batch when draws are compacted, otherwise the object's own command
+    uint32_t padding_;
+    uint32_t first_cluster;
+    uint32_t cluster_count;   // 0 when the object is drawn whole
+    uint32_t cluster_command; // like command, for the draws of the object's clusters
+    uint32_t cone_culling;    // 1 when back facing clusters may be dropped
+    glm::fvec4 transform[3];  // rows of the object transform
+};
+
+// bounds of one meshlet in the cull pass's cluster table, see shaders/cluster_cull.glsl
+struct MeshCluster {
+    glm::fvec4 sphere; // center and radius in mesh units
+    glm::fvec4 cone;   // axis and the cosine of its half angle, every triangle normal is inside
+    uint32_t first_index;
+    uint32_t index_count;
+    uint32_t padding_[2];
+};
+
+// index range of one level of detail in the cull pass's lod table
+struct MeshLod {
+    uint32_t first_index;
+    uint32_t index_count; // 0 past the last level of a mesh
+    float error;
+    uint32_t padding_;
+};
+
+// push constants of the cull pass
+struct CullConstants {
+    glm::fvec4 planes[6];
+    uint32_t first_record;
+    uint32_t object_count;
+    uint32_t phase;     // 0 tests against the previous frame's depth, 1 retests what phase 0 deferred
+    uint32_t occlusion; // 0 when the phase has no depth to test against
+};
+
+// camera each cull phase projects objects with onto the depth pyramid
+struct cbCullView {
+    glm::fmat4 occlusion_view_proj[2];
+    glm::uvec4 depth_size; // width, height, pyramid levels
+    glm::fvec4 camera;     // position and pixels per world unit at distance one, see FrameSubmitData::lod_view_
+    glm::fvec4 lod_error;  // pixel limit and the share of it a coarser level must meet
+};
+
+// push constants of one depth pyramid level, see shaders/depth_pyramid.glsl
+struct PyramidConstants {
+    glm::ivec2 source_size;
+    glm::ivec2 level_size;
 };
 
 struct MemoryHelper final {
@@ -556,8 +966,8 @@ public:
     MemoryHelper(const MemoryHelper &) = delete;
     MemoryHelper &operator=(const MemoryHelper &) = delete;
 
-    std::optional<Image> create_image(
-        VkFormat format, VkImageUsageFlags usage, VkImageType type, const VkExtent3D &extent) {
+    std::optional<Image> create_image(VkFormat format, VkImageUsageFlags usage, VkImageType type,
+        const VkExtent3D &extent, uint32_t mip_levels = 1) {
         VkResult res;
         VkImageCreateInfo create_info = {};
 
@@ -565,7 +975,7 @@ public:
         create_info.imageType = type;
         create_info.format = format;
         create_info.extent = extent;
-        create_info.mipLevels = 1;
+        create_info.mipLevels = mip_levels;
         create_info.arrayLayers = 1;
         create_info.samples = VK_SAMPLE_COUNT_1_BIT;
         create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
@@ -699,6 +1109,136 @@ public:
         return image;
     }
 
+    // creates an rgba 2d array image with all layers already in shader read layout, filled by upload_image_region
+    std::optional<Image> create_image_array_rgba(
+        VkImageUsageFlags usage, uint32_t width, uint32_t height, uint32_t layers) const {
+        VkImageCreateInfo create_info = {};
+        create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        create_info.imageType = VK_IMAGE_TYPE_2D;
+        create_info.format = VK_FORMAT_R8G8B8A8_SRGB;
+        create_info.extent = VkExtent3D{width, height, 1};
+        create_info.mipLevels = 1;
+        create_info.arrayLayers = layers;
+        create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        create_info.usage = usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+        VmaAllocationCreateInfo alloc_desc = {};
+        alloc_desc.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+        alloc_desc.flags = 0;
+        alloc_desc.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+        VkImage vk_image = VK_NULL_HANDLE;
+        VmaAllocation allocation = VMA_NULL;
+        VmaAllocationInfo alloc_info = {};
+
+        VkResult res =
+            vmaCreateImage(state_.allocator(), &create_info, &alloc_desc, &vk_image, &allocation, &alloc_info);
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("cannot create image array: %s", string_VkResult(res));
+            return {};
+        }
+
+        Image image{state_.allocator(), vk_image, allocation, alloc_info};
+
+        if (!run_on_transfer_queue([&](VkCommandBuffer command_buffer) {
+            VkImageMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.image = image.image();
+            barrier.subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, layers};
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+            state_.dispatch().cmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        })) {
+            LOG_ERROR("failed to transition image array layout");
+            return {};
+        }
+
+        return image;
+    }
+
+    // uploads rgba pixels into a rectangle of one layer of an image in shader read layout
+    bool upload_image_region(const Image &image, uint32_t layer, const VkOffset2D &offset, uint32_t width,
+        uint32_t height, const void *pixels) const {
+        VkResult res;
+        VkDeviceSize region_size = width * height * 4;
+
+        auto staging_buffer = create_staging_buffer(region_size);
+        if (!staging_buffer) {
+            LOG_ERROR("failed to allocate staging buffer for transfer");
+            return false;
+        }
+
+        void *mapped_mem;
+        res = vmaMapMemory(state_.allocator(), staging_buffer->allocation(), &mapped_mem);
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("cannot map staging buffer: %s", string_VkResult(res));
+            return false;
+        }
+
+        memcpy(mapped_mem, pixels, region_size);
+        if (!staging_buffer->flush()) {
+            LOG_ERROR("cannot flush staging buffer");
+            return false;
+        }
+
+        bool uploaded = run_on_transfer_queue([&](VkCommandBuffer command_buffer) {
+            VkImageSubresourceRange range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, layer, 1};
+
+            // only this layer leaves the shader read layout, earlier frames may still sample it
+            VkImageMemoryBarrier transfer_barrier = {};
+            transfer_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            transfer_barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            transfer_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            transfer_barrier.image = image.image();
+            transfer_barrier.subresourceRange = range;
+            transfer_barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            transfer_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+            state_.dispatch().cmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &transfer_barrier);
+
+            VkBufferImageCopy image_copy = {};
+            image_copy.bufferOffset = 0;
+            image_copy.bufferRowLength = 0;
+            image_copy.bufferImageHeight = 0;
+            image_copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            image_copy.imageSubresource.mipLevel = 0;
+            image_copy.imageSubresource.baseArrayLayer = layer;
+            image_copy.imageSubresource.layerCount = 1;
+            image_copy.imageOffset = VkOffset3D{offset.x, offset.y, 0};
+            image_copy.imageExtent = VkExtent3D{width, height, 1};
+
+            state_.dispatch().cmdCopyBufferToImage(command_buffer, staging_buffer->buffer(), image.image(),
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &image_copy);
+
+            VkImageMemoryBarrier optimal_barrier = {};
+            optimal_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            optimal_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            optimal_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            optimal_barrier.image = image.image();
+            optimal_barrier.subresourceRange = range;
+            optimal_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            optimal_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+            state_.dispatch().cmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &optimal_barrier);
+        });
+
+        vmaUnmapMemory(state_.allocator(), staging_buffer->allocation());
+
+        if (!uploaded) {
+            LOG_ERROR("failed to upload image region to the gpu");
+            return false;
+        }
+
+        return true;
+    }
+
     std::optional<Buffer> create_shared_buffer(const VkBufferUsageFlags usage, size_t byte_size) const {
         VkResult res;
 
@@ -727,6 +1267,32 @@ public:
         return Buffer{state_.allocator(), vk_buffer, allocation, alloc_info};
     }
 
+    // device local and left uninitialized, for buffers only the gpu writes
+    std::optional<Buffer> create_device_buffer(const VkBufferUsageFlags usage, size_t byte_size) const {
+        VkBufferCreateInfo create_info = {};
+        create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        create_info.size = byte_size;
+        create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        create_info.usage = usage;
+
+        VmaAllocationCreateInfo alloc_create_info = {};
+        alloc_create_info.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+        alloc_create_info.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+        VkBuffer vk_buffer = VK_NULL_HANDLE;
+        VmaAllocation allocation = VMA_NULL;
+        VmaAllocationInfo alloc_info = {};
+
+        VkResult res =
+            vmaCreateBuffer(state_.allocator(), &create_info, &alloc_create_info, &vk_buffer, &allocation, &alloc_info);
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("cannot create buffer: %s", string_VkResult(res));
+            return {};
+        }
+
+        return Buffer{state_.allocator(), vk_buffer, allocation, alloc_info};
+    }
+
     std::optional<Buffer> create_buffer(
         const VkBufferUsageFlags usage, const void *data, size_t byte_size, bool use_staging) const {
         VkResult res;
@@ -1043,7 +1609,9 @@ public:
         }
     };
 
-    template <typename T> std::optional<DynamicUniformBuffer<T>> init_dynamic_ubo(VkDeviceSize num_elements) {
+    template <typename T>
+    std::optional<DynamicUniformBuffer<T>> init_dynamic_ubo(
+        VkDeviceSize num_elements, VkBufferUsageFlags extra_usage = 0) {
         auto min_ubo_align = state_.ubo_alignment();
         auto cpu_size = sizeof(T);
 
@@ -1051,7 +1619,7 @@ public:
             min_ubo_align > 0 ? (cpu_size + min_ubo_align - 1) & ~(min_ubo_align - 1) : cpu_size;
 
         VkDeviceSize buffer_size = aligned_size * num_elements;
-        auto buffer = create_shared_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, buffer_size);
+        auto buffer = create_shared_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | extra_usage, buffer_size);
         if (!buffer) {
             LOG_ERROR("failed to create backing buffer for dynamic ubo");
             return {};
@@ -1061,631 +1629,4246 @@ public:
     }
 };
 
-struct SceneState final {
-public:
-    static constexpr size_t kMaxStaticMeshes = 128;
-    static constexpr size_t kMaxObjects = 1024;
-    static constexpr size_t kMaxMaterials = 256;
-
-    template <typename T> struct Identifier {
-    private:
-        static constexpr uint32_t kInvalidId = UINT32_MAX;
+struct SamplerCache final {
+private:
+    // every field of VkSamplerCreateInfo that affects the created sampler
+    struct Key final {
+        VkSamplerCreateFlags flags;
+        VkFilter mag_filter, min_filter;
+        VkSamplerMipmapMode mipmap_mode;
+        VkSamplerAddressMode address_u, address_v, address_w;
+        float mip_lod_bias;
+        VkBool32 anisotropy_enable;
+        float max_anisotropy;
+        VkBool32 compare_enable;
+        VkCompareOp compare_op;
+        float min_lod, max_lod;
+        VkBorderColor border_color;
+        VkBool32 unnormalized_coordinates;
+
+        explicit Key(const VkSamplerCreateInfo &desc)
+            : flags{desc.flags}, mag_filter{desc.magFilter}, min_filter{desc.minFilter},
+              mipmap_mode{desc.mipmapMode}, address_u{desc.addressModeU}, address_v{desc.addressModeV},
+              address_w{desc.addressModeW}, mip_lod_bias{desc.mipLodBias}, anisotropy_enable{desc.anisotropyEnable},
+              max_anisotropy{desc.maxAnisotropy}, compare_enable{desc.compareEnable}, compare_op{desc.compareOp},
+              min_lod{desc.minLod}, max_lod{desc.maxLod}, border_color{desc.borderColor},
+              unnormalized_coordinates{desc.unnormalizedCoordinates} {}
+
+        bool operator==(const Key &k) const {
+            return flags == k.flags && mag_filter == k.mag_filter && min_filter == k.min_filter &&
+                   mipmap_mode == k.mipmap_mode && address_u == k.address_u && address_v == k.address_v &&
+                   address_w == k.address_w && mip_lod_bias == k.mip_lod_bias &&
+                   anisotropy_enable == k.anisotropy_enable && max_anisotropy == k.max_anisotropy &&
+                   compare_enable == k.compare_enable && compare_op == k.compare_op && min_lod == k.min_lod &&
+                   max_lod == k.max_lod && border_color == k.border_color &&
+                   unnormalized_coordinates == k.unnormalized_coordinates;
+        }
+    };
 
-        uint32_t id_;
-        Identifier(uint32_t id) : id_{id} {}
+    struct KeyHash final {
+        size_t operator()(const Key &k) const {
+            size_t seed = 0;
+            hash_combine(seed, static_cast<uint32_t>(k.flags));
+            hash_combine(seed, static_cast<uint32_t>(k.mag_filter));
+            hash_combine(seed, static_cast<uint32_t>(k.min_filter));
+            hash_combine(seed, static_cast<uint32_t>(k.mipmap_mode));
+            hash_combine(seed, static_cast<uint32_t>(k.address_u));
+            hash_combine(seed, static_cast<uint32_t>(k.address_v));
+            hash_combine(seed, static_cast<uint32_t>(k.address_w));
+            hash_combine(seed, k.mip_lod_bias);
+            hash_combine(seed, static_cast<uint32_t>(k.anisotropy_enable));
+            hash_combine(seed, k.max_anisotropy);
+            hash_combine(seed, static_cast<uint32_t>(k.compare_enable));
+            hash_combine(seed, static_cast<uint32_t>(k.compare_op));
+            hash_combine(seed, k.min_lod);
+            hash_combine(seed, k.max_lod);
+            hash_combine(seed, static_cast<uint32_t>(k.border_color));
+            hash_combine(seed, static_cast<uint32_t>(k.unnormalized_coordinates));
+            return seed;
+        }
+    };
 
-        friend class SceneState;
+    struct Entry final {
+        VkSampler sampler;
+        uint32_t ref_count;
+    };
 
-    public:
-        Identifier() : id_{kInvalidId} {}
-        Identifier(const Identifier &) = default;
-        Identifier &operator=(const Identifier &) = default;
-        ~Identifier() = default;
+    ProgramState &state_;
+    std::unordered_map<Key, Entry, KeyHash> entries_;
+    std::unordered_map<VkSampler, Key> keys_;
 
-        Identifier(Identifier &&i) {
-            id_ = i.id_;
-            i.id_ = kInvalidId;
-        }
+    SamplerCache(ProgramState &state) : state_{state} {}
 
-        Identifier &operator=(Identifier &&i) {
-            if (this != &i) {
-                id_ = i.id_;
-                i.id_ = kInvalidId;
-            }
+public:
+    ~SamplerCache() {
+        if (!entries_.empty()) {
+            LOG_INFO("destroying %zu samplers still referenced at shutdown", entries_.size());
+        }
 
-            return *this;
+        for (auto &[key, entry] : entries_) {
+            state_.dispatch().destroySampler(entry.sampler, nullptr);
         }
+    }
 
-        bool valid() const { return id_ != kInvalidId; }
+    SamplerCache(const SamplerCache &) = delete;
+    SamplerCache &operator=(const SamplerCache &) = delete;
 
-        operator bool() const { return valid(); }
-        bool operator<(const Identifier<T> &other) const { return id_ < other.id_; }
-        bool operator>(const Identifier<T> &other) const { return id_ > other.id_; }
-        bool operator==(const Identifier<T> &other) const { return id_ == other.id_; }
-    };
+    size_t size() const { return entries_.size(); }
 
-    struct Material final {
-    public:
-        using Id = Identifier<Material>;
+    // returns a shared sampler matching the description, every acquire must be paired with a release
+    VkSampler acquire(const VkSamplerCreateInfo &desc) {
+        if (desc.pNext != nullptr) {
+            LOG_ERROR("sampler descriptions with extension structs cannot be cached");
+            return VK_NULL_HANDLE;
+        }
 
-    private:
-        ProgramState *state_;
-        Id id_;
-        Image image_;
-        Image::View image_view_;
-        VkSampler sampler_;
-        VkDescriptorSet descriptor_set_;
+        Key key{desc};
+        auto iter = entries_.find(key);
+        if (iter != entries_.end()) {
+            iter->second.ref_count++;
+            return iter->second.sampler;
+        }
 
-        Material(ProgramState &state, const Id &id, Image &&image, Image::View &&image_view, VkSampler sampler,
-            VkDescriptorSet descriptor_set)
-            : state_{&state}, id_{id}, image_{std::move(image)}, image_view_{std::move(image_view)}, sampler_{sampler},
-              descriptor_set_{descriptor_set} {}
+        if (entries_.size() >= state_.phys_dev().properties.limits.maxSamplerAllocationCount) {
+            LOG_ERROR("sampler limit of %u reached", state_.phys_dev().properties.limits.maxSamplerAllocationCount);
+            return VK_NULL_HANDLE;
+        }
 
-        friend struct SceneState;
+        VkSampler sampler = VK_NULL_HANDLE;
+        VkResult res = state_.dispatch().createSampler(&desc, nullptr, &sampler);
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to create sampler: %s", string_VkResult(res));
+            return VK_NULL_HANDLE;
+        }
 
-    public:
-        const Id &id() const { return id_; }
-        Image &image() { return image_; }
-        Image::View &image_view() { return image_view_; }
-        VkSampler sampler() { return sampler_; }
-        VkDescriptorSet descriptor_set() { return descriptor_set_; }
-        const VkDescriptorSet *descriptor_set_addr() const { return &descriptor_set_; }
+        entries_.emplace(key, Entry{sampler, 1});
+        keys_.emplace(sampler, key);
 
-        ~Material() {
-            if (state_ && sampler_ != VK_NULL_HANDLE) {
-                state_->dispatch().destroySampler(sampler_, nullptr);
-            }
+        return sampler;
+    }
 
-            state_ = nullptr;
-            sampler_ = VK_NULL_HANDLE;
+    void release(VkSampler sampler) {
+        auto key_iter = keys_.find(sampler);
+        if (key_iter == keys_.end()) {
+            LOG_ERROR("releasing a sampler that is not owned by the cache");
+            return;
         }
 
-        Material(const Material &) = delete;
-        Material &operator=(const Material &) = delete;
+        auto iter = entries_.find(key_iter->second);
+        if (--iter->second.ref_count == 0) {
+            state_.dispatch().destroySampler(sampler, nullptr);
+            entries_.erase(iter);
+            keys_.erase(key_iter);
+        }
+    }
 
-        Material(Material &&m) : image_view_{std::move(m.image_view_)} {
-            state_ = m.state_;
-            id_ = std::move(m.id_);
-            image_ = std::move(m.image_);
-            sampler_ = m.sampler_;
-            descriptor_set_ = m.descriptor_set_;
+    static std::unique_ptr<SamplerCache> initialize(ProgramState &state) {
+        return std::unique_ptr<SamplerCache>{new SamplerCache(state)};
+    }
+};
 
-            m.state_ = nullptr;
-            m.sampler_ = VK_NULL_HANDLE;
-            m.descriptor_set_ = VK_NULL_HANDLE;
+// skyline bottom-left rectangle packer for a single atlas layer
+struct SkylinePacker final {
+private:
+    struct Node {
+        int32_t x, y, width;
+    };
+
+    int32_t width_, height_;
+    std::vector<Node> skyline_;
+
+    // lowest y at which a rect of the given size can sit when its left edge starts at node index
+    bool fit(size_t index, int32_t width, int32_t height, int32_t &y) const {
+        int32_t x = skyline_[index].x;
+        if (x + width > width_) {
+            return false;
         }
 
-        Material &operator=(Material &&m) {
-            if (this != &m) {
-                state_ = m.state_;
-                id_ = std::move(m.id_);
-                image_ = std::move(m.image_);
-                descriptor_set_ = m.descriptor_set_;
-                descriptor_set_ = m.descriptor_set_;
-                image_view_ = std::move(m.image_view_);
+        int32_t width_left = width;
+        y = skyline_[index].y;
 
-                m.state_ = nullptr;
-                m.sampler_ = VK_NULL_HANDLE;
-                m.descriptor_set_ = VK_NULL_HANDLE;
+        while (width_left > 0) {
+            if (index >= skyline_.size()) {
+                return false;
             }
 
-            return *this;
+            y = std::max(y, skyline_[index].y);
+            if (y + height > height_) {
+                return false;
+            }
+
+            width_left -= skyline_[index].width;
+            index++;
         }
-    };
 
-    struct StaticMesh final {
-    public:
-        using Id = Identifier<StaticMesh>;
+        return true;
+    }
 
-    private:
-        Id id_;
-        Buffer vertex_buffer_;
-        Buffer index_buffer_;
-        uint32_t num_vertices_;
-        uint32_t num_indices_;
+public:
+    SkylinePacker(uint32_t width, uint32_t height)
+        : width_{static_cast<int32_t>(width)}, height_{static_cast<int32_t>(height)} {
+        skyline_.push_back(Node{0, 0, width_});
+    }
 
-        StaticMesh(
-            const Id &id, Buffer &&vertex_buffer, Buffer &&index_buffer, uint32_t num_vertices, uint32_t num_indices)
-            : id_{id}, vertex_buffer_{std::move(vertex_buffer)}, index_buffer_{std::move(index_buffer)},
-              num_vertices_{num_vertices}, num_indices_{num_indices} {}
+    std::optional<VkOffset2D> allocate(uint32_t width, uint32_t height) {
+        int32_t w = static_cast<int32_t>(width);
+        int32_t h = static_cast<int32_t>(height);
 
-        friend struct SceneState;
+        size_t best_index = SIZE_MAX;
+        int32_t best_bottom = INT32_MAX, best_width = INT32_MAX, best_y = 0;
 
-    public:
-        const Id &id() const { return id_; }
-        Buffer &vertex_buffer() { return vertex_buffer_; }
-        Buffer &index_buffer() { return index_buffer_; }
-        uint32_t num_vertices() const { return num_vertices_; }
-        uint32_t num_indices() const { return num_indices_; }
+        for (size_t i = 0; i < skyline_.size(); ++i) {
+            int32_t y;
+            if (!fit(i, w, h, y)) {
+                continue;
+            }
 
-        ~StaticMesh() = default;
+            // bottom-left heuristic, ties broken by the narrowest segment to reduce waste
+            if (y + h < best_bottom || (y + h == best_bottom && skyline_[i].width < best_width)) {
+                best_index = i;
+                best_bottom = y + h;
+                best_width = skyline_[i].width;
+                best_y = y;
+            }
+        }
 
-        StaticMesh(const StaticMesh &) = delete;
-        StaticMesh &operator=(const StaticMesh &) = delete;
+        if (best_index == SIZE_MAX) {
+            return {};
+        }
 
-        StaticMesh(StaticMesh &&m) {
-            id_ = std::move(m.id_);
-            vertex_buffer_ = std::move(m.vertex_buffer_);
-            index_buffer_ = std::move(m.index_buffer_);
-            num_vertices_ = m.num_vertices_;
-            num_indices_ = m.num_indices_;
+        VkOffset2D offset{skyline_[best_index].x, best_y};
+        skyline_.insert(skyline_.begin() + best_index, Node{offset.x, best_y + h, w});
 
-            m.num_vertices_ = 0;
-            m.num_vertices_ = 0;
-        }
+        // shrink or remove the segments now covered by the new one
+        for (size_t i = best_index + 1; i < skyline_.size(); ++i) {
+            const auto &prev = skyline_[i - 1];
+            int32_t prev_end = prev.x + prev.width;
 
-        StaticMesh &operator=(StaticMesh &&m) {
-            if (this != &m) {
-                id_ = std::move(m.id_);
-                vertex_buffer_ = std::move(m.vertex_buffer_);
-                index_buffer_ = std::move(m.index_buffer_);
-                num_vertices_ = m.num_vertices_;
-                num_indices_ = m.num_indices_;
+            if (skyline_[i].x >= prev_end) {
+                break;
+            }
 
-                m.num_vertices_ = 0;
-                m.num_vertices_ = 0;
+            int32_t shrink = prev_end - skyline_[i].x;
+            skyline_[i].x += shrink;
+            skyline_[i].width -= shrink;
+
+            if (skyline_[i].width > 0) {
+                break;
             }
 
-            return *this;
+            skyline_.erase(skyline_.begin() + i);
+            --i;
         }
 
-        void draw(vkb::DispatchTable &dispatch, VkCommandBuffer command_buffer) {
-            VkDeviceSize buf_offset = 0;
-            dispatch.cmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffer_.addr_of(), &buf_offset);
-            dispatch.cmdBindIndexBuffer(command_buffer, index_buffer_.buffer(), 0, VK_INDEX_TYPE_UINT32);
-            dispatch.cmdDrawIndexed(command_buffer, num_indices_, 1, 0, 0, 0);
+        // merge neighbours at the same height
+        for (size_t i = 0; i + 1 < skyline_.size(); ++i) {
+            if (skyline_[i].y == skyline_[i + 1].y) {
+                skyline_[i].width += skyline_[i + 1].width;
+                skyline_.erase(skyline_.begin() + i + 1);
+                --i;
+            }
         }
-    };
 
-    struct SceneObject final {
-    public:
-        using Id = Identifier<SceneObject>;
+        return offset;
+    }
+};
 
-    private:
-        Id id_;
-        glm::fvec3 translation_;
-        glm::fvec3 scale_;
-        glm::fquat rotation_;
+// packs small material textures into the layers of a single 2d array image
+struct TextureAtlas final {
+public:
+    static constexpr uint32_t kSize = 1024;
+    static constexpr uint32_t kLayers = 4;
+    static constexpr uint32_t kMaxTextureSize = 256;
 
-        glm::fmat4x4 transform_;
-        StaticMesh::Id mesh_id_;
-        Material::Id material_id_;
+    // replicated border around every texture so filtering never reads a neighbour
+    static constexpr uint32_t kGutter = 2;
 
-        SceneObject(const Id &id)
-            : id_{id}, translation_{0.0f, 0.0f, 0.0f}, scale_{1.0f, 1.0f, 1.0f}, rotation_{0.0f, 0.0f, 0.0f, 1.0f},
-              transform_(1.0f), mesh_id_{} {}
+    struct Region final {
+        uint32_t layer;
+        glm::fvec4 uv_rect;
+        bool wrap;
+    };
 
-        friend struct SceneState;
+private:
+    MemoryHelper &memory_;
+    Image image_;
+    Image::View view_;
+    std::vector<SkylinePacker> layers_;
+
+    TextureAtlas(MemoryHelper &memory, Image &&image, Image::View &&view)
+        : memory_{memory}, image_{std::move(image)}, view_{std::move(view)} {
+        layers_.resize(kLayers, SkylinePacker(kSize, kSize));
+    }
 
-        void recalculate_transform() {
-            transform_ = glm::translate(glm::mat4(1.0f), translation_) * glm::mat4_cast(rotation_) *
-                         glm::scale(glm::mat4(1.0f), scale_);
+    // copy of the bitmap surrounded by a gutter that either wraps or clamps to the edge
+    static Bitmap with_gutter(const Bitmap &bitmap, bool wrap) {
+        int32_t width = static_cast<int32_t>(bitmap.width());
+        int32_t height = static_cast<int32_t>(bitmap.height());
+        int32_t gutter = static_cast<int32_t>(kGutter);
+
+        Bitmap padded{bitmap.width() + 2 * kGutter, bitmap.height() + 2 * kGutter};
+        auto source = [&](int32_t coord, int32_t size) {
+            coord -= gutter;
+            return wrap ? ((coord % size) + size) % size : std::clamp(coord, 0, size - 1);
+        };
+
+        for (int32_t y = 0; y < static_cast<int32_t>(padded.height()); ++y) {
+            int32_t sy = source(y, height);
+            for (int32_t x = 0; x < static_cast<int32_t>(padded.width()); ++x) {
+                int32_t sx = source(x, width);
+                memcpy(padded.raw_pixels() + (y * padded.width() + x) * 4,
+                    bitmap.raw_pixels() + (sy * bitmap.width() + sx) * 4, 4);
+            }
         }
 
-    public:
-        SceneObject(const SceneObject &) = delete;
-        SceneObject &operator=(const SceneObject &) = delete;
+        return padded;
+    }
 
-        SceneObject(SceneObject &&o) noexcept
-            : id_{std::move(o.id_)}, translation_(std::move(o.translation_)), scale_(std::move(o.scale_)),
-              rotation_(std::move(o.rotation_)), transform_(std::move(o.transform_)), mesh_id_(std::move(o.mesh_id_)) {}
+public:
+    TextureAtlas(const TextureAtlas &) = delete;
+    TextureAtlas &operator=(const TextureAtlas &) = delete;
 
-        SceneObject &operator=(SceneObject &&o) noexcept {
-            if (this != &o) {
-                id_ = std::move(o.id_);
-                translation_ = std::move(o.translation_);
-                scale_ = std::move(o.scale_);
-                rotation_ = std::move(o.rotation_);
-                transform_ = std::move(o.transform_);
-                mesh_id_ = std::move(o.mesh_id_);
+    VkImageView view() const { return view_.view(); }
 
-                o.translation_ = {0.0f, 0.0f, 0.0f};
-                o.scale_ = {1.0f, 1.0f, 1.0f};
-                o.rotation_ = {0.0f, 0.0f, 0.0f, 1.0f};
-                o.transform_ = glm::mat4(1.0f);
-                o.mesh_id_ = {};
+    static bool fits(const Bitmap &bitmap) {
+        return bitmap.width() <= kMaxTextureSize && bitmap.height() <= kMaxTextureSize;
+    }
+
+    std::optional<Region> insert(const Bitmap &bitmap, VkSamplerAddressMode address_mode) {
+        // mirrored modes are approximated by clamping
+        bool wrap = address_mode == VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        uint32_t padded_width = bitmap.width() + 2 * kGutter;
+        uint32_t padded_height = bitmap.height() + 2 * kGutter;
+
+        for (uint32_t layer = 0; layer < kLayers; ++layer) {
+            auto offset = layers_[layer].allocate(padded_width, padded_height);
+            if (!offset) {
+                continue;
             }
 
-            return *this;
-        }
+            auto padded = with_gutter(bitmap, wrap);
+            if (!memory_.upload_image_region(
+                    image_, layer, *offset, padded.width(), padded.height(), padded.raw_pixels())) {
+                LOG_ERROR("failed to upload texture into the atlas");
+                return {};
+            }
 
-        const Id &id() const { return id_; }
-        const glm::fvec3 &translation() const { return translation_; }
-        const glm::fvec3 &scale() const { return scale_; }
-        const glm::fquat &rotation() const { return rotation_; }
-        const glm::fmat4x4 &transform() const { return transform_; }
-        const StaticMesh::Id &mesh_id() const { return mesh_id_; }
-        const Material::Id &material_id() const { return material_id_; }
+            constexpr float kInvSize = 1.0f / static_cast<float>(kSize);
 
-        void set_translation(const glm::fvec3 &translation) {
-            translation_ = translation;
-            recalculate_transform();
+            Region region;
+            region.layer = layer;
+            region.wrap = wrap;
+            region.uv_rect = glm::fvec4{static_cast<float>(offset->x + kGutter) * kInvSize,
+                static_cast<float>(offset->y + kGutter) * kInvSize, static_cast<float>(bitmap.width()) * kInvSize,
+                static_cast<float>(bitmap.height()) * kInvSize};
+
+            return region;
         }
 
-        void set_scale(const glm::fvec3 &scale) {
-            scale_ = scale;
-            recalculate_transform();
+        return {};
+    }
+
+    static std::unique_ptr<TextureAtlas> initialize(ProgramState &state, MemoryHelper &memory) {
+        auto image = memory.create_image_array_rgba(VK_IMAGE_USAGE_SAMPLED_BIT, kSize, kSize, kLayers);
+        if (!image) {
+            LOG_ERROR("failed to create atlas image");
+            return {};
         }
 
-        void set_rotation(const glm::fquat &rotation) {
-            rotation_ = rotation;
-            recalculate_transform();
+        auto view = image->create_view(state.dispatch(), VK_IMAGE_VIEW_TYPE_2D_ARRAY, VK_FORMAT_R8G8B8A8_SRGB,
+            VK_IMAGE_ASPECT_COLOR_BIT, kLayers);
+        if (!view) {
+            LOG_ERROR("failed to create atlas image view");
+            return {};
         }
 
-        void set_mesh_id(const StaticMesh::Id &mesh_id) { mesh_id_ = mesh_id; }
-        void set_material_id(const Material::Id &material_id) { material_id_ = material_id; }
+        return std::unique_ptr<TextureAtlas>{new TextureAtlas(memory, std::move(*image), std::move(*view))};
+    }
+};
+
+// descriptor bindings, push constants and vertex inputs of one spir-v module
+struct ShaderReflection {
+    struct Binding {
+        uint32_t set;
+        VkDescriptorSetLayoutBinding binding; // descriptorCount is 0 for runtime sized arrays
     };
 
-    enum DescriptorSet { PerFrame, PerMaterial, PerObject, Count };
-    struct FrameSubmitData final {
-    private:
-        ProgramState &state_;
-        SceneState &scene_;
+    VkShaderStageFlagBits stage;
+    std::vector<Binding> bindings;
+    uint32_t push_constant_size;
+
+    // only location and format are filled in, the offsets come from the vertex format
+    std::vector<VkVertexInputAttributeDescription> inputs;
+
+    // minimal parser for the subset of spir-v that glslc emits for graphics shaders
+    static std::optional<ShaderReflection> parse(const uint32_t *code, size_t word_count) {
+        // opcodes, decorations and storage classes from the spir-v specification
+        enum : uint32_t {
+            OpEntryPoint = 15,
+            OpTypeInt = 21,
+            OpTypeFloat = 22,
+            OpTypeVector = 23,
+            OpTypeMatrix = 24,
+            OpTypeImage = 25,
+            OpTypeSampler = 26,
+            OpTypeSampledImage = 27,
+            OpTypeArray = 28,
+            OpTypeRuntimeArray = 29,
+            OpTypeStruct = 30,
+            OpTypePointer = 32,
+            OpConstant = 43,
+            OpSpecConstant = 50,
+            OpVariable = 59,
+            OpDecorate = 71,
+            OpMemberDecorate = 72,
+        };
 
-        VkCommandBuffer command_buffer_;
-        VkSemaphore sem_image_avaliable_, sem_render_done_;
-        VkFence fence_in_flight_;
+        enum : uint32_t {
+            DecorationBufferBlock = 3,
+            DecorationArrayStride = 6,
+            DecorationMatrixStride = 7,
+            DecorationBuiltIn = 11,
+            DecorationLocation = 30,
+            DecorationBinding = 33,
+            DecorationDescriptorSet = 34,
+            DecorationOffset = 35,
+        };
 
-        VkDescriptorSet per_frame_set_;
-        Buffer per_frame_buffer_;
+        enum : uint32_t {
+            StorageUniformConstant = 0,
+            StorageInput = 1,
+            StorageUniform = 2,
+            StoragePushConstant = 9,
+            StorageStorageBuffer = 12,
+        };
 
-        FrameSubmitData(ProgramState &state, SceneState &scene)
-            : state_{state}, scene_{scene}, command_buffer_{VK_NULL_HANDLE}, sem_image_avaliable_{VK_NULL_HANDLE},
-              sem_render_done_{VK_NULL_HANDLE}, fence_in_flight_{VK_NULL_HANDLE}, per_frame_set_{VK_NULL_HANDLE} {}
+        constexpr uint32_t kMagic = 0x07230203;
+        constexpr uint32_t kDimBuffer = 5, kDimSubpassData = 6;
+        constexpr uint32_t kNone = ~0u;
 
-    public:
-        VkCommandBuffer command_buffer() { return command_buffer_; }
-        Buffer &per_frame_buffer() { return per_frame_buffer_; }
+        if (word_count < 5 || code[0] != kMagic) {
+            LOG_ERROR("not a spir-v module");
+            return {};
+        }
 
-        void update_per_frame(const cbPerFrame &data) {
-            memcpy(per_frame_buffer_.alloc_info().pMappedData, &data, sizeof(cbPerFrame));
+        struct Id {
+            const uint32_t *ins = nullptr;
+            uint32_t count = 0;
+            uint32_t set = kNone, binding = kNone, location = kNone;
+            uint32_t array_stride = 0;
+            bool builtin = false, buffer_block = false;
+            std::vector<uint32_t> member_offsets, member_matrix_strides;
+        };
 
-            if (!per_frame_buffer_.flush()) {
-                LOG_ERROR("cannot flush per frame uniform buffer");
+        uint32_t bound = code[3];
+        std::vector<Id> ids(bound);
+        std::vector<uint32_t> variables;
+
+        ShaderReflection reflection = {};
+        reflection.stage = VkShaderStageFlagBits(0);
+
+        auto valid_id = [&](uint32_t id) { return id < bound; };
+
+        for (size_t i = 5; i < word_count;) {
+            const uint32_t *ins = code + i;
+            uint32_t opcode = ins[0] & 0xffff, count = ins[0] >> 16;
+
+            if (count == 0 || count > word_count - i) {
+                LOG_ERROR("malformed spir-v instruction at word %zu", i);
+                return {};
             }
-        }
 
-        FrameSubmitData(const FrameSubmitData &) = delete;
-        FrameSubmitData &operator=(const FrameSubmitData &) = delete;
+            i += count;
 
-        FrameSubmitData(FrameSubmitData &&f) : state_{f.state_}, scene_{f.scene_} {
-            command_buffer_ = f.command_buffer_;
-            sem_image_avaliable_ = f.sem_image_avaliable_;
-            sem_render_done_ = f.sem_render_done_;
-            fence_in_flight_ = f.fence_in_flight_;
-            per_frame_set_ = std::move(f.per_frame_set_);
-            per_frame_buffer_ = std::move(f.per_frame_buffer_);
+            switch (opcode) {
+            case OpEntryPoint: {
+                if (count < 2 || reflection.stage != 0) {
+                    break;
+                }
 
-            f.command_buffer_ = VK_NULL_HANDLE;
-            f.sem_image_avaliable_ = VK_NULL_HANDLE;
-            f.sem_render_done_ = VK_NULL_HANDLE;
-            f.fence_in_flight_ = VK_NULL_HANDLE;
-            f.per_frame_set_ = VK_NULL_HANDLE;
+                constexpr std::array<VkShaderStageFlagBits, 6> kStages = {VK_SHADER_STAGE_VERTEX_BIT,
+                    VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT,
+                    VK_SHADER_STAGE_GEOMETRY_BIT, VK_SHADER_STAGE_FRAGMENT_BIT, VK_SHADER_STAGE_COMPUTE_BIT};
+
+                if (ins[1] < kStages.size()) {
+                    reflection.stage = kStages[ins[1]];
+                }
+            } break;
+
+            case OpDecorate: {
+                if (count < 3 || !valid_id(ins[1])) {
+                    break;
+                }
+
+                auto &id = ids[ins[1]];
+                uint32_t value = count > 3 ? ins[3] : 0;
+
+                switch (ins[2]) {
+                case DecorationBufferBlock:
+                    id.buffer_block = true;
+                    break;
+                case DecorationArrayStride:
+                    id.array_stride = value;
+                    break;
+                case DecorationBuiltIn:
+                    id.builtin = true;
+                    break;
+                case DecorationLocation:
+                    id.location = value;
+                    break;
+                case DecorationBinding:
+                    id.binding = value;
+                    break;
+                case DecorationDescriptorSet:
+                    id.set = value;
+                    break;
+                }
+            } break;
+
+            case OpMemberDecorate: {
+                if (count < 5 || !valid_id(ins[1])) {
+                    break;
+                }
+
+                auto &id = ids[ins[1]];
+                uint32_t member = ins[2];
+
+                auto set_member = [&](std::vector<uint32_t> &values) {
+                    if (values.size() <= member) {
+                        values.resize(member + 1, 0);
+                    }
+
+                    values[member] = ins[4];
+                };
+
+                if (ins[3] == DecorationOffset) {
+                    set_member(id.member_offsets);
+                } else if (ins[3] == DecorationMatrixStride) {
+                    set_member(id.member_matrix_strides);
+                }
+            } break;
+
+            case OpConstant:
+            case OpSpecConstant:
+            case OpVariable:
+                if (count >= 3 && valid_id(ins[2])) {
+                    ids[ins[2]].ins = ins;
+                    ids[ins[2]].count = count;
+
+                    if (opcode == OpVariable) {
+                        variables.push_back(ins[2]);
+                    }
+                }
+                break;
+
+            default:
+                // type declarations carry their result id as the first operand
+                if (opcode >= OpTypeInt && opcode <= OpTypePointer && count >= 2 && valid_id(ins[1])) {
+                    ids[ins[1]].ins = ins;
+                    ids[ins[1]].count = count;
+                }
+                break;
+            }
         }
 
-        ~FrameSubmitData() {
-            state_.dispatch().destroySemaphore(sem_image_avaliable_, nullptr);
-            state_.dispatch().destroySemaphore(sem_render_done_, nullptr);
-            state_.dispatch().destroyFence(fence_in_flight_, nullptr);
+        auto opcode_of = [&](uint32_t id) -> uint32_t {
+            return valid_id(id) && ids[id].ins ? ids[id].ins[0] & 0xffff : 0;
+        };
+        auto operand = [&](uint32_t id, uint32_t index) -> uint32_t {
+            return valid_id(id) && ids[id].ins && index < ids[id].count ? ids[id].ins[index] : 0;
+        };
+
+        // size of a type as laid out in a block, runtime arrays count as empty
+        std::function<uint32_t(uint32_t, uint32_t)> type_size = [&](uint32_t id, uint32_t matrix_stride) -> uint32_t {
+            switch (opcode_of(id)) {
+            case OpTypeInt:
+            case OpTypeFloat:
+                return operand(id, 2) / 8;
+            case OpTypeVector:
+                return operand(id, 3) * type_size(operand(id, 2), 0);
+            case OpTypeMatrix:
+                return operand(id, 3) * (matrix_stride ? matrix_stride : type_size(operand(id, 2), 0));
+            case OpTypeArray: {
+                uint32_t stride = ids[id].array_stride ? ids[id].array_stride : type_size(operand(id, 2), 0);
+                return operand(operand(id, 3), 3) * stride;
+            }
+            case OpTypeStruct: {
+                uint32_t size = 0;
+                for (uint32_t m = 0; m + 2 < ids[id].count; ++m) {
+                    uint32_t offset = m < ids[id].member_offsets.size() ? ids[id].member_offsets[m] : 0;
+                    uint32_t stride = m < ids[id].member_matrix_strides.size() ? ids[id].member_matrix_strides[m] : 0;
+                    size = std::max(size, offset + type_size(ids[id].ins[m + 2], stride));
+                }
+
+                return size;
+            }
+            default:
+                return 0;
+            }
+        };
+
+        auto format_of = [&](uint32_t id) -> VkFormat {
+            uint32_t components = 1;
+            if (opcode_of(id) == OpTypeVector) {
+                components = operand(id, 3);
+                id = operand(id, 2);
+            }
+
+            if (operand(id, 2) != 32 || components < 1 || components > 4) {
+                return VK_FORMAT_UNDEFINED;
+            }
+
+            constexpr std::array<VkFormat, 4> kFloat = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT,
+                VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+            constexpr std::array<VkFormat, 4> kSint = {
+                VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+            constexpr std::array<VkFormat, 4> kUint = {
+                VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+
+            if (opcode_of(id) == OpTypeFloat) {
+                return kFloat[components - 1];
+            }
+
+            if (opcode_of(id) == OpTypeInt) {
+                return operand(id, 3) ? kSint[components - 1] : kUint[components - 1];
+            }
+
+            return VK_FORMAT_UNDEFINED;
+        };
+
+        for (uint32_t variable : variables) {
+            const auto &var = ids[variable];
+            uint32_t pointer = operand(variable, 1);
+            uint32_t storage = operand(variable, 3);
+
+            if (opcode_of(pointer) != OpTypePointer) {
+                continue;
+            }
+
+            uint32_t type = operand(pointer, 3);
+
+            if (storage == StorageInput) {
+                if (reflection.stage == VK_SHADER_STAGE_VERTEX_BIT && !var.builtin && var.location != kNone) {
+                    VkVertexInputAttributeDescription input = {};
+                    input.location = var.location;
+                    input.format = format_of(type);
+                    reflection.inputs.push_back(input);
+                }
+
+                continue;
+            }
+
+            if (storage == StoragePushConstant) {
+                reflection.push_constant_size = std::max(reflection.push_constant_size, type_size(type, 0));
+                continue;
+            }
+
+            if (storage != StorageUniformConstant && storage != StorageUniform && storage != StorageStorageBuffer) {
+                continue;
+            }
+
+            if (var.set == kNone || var.binding == kNone) {
+                continue;
+            }
+
+            Binding binding = {};
+            binding.set = var.set;
+            binding.binding.binding = var.binding;
+            binding.binding.descriptorCount = 1;
+            binding.binding.stageFlags = reflection.stage;
+
+            if (opcode_of(type) == OpTypeArray) {
+                binding.binding.descriptorCount = operand(operand(type, 3), 3);
+                type = operand(type, 2);
+            } else if (opcode_of(type) == OpTypeRuntimeArray) {
+                binding.binding.descriptorCount = 0;
+                type = operand(type, 2);
+            }
+
+            switch (opcode_of(type)) {
+            case OpTypeSampledImage:
+                binding.binding.descriptorType = operand(operand(type, 2), 3) == kDimBuffer
+                                                     ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER
+                                                     : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                break;
+            case OpTypeImage: {
+                uint32_t dim = operand(type, 3);
+                bool storage_image = operand(type, 7) == 2;
+
+                if (dim == kDimSubpassData) {
+                    binding.binding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+                } else if (dim == kDimBuffer) {
+                    binding.binding.descriptorType = storage_image ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER
+                                                                   : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+                } else {
+                    binding.binding.descriptorType =
+                        storage_image ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+                }
+            } break;
+            case OpTypeSampler:
+                binding.binding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+                break;
+            case OpTypeStruct:
+                binding.binding.descriptorType = (storage == StorageStorageBuffer || ids[type].buffer_block)
+                                                     ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+                                                     : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+                break;
+            default:
+                LOG_ERROR("unsupported resource type at set %u binding %u", var.set, var.binding);
+                return {};
+            }
+
+            reflection.bindings.push_back(binding);
         }
 
-        friend struct SceneState;
+        std::sort(reflection.inputs.begin(), reflection.inputs.end(),
+            [](const auto &a, const auto &b) { return a.location < b.location; });
+
+        return reflection;
+    }
+};
+
+// set layout as derived from reflection, before it is turned into a vulkan object
+struct DescriptorSetLayoutDesc {
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    std::vector<VkDescriptorBindingFlagsEXT> binding_flags; // empty or one entry per binding
+    VkDescriptorSetLayoutCreateFlags flags;
+};
+
+// owns every shader module, set layout and pipeline layout. modules are created once per shader and layouts with
+// identical contents are shared, so equal reflection always yields the same handle
+struct ShaderLibrary final {
+public:
+    struct Shader {
+        VkShaderModule module;
+        ShaderReflection reflection;
     };
 
 private:
     ProgramState &state_;
-    std::unique_ptr<MemoryHelper> memory_;
 
-    VkRenderPass render_pass_;
-    VkPipelineLayout pipeline_layout_;
-    VkPipeline graphics_pipeline_;
-    VkCommandPool command_pool_;
+    std::unordered_map<std::string, std::unique_ptr<Shader>> shaders_;
+    std::map<std::vector<uint64_t>, VkDescriptorSetLayout> set_layouts_;
+    std::map<std::vector<uint64_t>, VkPipelineLayout> pipeline_layouts_;
+
+    // modules replaced by a reload, pipelines still compiling from them may reference them
+    std::vector<VkShaderModule> retired_modules_;
+
+    ShaderLibrary(ProgramState &state) : state_{state} {}
+
+    std::optional<Shader> create_shader(const char *name, const uint8_t *data, size_t size) {
+        if (!data || size % sizeof(uint32_t) != 0) {
+            LOG_ERROR("missing or malformed shader bytecode %s", name);
+            return {};
+        }
+
+        auto words = reinterpret_cast<const uint32_t *>(data);
+        auto reflection = ShaderReflection::parse(words, size / sizeof(uint32_t));
+        if (!reflection) {
+            LOG_ERROR("failed to reflect shader %s", name);
+            return {};
+        }
+
+        VkShaderModuleCreateInfo create_info = {};
+        create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        create_info.codeSize = size;
+        create_info.pCode = words;
+
+        VkShaderModule module;
+        VkResult res = state_.dispatch().createShaderModule(&create_info, nullptr, &module);
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to create shader module %s: %s", name, string_VkResult(res));
+            return {};
+        }
+
+        return Shader{module, std::move(*reflection)};
+    }
+
+    // layouts are built once from the first reflection, a reloaded shader has to fit them unchanged
+    static bool same_interface(const ShaderReflection &a, const ShaderReflection &b) {
+        auto same_binding = [](const ShaderReflection::Binding &x, const ShaderReflection::Binding &y) {
+            return x.set == y.set && x.binding.binding == y.binding.binding &&
+                   x.binding.descriptorType == y.binding.descriptorType &&
+                   x.binding.descriptorCount == y.binding.descriptorCount;
+        };
+        auto same_input = [](const VkVertexInputAttributeDescription &x, const VkVertexInputAttributeDescription &y) {
+            return x.location == y.location && x.format == y.format;
+        };
+
+        return a.stage == b.stage && a.push_constant_size == b.push_constant_size &&
+               std::equal(a.bindings.begin(), a.bindings.end(), b.bindings.begin(), b.bindings.end(), same_binding) &&
+               std::equal(a.inputs.begin(), a.inputs.end(), b.inputs.begin(), b.inputs.end(), same_input);
+    }
+
+public:
+    ShaderLibrary(const ShaderLibrary &) = delete;
+    ShaderLibrary &operator=(const ShaderLibrary &) = delete;
+
+    ~ShaderLibrary() {
+        for (auto &entry : pipeline_layouts_) {
+            state_.dispatch().destroyPipelineLayout(entry.second, nullptr);
+        }
+
+        for (auto &entry : set_layouts_) {
+            state_.dispatch().destroyDescriptorSetLayout(entry.second, nullptr);
+        }
+
+        for (auto &entry : shaders_) {
+            state_.dispatch().destroyShaderModule(entry.second->module, nullptr);
+        }
+
+        for (auto module : retired_modules_) {
+            state_.dispatch().destroyShaderModule(module, nullptr);
+        }
+    }
+
+    // loads, reflects and creates the module on first use
+    const Shader *get(const char *name) {
+        auto iter = shaders_.find(name);
+        if (iter != shaders_.end()) {
+            return iter->second.get();
+        }
+
+        auto code = state_.load_asset(name).get();
+        auto shader = create_shader(name, code.data(), code.size());
+        if (!shader) {
+            return nullptr;
+        }
+
+        return shaders_.emplace(name, std::make_unique<Shader>(std::move(*shader))).first->second.get();
+    }
+
+    // swaps new bytecode into an already loaded shader and returns the module it replaced. pipelines built from
+    // the old module have to be rebuilt by the caller, the old module itself is kept until the library is destroyed
+    VkShaderModule reload(const char *name, const std::vector<uint8_t> &code) {
+        auto iter = shaders_.find(name);
+        if (iter == shaders_.end()) {
+            return VK_NULL_HANDLE;
+        }
+
+        auto shader = create_shader(name, code.data(), code.size());
+        if (!shader) {
+            return VK_NULL_HANDLE;
+        }
+
+        if (!same_interface(iter->second->reflection, shader->reflection)) {
+            LOG_ERROR("%s changed its bindings or inputs, restart to pick up layout changes", name);
+            state_.dispatch().destroyShaderModule(shader->module, nullptr);
+            return VK_NULL_HANDLE;
+        }
+
+        VkShaderModule old_module = iter->second->module;
+        retired_modules_.push_back(old_module);
+        *iter->second = std::move(*shader);
+        return old_module;
+    }
+
+    // null unless the shader has been loaded before, never loads
+    const Shader *find(const std::string &name) const {
+        auto iter = shaders_.find(name);
+        return iter != shaders_.end() ? iter->second.get() : nullptr;
+    }
+
+    // bindings of one set as used by any of the given stages
+    static DescriptorSetLayoutDesc reflect_set(const std::vector<const Shader *> &shaders, uint32_t set) {
+        DescriptorSetLayoutDesc desc = {};
+
+        for (const auto *shader : shaders) {
+            for (const auto &binding : shader->reflection.bindings) {
+                if (binding.set != set) {
+                    continue;
+                }
+
+                auto iter = std::find_if(desc.bindings.begin(), desc.bindings.end(),
+                    [&](const auto &b) { return b.binding == binding.binding.binding; });
+
+                if (iter == desc.bindings.end()) {
+                    desc.bindings.push_back(binding.binding);
+                } else {
+                    iter->stageFlags |= binding.binding.stageFlags;
+                }
+            }
+        }
+
+        std::sort(desc.bindings.begin(), desc.bindings.end(),
+            [](const auto &a, const auto &b) { return a.binding < b.binding; });
+
+        return desc;
+    }
+
+    static std::vector<VkPushConstantRange> reflect_push_constants(const std::vector<const Shader *> &shaders) {
+        VkPushConstantRange range = {};
+        for (const auto *shader : shaders) {
+            if (shader->reflection.push_constant_size > 0) {
+                range.stageFlags |= shader->reflection.stage;
+                range.size = std::max(range.size, shader->reflection.push_constant_size);
+            }
+        }
+
+        if (range.size == 0) {
+            return {};
+        }
+
+        return {range};
+    }
+
+    VkDescriptorSetLayout descriptor_set_layout(const DescriptorSetLayoutDesc &desc) {
+        std::vector<uint64_t> key = {desc.flags, desc.bindings.size(), desc.binding_flags.size()};
+        for (const auto &binding : desc.bindings) {
+            key.insert(key.end(), {binding.binding, static_cast<uint64_t>(binding.descriptorType),
+                                      binding.descriptorCount, binding.stageFlags});
+        }
+
+        key.insert(key.end(), desc.binding_flags.begin(), desc.binding_flags.end());
+
+        auto iter = set_layouts_.find(key);
+        if (iter != set_layouts_.end()) {
+            return iter->second;
+        }
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flags_desc = {};
+        flags_desc.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+        flags_desc.bindingCount = static_cast<uint32_t>(desc.binding_flags.size());
+        flags_desc.pBindingFlags = desc.binding_flags.data();
+
+        VkDescriptorSetLayoutCreateInfo create_info = {};
+        create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        create_info.pNext = desc.binding_flags.empty() ? nullptr : &flags_desc;
+        create_info.flags = desc.flags;
+        create_info.bindingCount = static_cast<uint32_t>(desc.bindings.size());
+        create_info.pBindings = desc.bindings.data();
+
+        VkDescriptorSetLayout layout;
+        VkResult res = state_.dispatch().createDescriptorSetLayout(&create_info, nullptr, &layout);
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to create descriptor set layout: %s", string_VkResult(res));
+            return VK_NULL_HANDLE;
+        }
+
+        set_layouts_.emplace(std::move(key), layout);
+        return layout;
+    }
+
+    VkPipelineLayout pipeline_layout(
+        const std::vector<VkDescriptorSetLayout> &set_layouts, const std::vector<VkPushConstantRange> &push_constants) {
+        std::vector<uint64_t> key = {set_layouts.size()};
+        for (auto layout : set_layouts) {
+            key.push_back(reinterpret_cast<uint64_t>(layout));
+        }
+
+        for (const auto &range : push_constants) {
+            key.insert(key.end(), {range.stageFlags, range.offset, range.size});
+        }
+
+        auto iter = pipeline_layouts_.find(key);
+        if (iter != pipeline_layouts_.end()) {
+            return iter->second;
+        }
+
+        VkPipelineLayoutCreateInfo create_info = {};
+        create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        create_info.setLayoutCount = static_cast<uint32_t>(set_layouts.size());
+        create_info.pSetLayouts = set_layouts.data();
+        create_info.pushConstantRangeCount = static_cast<uint32_t>(push_constants.size());
+        create_info.pPushConstantRanges = push_constants.data();
+
+        VkPipelineLayout layout;
+        VkResult res = state_.dispatch().createPipelineLayout(&create_info, nullptr, &layout);
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to create pipeline layout: %s", string_VkResult(res));
+            return VK_NULL_HANDLE;
+        }
+
+        pipeline_layouts_.emplace(std::move(key), layout);
+        return layout;
+    }
+
+    size_t num_set_layouts() const { return set_layouts_.size(); }
+    size_t num_pipeline_layouts() const { return pipeline_layouts_.size(); }
+
+    static std::unique_ptr<ShaderLibrary> initialize(ProgramState &state) {
+        return std::unique_ptr<ShaderLibrary>{new ShaderLibrary(state)};
+    }
+};
+
+// vertex input layouts understood by the pipeline manager, see VertexFormat
+constexpr size_t kVertexFormats = 2;
+
+// every attribute a vertex format provides, pipelines only enable the ones their vertex shader consumes
+struct VertexLayout {
+    uint32_t stride;
+    std::vector<VkVertexInputAttributeDescription> attributes;
+
+    static VertexLayout of(VertexFormat format) {
+        switch (format) {
+        case VertexFormat::Compact:
+            return VertexLayout{sizeof(CompactVertex),
+                {
+                    VkVertexInputAttributeDescription{
+                        0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(CompactVertex, position)},
+                    VkVertexInputAttributeDescription{1, 0, VK_FORMAT_R16G16_SNORM, offsetof(CompactVertex, normal)},
+                    VkVertexInputAttributeDescription{2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(CompactVertex, uv)},
+                }};
+        case VertexFormat::Standard:
+        default:
+            return VertexLayout{sizeof(Vertex),
+                {
+                    VkVertexInputAttributeDescription{0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position)},
+                    VkVertexInputAttributeDescription{1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal)},
+                    VkVertexInputAttributeDescription{2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv)},
+                }};
+        }
+    }
+
+    // normalized and half float attributes arrive in the shader as floats, missing components are filled in
+    static bool feeds(VkFormat attribute, VkFormat input) {
+        auto is_float_input = [](VkFormat format) {
+            return format == VK_FORMAT_R32_SFLOAT || format == VK_FORMAT_R32G32_SFLOAT ||
+                   format == VK_FORMAT_R32G32B32_SFLOAT || format == VK_FORMAT_R32G32B32A32_SFLOAT;
+        };
+
+        auto converts_to_float = [](VkFormat format) {
+            return format == VK_FORMAT_R16G16_SNORM || format == VK_FORMAT_R16G16B16A16_SNORM ||
+                   format == VK_FORMAT_R16G16_SFLOAT || format == VK_FORMAT_R16G16B16A16_SFLOAT;
+        };
+
+        return attribute == input || (is_float_input(input) && converts_to_float(attribute));
+    }
+
+    // matches the reflected inputs of a vertex shader against this layout
+    std::optional<std::vector<VkVertexInputAttributeDescription>> bind(const ShaderReflection &vertex_shader) const {
+        std::vector<VkVertexInputAttributeDescription> bound;
+
+        for (const auto &input : vertex_shader.inputs) {
+            auto iter = std::find_if(attributes.begin(), attributes.end(),
+                [&](const auto &attribute) { return attribute.location == input.location; });
+
+            if (iter == attributes.end()) {
+                LOG_ERROR("vertex format has no attribute for shader input at location %u", input.location);
+                return {};
+            }
+
+            if (!feeds(iter->format, input.format)) {
+                LOG_ERROR("vertex attribute at location %u is %s but the shader reads %s", input.location,
+                    string_VkFormat(iter->format), string_VkFormat(input.format));
+                return {};
+            }
+
+            bound.push_back(*iter);
+        }
+
+        return bound;
+    }
+};
+
+// fixed function state that may differ between pipeline variants of the same shaders
+struct RenderState {
+    VkCullModeFlags cull_mode;
+    VkFrontFace front_face;
+    VkBool32 depth_test;
+    VkBool32 depth_write;
+    VkCompareOp depth_compare;
+    VkBool32 blend;
+    VkBlendFactor src_color_factor, dst_color_factor;
+    VkBlendOp color_op;
+    VkBlendFactor src_alpha_factor, dst_alpha_factor;
+    VkBlendOp alpha_op;
+
+    static RenderState opaque() {
+        RenderState state = {};
+        state.cull_mode = VK_CULL_MODE_BACK_BIT;
+        state.front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        state.depth_test = VK_TRUE;
+        state.depth_write = VK_TRUE;
+        state.depth_compare = VK_COMPARE_OP_LESS;
+        state.blend = VK_FALSE;
+        state.src_color_factor = VK_BLEND_FACTOR_ONE;
+        state.dst_color_factor = VK_BLEND_FACTOR_ZERO;
+        state.color_op = VK_BLEND_OP_ADD;
+        state.src_alpha_factor = VK_BLEND_FACTOR_ONE;
+        state.dst_alpha_factor = VK_BLEND_FACTOR_ZERO;
+        state.alpha_op = VK_BLEND_OP_ADD;
+        return state;
+    }
+
+    static RenderState double_sided() {
+        RenderState state = opaque();
+        state.cull_mode = VK_CULL_MODE_NONE;
+        return state;
+    }
+
+    // straight alpha blending, tested against but not written to depth
+    static RenderState transparent() {
+        RenderState state = double_sided();
+        state.depth_write = VK_FALSE;
+        state.blend = VK_TRUE;
+        state.src_color_factor = VK_BLEND_FACTOR_SRC_ALPHA;
+        state.dst_color_factor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        state.src_alpha_factor = VK_BLEND_FACTOR_ONE;
+        state.dst_alpha_factor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        return state;
+    }
+
+    bool operator==(const RenderState &o) const {
+        return cull_mode == o.cull_mode && front_face == o.front_face && depth_test == o.depth_test &&
+               depth_write == o.depth_write && depth_compare == o.depth_compare && blend == o.blend &&
+               src_color_factor == o.src_color_factor && dst_color_factor == o.dst_color_factor &&
+               color_op == o.color_op && src_alpha_factor == o.src_alpha_factor &&
+               dst_alpha_factor == o.dst_alpha_factor && alpha_op == o.alpha_op;
+    }
+
+    size_t hash() const {
+        size_t seed = 0;
+        hash_combine(seed, cull_mode);
+        hash_combine(seed, static_cast<uint32_t>(front_face));
+        hash_combine(seed, depth_test);
+        hash_combine(seed, depth_write);
+        hash_combine(seed, static_cast<uint32_t>(depth_compare));
+        hash_combine(seed, blend);
+        hash_combine(seed, static_cast<uint32_t>(src_color_factor));
+        hash_combine(seed, static_cast<uint32_t>(dst_color_factor));
+        hash_combine(seed, static_cast<uint32_t>(color_op));
+        hash_combine(seed, static_cast<uint32_t>(src_alpha_factor));
+        hash_combine(seed, static_cast<uint32_t>(dst_alpha_factor));
+        hash_combine(seed, static_cast<uint32_t>(alpha_op));
+        return seed;
+    }
+};
+
+// feature toggles baked into a variant through specialization constants. the constant ids are the member order and
+// match the constant_id declarations in the shaders, the driver strips the paths a variant does not use
+struct ShaderFeatures {
+    VkBool32 instanced;        // object data is fetched by instance index instead of through the dynamic offset
+    uint32_t object_stride;    // distance between object records in 16 byte words, only read by instanced variants
+    VkBool32 textured;         // untextured variants shade by normal
+    VkBool32 alpha_test;       // discards fragments below the cutoff
+    float alpha_cutoff;
+    VkBool32 compact_vertices; // normals arrive octahedral encoded, see CompactVertex
+
+    static ShaderFeatures standard() {
+        ShaderFeatures features = {};
+        features.instanced = VK_FALSE;
+        features.object_stride = 0;
+        features.textured = VK_TRUE;
+        features.alpha_test = VK_FALSE;
+        features.alpha_cutoff = 0.5f;
+        features.compact_vertices = VK_FALSE;
+        return features;
+    }
+
+    static ShaderFeatures alpha_tested(float cutoff = 0.5f) {
+        ShaderFeatures features = standard();
+        features.alpha_test = VK_TRUE;
+        features.alpha_cutoff = cutoff;
+        return features;
+    }
+
+    bool operator==(const ShaderFeatures &o) const {
+        return instanced == o.instanced && object_stride == o.object_stride && textured == o.textured &&
+               alpha_test == o.alpha_test && alpha_cutoff == o.alpha_cutoff && compact_vertices == o.compact_vertices;
+    }
+
+    size_t hash() const {
+        size_t seed = 0;
+        hash_combine(seed, instanced);
+        hash_combine(seed, object_stride);
+        hash_combine(seed, textured);
+        hash_combine(seed, alpha_test);
+        hash_combine(seed, alpha_cutoff);
+        hash_combine(seed, compact_vertices);
+        return seed;
+    }
+};
+
+// creates graphics pipelines on demand and hands out the same pipeline for identical state.
+// compiles run on the job system, vkCreateGraphicsPipelines is thread safe including the shared pipeline cache
+struct PipelineManager final {
+public:
+    struct Desc {
+        const char *vertex_shader;
+        const char *fragment_shader;
+        VertexFormat vertex_format;
+        RenderState render_state;
+        ShaderFeatures features;
+        VkPipelineLayout layout;
+        VkRenderPass render_pass;
+        uint32_t subpass;
+    };
+
+    // compile status of one pipeline, the address is stable for the lifetime of the manager
+    struct Variant final {
+    private:
+        enum class Status { Compiling, Ready, Failed };
+
+        std::atomic<Status> status_;
+        VkPipeline pipeline_;
+
+        // owned by the thread owning the manager, kept to rebuild the variant when one of its shaders is reloaded
+        std::vector<VkVertexInputAttributeDescription> attributes_;
+        uint32_t generation_;
+
+        friend struct PipelineManager;
+
+    public:
+        Variant() : status_{Status::Compiling}, pipeline_{VK_NULL_HANDLE}, generation_{0} {}
+
+        bool ready() const { return status_.load(std::memory_order_acquire) == Status::Ready; }
+        bool failed() const { return status_.load(std::memory_order_acquire) == Status::Failed; }
+
+        // null until the compile has finished
+        VkPipeline pipeline() const { return ready() ? pipeline_ : VK_NULL_HANDLE; }
+    };
+
+private:
+    struct Key {
+        VkShaderModule vertex_module;
+        VkShaderModule fragment_module;
+        VertexFormat vertex_format;
+        RenderState render_state;
+        ShaderFeatures features;
+        VkPipelineLayout layout;
+        VkRenderPass render_pass;
+        uint32_t subpass;
+
+        bool operator==(const Key &o) const {
+            return vertex_module == o.vertex_module && fragment_module == o.fragment_module &&
+                   vertex_format == o.vertex_format && render_state == o.render_state && features == o.features &&
+                   layout == o.layout && render_pass == o.render_pass && subpass == o.subpass;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const {
+            size_t seed = key.render_state.hash();
+            hash_combine(seed, key.vertex_module);
+            hash_combine(seed, key.fragment_module);
+            hash_combine(seed, static_cast<uint32_t>(key.vertex_format));
+            hash_combine(seed, key.features.hash());
+            hash_combine(seed, key.layout);
+            hash_combine(seed, key.render_pass);
+            hash_combine(seed, key.subpass);
+            return seed;
+        }
+    };
+
+    ProgramState &state_;
+
+    // shader modules outlive the manager so their handles can identify pipelines
+    ShaderLibrary &shaders_;
+
+    // only touched by the thread owning the manager
+    std::unordered_map<Key, std::unique_ptr<Variant>, KeyHash> variants_;
+
+    // rebuilt pipeline waiting to be swapped in at the next frame boundary
+    struct Replacement {
+        Variant *variant;
+        VkPipeline pipeline;
+        uint32_t generation;
+    };
+
+    // replaced pipeline, destroyed once the frames that may still draw with it have completed
+    struct Retired {
+        VkPipeline pipeline;
+        uint64_t frame;
+    };
+
+    // compiles still running on the worker pool
+    std::mutex mutex_;
+    std::condition_variable compiled_;
+    size_t pending_;
+    std::vector<Replacement> replacements_;
+
+    // only touched by the thread owning the manager
+    std::deque<Retired> retired_;
+    uint64_t frame_;
+
+    PipelineManager(ProgramState &state, ShaderLibrary &shaders)
+        : state_{state}, shaders_{shaders}, pending_{0}, frame_{0} {}
+
+    VkPipeline create_pipeline(const Key &key, const std::vector<VkVertexInputAttributeDescription> &attributes) {
+        constexpr std::array<VkDynamicState, 2> kDynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+
+        // both stages get every constant, ids a module does not declare are ignored
+        constexpr std::array<VkSpecializationMapEntry, 6> kSpecializationEntries = {
+            VkSpecializationMapEntry{0, offsetof(ShaderFeatures, instanced), sizeof(VkBool32)},
+            VkSpecializationMapEntry{1, offsetof(ShaderFeatures, object_stride), sizeof(uint32_t)},
+            VkSpecializationMapEntry{2, offsetof(ShaderFeatures, textured), sizeof(VkBool32)},
+            VkSpecializationMapEntry{3, offsetof(ShaderFeatures, alpha_test), sizeof(VkBool32)},
+            VkSpecializationMapEntry{4, offsetof(ShaderFeatures, alpha_cutoff), sizeof(float)},
+            VkSpecializationMapEntry{5, offsetof(ShaderFeatures, compact_vertices), sizeof(VkBool32)},
+        };
+
+        VkSpecializationInfo specialization_info = {};
+        specialization_info.mapEntryCount = static_cast<uint32_t>(kSpecializationEntries.size());
+        specialization_info.pMapEntries = kSpecializationEntries.data();
+        specialization_info.dataSize = sizeof(ShaderFeatures);
+        specialization_info.pData = &key.features;
+
+        VkPipelineShaderStageCreateInfo vert_stage_info = {};
+        vert_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vert_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vert_stage_info.module = key.vertex_module;
+        vert_stage_info.pName = "main";
+        vert_stage_info.pSpecializationInfo = &specialization_info;
+
+        VkPipelineShaderStageCreateInfo frag_stage_info = {};
+        frag_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        frag_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        frag_stage_info.module = key.fragment_module;
+        frag_stage_info.pName = "main";
+        frag_stage_info.pSpecializationInfo = &specialization_info;
+
+        std::array<VkPipelineShaderStageCreateInfo, 2> shader_stages = {vert_stage_info, frag_stage_info};
+
+        // set viewport and scissor as dynamic state
+        VkPipelineDynamicStateCreateInfo dynamic_state_desc = {};
+        dynamic_state_desc.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamic_state_desc.pDynamicStates = kDynamicStates.data();
+        dynamic_state_desc.dynamicStateCount = static_cast<uint32_t>(kDynamicStates.size());
+
+        // input state using the attributes of the vertex format the shader consumes
+        VkVertexInputBindingDescription vertex_binding_desc = {};
+        vertex_binding_desc.binding = 0;
+        vertex_binding_desc.stride = VertexLayout::of(key.vertex_format).stride;
+        vertex_binding_desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        VkPipelineVertexInputStateCreateInfo input_state_desc = {};
+        input_state_desc.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        input_state_desc.pVertexAttributeDescriptions = attributes.data();
+        input_state_desc.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size());
+        input_state_desc.pVertexBindingDescriptions = &vertex_binding_desc;
+        input_state_desc.vertexBindingDescriptionCount = 1;
+
+        // input assembly
+        VkPipelineInputAssemblyStateCreateInfo assembly_desc = {};
+        assembly_desc.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        assembly_desc.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        assembly_desc.primitiveRestartEnable = false;
+
+        // dynamic state
+        VkPipelineViewportStateCreateInfo viewport_desc = {};
+        viewport_desc.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewport_desc.viewportCount = 1;
+        viewport_desc.scissorCount = 1;
+
+        // rasterization
+        VkPipelineRasterizationStateCreateInfo rasterizer_desc = {};
+        rasterizer_desc.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer_desc.depthClampEnable = false;
+        rasterizer_desc.rasterizerDiscardEnable = false;
+        rasterizer_desc.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer_desc.lineWidth = 1.0f;
+        rasterizer_desc.cullMode = key.render_state.cull_mode;
+        rasterizer_desc.frontFace = key.render_state.front_face;
+        rasterizer_desc.depthBiasEnable = false;
+        rasterizer_desc.depthBiasConstantFactor = 0.0f;
+        rasterizer_desc.depthBiasClamp = 0.0f;
+        rasterizer_desc.depthBiasSlopeFactor = 0.0f;
+
+        // no multisampling
+        VkPipelineMultisampleStateCreateInfo multisample_desc = {};
+        multisample_desc.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisample_desc.sampleShadingEnable = false;
+        multisample_desc.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisample_desc.minSampleShading = 1.0f;
+        multisample_desc.pSampleMask = nullptr;
+        multisample_desc.alphaToCoverageEnable = false;
+        multisample_desc.alphaToOneEnable = false;
+
+        // blending
+        VkPipelineColorBlendAttachmentState blend_att_desc = {};
+        blend_att_desc.colorWriteMask =
+            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        blend_att_desc.blendEnable = key.render_state.blend;
+        blend_att_desc.srcColorBlendFactor = key.render_state.src_color_factor;
+        blend_att_desc.dstColorBlendFactor = key.render_state.dst_color_factor;
+        blend_att_desc.colorBlendOp = key.render_state.color_op;
+        blend_att_desc.srcAlphaBlendFactor = key.render_state.src_alpha_factor;
+        blend_att_desc.dstAlphaBlendFactor = key.render_state.dst_alpha_factor;
+        blend_att_desc.alphaBlendOp = key.render_state.alpha_op;
+
+        VkPipelineColorBlendStateCreateInfo blend_desc = {};
+        blend_desc.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        blend_desc.logicOpEnable = false;
+        blend_desc.logicOp = VK_LOGIC_OP_COPY;
+        blend_desc.blendConstants[0] = 0.0f;
+        blend_desc.blendConstants[1] = 0.0f;
+        blend_desc.blendConstants[2] = 0.0f;
+        blend_desc.blendConstants[3] = 0.0f;
+        blend_desc.pAttachments = &blend_att_desc;
+        blend_desc.attachmentCount = 1;
+
+        VkPipelineDepthStencilStateCreateInfo depth_desc = {};
+        depth_desc.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depth_desc.depthWriteEnable = key.render_state.depth_write;
+        depth_desc.depthTestEnable = key.render_state.depth_test;
+        depth_desc.depthCompareOp = key.render_state.depth_compare;
+        depth_desc.depthBoundsTestEnable = VK_FALSE;
+        depth_desc.stencilTestEnable = VK_FALSE;
+
+        // finally, create the graphics pipeline
+        VkGraphicsPipelineCreateInfo create_info = {};
+        create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        create_info.pStages = shader_stages.data();
+        create_info.stageCount = static_cast<uint32_t>(shader_stages.size());
+        create_info.pVertexInputState = &input_state_desc;
+        create_info.pInputAssemblyState = &assembly_desc;
+        create_info.pViewportState = &viewport_desc;
+        create_info.pRasterizationState = &rasterizer_desc;
+        create_info.pMultisampleState = &multisample_desc;
+        create_info.pColorBlendState = &blend_desc;
+        create_info.pDynamicState = &dynamic_state_desc;
+        create_info.pDepthStencilState = &depth_desc;
+        create_info.layout = key.layout;
+        create_info.renderPass = key.render_pass;
+        create_info.subpass = key.subpass;
+
+        VkPipeline pipeline;
+        VkResult res =
+            state_.dispatch().createGraphicsPipelines(state_.pipeline_cache(), 1, &create_info, nullptr, &pipeline);
+
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to create pipeline: %s", string_VkResult(res));
+            return VK_NULL_HANDLE;
+        }
+
+        return pipeline;
+    }
+
+    // generation 0 is the first compile of a variant, later generations are rebuilds that get swapped in by update()
+    void compile(const Key &key, const std::vector<VkVertexInputAttributeDescription> &attributes, Variant *variant,
+        uint32_t generation) {
+        auto start = std::chrono::steady_clock::now();
+        VkPipeline pipeline = create_pipeline(key, attributes);
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        if (generation == 0) {
+            variant->pipeline_ = pipeline;
+            variant->status_.store(pipeline != VK_NULL_HANDLE ? Variant::Status::Ready : Variant::Status::Failed,
+                std::memory_order_release);
+        }
+
+        size_t remaining;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            remaining = --pending_;
+
+            if (generation != 0 && pipeline != VK_NULL_HANDLE) {
+                replacements_.push_back(Replacement{variant, pipeline, generation});
+            }
+        }
+
+        compiled_.notify_all();
+
+        if (pipeline != VK_NULL_HANDLE) {
+            LOG_INFO("compiled pipeline variant in %.2f ms, %zu still compiling", ms, remaining);
+        }
+    }
+
+    void wait(const Variant &variant) {
+        std::unique_lock<std::mutex> lock{mutex_};
+        compiled_.wait(lock, [&]() { return variant.ready() || variant.failed(); });
+    }
+
+public:
+    PipelineManager(const PipelineManager &) = delete;
+    PipelineManager &operator=(const PipelineManager &) = delete;
+
+    ~PipelineManager() {
+        wait_idle();
+
+        for (auto &entry : variants_) {
+            if (entry.second->pipeline_ != VK_NULL_HANDLE) {
+                state_.dispatch().destroyPipeline(entry.second->pipeline_, nullptr);
+            }
+        }
+
+        for (auto &replacement : replacements_) {
+            state_.dispatch().destroyPipeline(replacement.pipeline, nullptr);
+        }
+
+        for (auto &retired : retired_) {
+            state_.dispatch().destroyPipeline(retired.pipeline, nullptr);
+        }
+    }
+
+    // queues a compile unless the variant already exists, returns null if the shaders cannot be loaded
+    // or do not fit the vertex format
+    const Variant *request(const Desc &desc) {
+        const auto *vertex_shader = shaders_.get(desc.vertex_shader);
+        const auto *fragment_shader = shaders_.get(desc.fragment_shader);
+        if (!vertex_shader || !fragment_shader) {
+            return nullptr;
+        }
+
+        Key key = {};
+        key.vertex_module = vertex_shader->module;
+        key.fragment_module = fragment_shader->module;
+        key.vertex_format = desc.vertex_format;
+        key.render_state = desc.render_state;
+        key.features = desc.features;
+        key.layout = desc.layout;
+        key.render_pass = desc.render_pass;
+        key.subpass = desc.subpass;
+
+        auto iter = variants_.find(key);
+        if (iter != variants_.end()) {
+            return iter->second.get();
+        }
+
+        auto attributes = VertexLayout::of(desc.vertex_format).bind(vertex_shader->reflection);
+        if (!attributes) {
+            LOG_ERROR("%s does not match its vertex format", desc.vertex_shader);
+            return nullptr;
+        }
+
+        Variant *variant = variants_.emplace(key, std::make_unique<Variant>()).first->second.get();
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            ++pending_;
+        }
+
+        variant->attributes_ = std::move(*attributes);
+        state_.jobs().submit([this, key, attributes = variant->attributes_, variant]() {
+            compile(key, attributes, variant, 0);
+        });
+        return variant;
+    }
+
+    // blocking variant of request, for pipelines that must exist before the first frame
+    VkPipeline get(const Desc &desc) {
+        const Variant *variant = request(desc);
+        if (!variant) {
+            return VK_NULL_HANDLE;
+        }
+
+        wait(*variant);
+        return variant->pipeline();
+    }
+
+    // number of compiles that have not finished yet
+    size_t pending() {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return pending_;
+    }
+
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock{mutex_};
+        compiled_.wait(lock, [this]() { return pending_ == 0; });
+    }
+
+    // recompiles every variant built from a replaced shader module. the variants keep their address and keep
+    // drawing with their current pipeline until update() swaps the rebuilt one in, returns the number queued
+    size_t rebuild(VkShaderModule old_module, VkShaderModule new_module) {
+        std::vector<std::pair<Key, std::unique_ptr<Variant>>> affected;
+        for (auto iter = variants_.begin(); iter != variants_.end();) {
+            if (iter->first.vertex_module == old_module || iter->first.fragment_module == old_module) {
+                affected.emplace_back(iter->first, std::move(iter->second));
+                iter = variants_.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+
+        for (auto &entry : affected) {
+            Key key = entry.first;
+            key.vertex_module = key.vertex_module == old_module ? new_module : key.vertex_module;
+            key.fragment_module = key.fragment_module == old_module ? new_module : key.fragment_module;
+
+            Variant *variant = variants_.emplace(key, std::move(entry.second)).first->second.get();
+            uint32_t generation = ++variant->generation_;
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                ++pending_;
+            }
+
+            state_.jobs().submit([this, key, attributes = variant->attributes_, variant, generation]() {
+                compile(key, attributes, variant, generation);
+            });
+        }
+
+        return affected.size();
+    }
+
+    // swaps rebuilt pipelines in, called once per frame after waiting on the fence of the frame about to be recorded.
+    // a replaced pipeline may still be in use by the frames in flight so it is only destroyed after they complete
+    void update(uint32_t frames_in_flight) {
+        ++frame_;
+
+        while (!retired_.empty() && retired_.front().frame + frames_in_flight <= frame_) {
+            state_.dispatch().destroyPipeline(retired_.front().pipeline, nullptr);
+            retired_.pop_front();
+        }
+
+        std::vector<Replacement> replacements;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            if (replacements_.empty()) {
+                return;
+            }
+
+            replacements.swap(replacements_);
+        }
+
+        for (auto &replacement : replacements) {
+            Variant *variant = replacement.variant;
+
+            // a newer rebuild was queued while this one compiled, it was never drawn with
+            if (replacement.generation != variant->generation_) {
+                state_.dispatch().destroyPipeline(replacement.pipeline, nullptr);
+                continue;
+            }
+
+            // the first compile still writes the pipeline on a worker, try again next frame
+            if (variant->status_.load(std::memory_order_acquire) == Variant::Status::Compiling) {
+                std::lock_guard<std::mutex> lock{mutex_};
+                replacements_.push_back(replacement);
+                continue;
+            }
+
+            if (variant->pipeline_ != VK_NULL_HANDLE) {
+                retired_.push_back(Retired{variant->pipeline_, frame_});
+            }
+
+            variant->pipeline_ = replacement.pipeline;
+            variant->status_.store(Variant::Status::Ready, std::memory_order_release);
+        }
+    }
+
+    // pipelines replaced outside the manager, destroyed like its own once the frames in flight complete
+    void retire(VkPipeline pipeline) {
+        if (pipeline != VK_NULL_HANDLE) {
+            retired_.push_back(Retired{pipeline, frame_});
+        }
+    }
+
+    size_t size() const { return variants_.size(); }
+
+    static std::unique_ptr<PipelineManager> initialize(ProgramState &state, ShaderLibrary &shaders) {
+        return std::unique_ptr<PipelineManager>{new PipelineManager(state, shaders)};
+    }
+};
+
+// gpu time of named scopes of every frame, measured with timestamp queries. every frame in flight writes its own
+// query pool, which is read back once the frame's fence was waited on, so the results trail by a frame in flight and
+// reading them never stalls. scopes can be written from several recorders of a frame at once
+struct GpuProfiler final {
+public:
+    static constexpr uint32_t kMaxScopes = 256;
+    static constexpr uint32_t kNoScope = UINT32_MAX;
+
+    // averages over this many seconds are logged
+    static constexpr double kLogInterval = 5.0;
+
+    struct Timing {
+        std::string name;
+        double ms;
+    };
+
+    // what the scene draws of one frame fed through the pipeline, in the order vulkan writes the counters
+    struct Statistics {
+        uint64_t input_primitives;
+        uint64_t vertex_invocations;
+        uint64_t clipping_primitives; // primitives left after clipping
+        uint64_t fragment_invocations;
+    };
+
+    static constexpr VkQueryPipelineStatisticFlags kStatistics =
+        VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct FrameQueries {
+        VkQueryPool pool = VK_NULL_HANDLE;
+        std::atomic<uint32_t> num_scopes{0};
+        std::array<std::string, kMaxScopes> names;
+
+        // a single query, only read back when the frame began it
+        VkQueryPool statistics_pool = VK_NULL_HANDLE;
+        bool statistics_written = false;
+    };
+
+    // running totals of the log interval, in the order the scopes first appeared
+    struct Summary {
+        std::string name;
+        double total_ms;
+        uint32_t count;
+    };
+
+    ProgramState &state_;
+    std::vector<std::unique_ptr<FrameQueries>> frames_;
+
+    double ms_per_tick_;
+    uint64_t tick_mask_; // timestamps only count up in the valid bits of the queue
+
+    bool batch_scopes_;
+    std::vector<Timing> timings_;
+    std::vector<Summary> summary_;
+    Clock::time_point summary_start_;
+
+    bool pipeline_statistics_;
+    Statistics statistics_;
+    Statistics statistics_total_;
+    uint32_t statistics_count_;
+
+    GpuProfiler(ProgramState &state)
+        : state_{state}, ms_per_tick_{0.0}, tick_mask_{0}, batch_scopes_{false}, summary_start_{Clock::now()},
+          pipeline_statistics_{false}, statistics_{}, statistics_total_{}, statistics_count_{0} {}
+
+    void read_back_statistics(FrameQueries &queries) {
+        if (!queries.statistics_written) {
+            return;
+        }
+
+        Statistics statistics = {};
+        VkResult res = state_.dispatch().getQueryPoolResults(queries.statistics_pool, 0, 1, sizeof(statistics),
+            &statistics, sizeof(statistics), VK_QUERY_RESULT_64_BIT);
+
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to read pipeline statistics: %s", string_VkResult(res));
+            return;
+        }
+
+        statistics_ = statistics;
+        statistics_total_.input_primitives += statistics.input_primitives;
+        statistics_total_.vertex_invocations += statistics.vertex_invocations;
+        statistics_total_.clipping_primitives += statistics.clipping_primitives;
+        statistics_total_.fragment_invocations += statistics.fragment_invocations;
+        ++statistics_count_;
+    }
+
+    void read_back(FrameQueries &queries) {
+        uint32_t num_scopes = std::min(queries.num_scopes.load(), kMaxScopes);
+        if (num_scopes == 0) {
+            return;
+        }
+
+        std::vector<uint64_t> ticks(2 * num_scopes);
+        VkResult res = state_.dispatch().getQueryPoolResults(queries.pool, 0, 2 * num_scopes,
+            ticks.size() * sizeof(uint64_t), ticks.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+        // the fence was waited on, so anything missing was never written
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to read gpu timestamps: %s", string_VkResult(res));
+            return;
+        }
+
+        timings_.clear();
+        for (uint32_t i = 0; i < num_scopes; ++i) {
+            uint64_t elapsed = (ticks[2 * i + 1] - ticks[2 * i]) & tick_mask_;
+            timings_.push_back(Timing{std::move(queries.names[i]), static_cast<double>(elapsed) * ms_per_tick_});
+        }
+
+        for (const auto &timing : timings_) {
+            auto iter = std::find_if(summary_.begin(), summary_.end(),
+                [&](const Summary &summary) { return summary.name == timing.name; });
+            if (iter == summary_.end()) {
+                summary_.push_back(Summary{timing.name, 0.0, 0});
+                iter = summary_.end() - 1;
+            }
+
+            iter->total_ms += timing.ms;
+            ++iter->count;
+        }
+    }
+
+    void log_summary() {
+        auto now = Clock::now();
+        if (std::chrono::duration<double>(now - summary_start_).count() < kLogInterval || summary_.empty()) {
+            return;
+        }
+
+        std::string line;
+        for (const auto &summary : summary_) {
+            char entry[128];
+            snprintf(entry, sizeof(entry), "%s%s %.3f ms", line.empty() ? "" : ", ", summary.name.c_str(),
+                summary.total_ms / std::max(summary.count, 1u));
+            line += entry;
+        }
+
+        LOG_INFO("gpu time: %s", line.c_str());
+        summary_.clear();
+        summary_start_ = now;
+
+        if (statistics_count_ == 0) {
+            return;
+        }
+
+        // fragment invocations per pixel is the overdraw the early depth test let through
+        auto extent = state_.swapchain().extent;
+        double frames = static_cast<double>(statistics_count_);
+        double fragments = static_cast<double>(statistics_total_.fragment_invocations) / frames;
+        LOG_INFO("gpu statistics: %.0f primitives in, %.0f vertex invocations, %.0f primitives after clipping, "
+                 "%.0f fragment invocations (%.2f per pixel)",
+            static_cast<double>(statistics_total_.input_primitives) / frames,
+            static_cast<double>(statistics_total_.vertex_invocations) / frames,
+            static_cast<double>(statistics_total_.clipping_primitives) / frames, fragments,
+            fragments / std::max(1.0, static_cast<double>(extent.width) * extent.height));
+
+        statistics_total_ = {};
+        statistics_count_ = 0;
+    }
+
+public:
+    GpuProfiler(const GpuProfiler &) = delete;
+    GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+    ~GpuProfiler() {
+        for (auto &queries : frames_) {
+            state_.dispatch().destroyQueryPool(queries->pool, nullptr);
+            state_.dispatch().destroyQueryPool(queries->statistics_pool, nullptr);
+        }
+    }
+
+    // per batch scopes split the draws into one scope per material batch, which costs a pair of timestamps each
+    void set_batch_scopes(bool enabled) { batch_scopes_ = enabled; }
+    bool batch_scopes() const { return batch_scopes_; }
+
+    // scopes of the latest frame that was read back, in the order they began
+    const std::vector<Timing> &timings() const { return timings_; }
+
+    // counters of the latest frame that was read back, all zero without pipeline statistics
+    bool pipeline_statistics() const { return pipeline_statistics_; }
+    const Statistics &statistics() const { return statistics_; }
+
+    // secondary command buffers executed inside the statistics query have to inherit these
+    VkQueryPipelineStatisticFlags inherited_statistics() const { return pipeline_statistics_ ? kStatistics : 0; }
+
+    // reads back what the frame measured last time and resets its queries. call after the frame's fence was waited
+    // on, before anything else is recorded into its command buffer
+    void begin_frame(VkCommandBuffer command_buffer, uint32_t frame) {
+        auto &queries = *frames_[frame];
+        read_back(queries);
+        read_back_statistics(queries);
+        log_summary();
+
+        queries.num_scopes = 0;
+        state_.dispatch().cmdResetQueryPool(command_buffer, queries.pool, 0, 2 * kMaxScopes);
+
+        queries.statistics_written = false;
+        if (pipeline_statistics_) {
+            state_.dispatch().cmdResetQueryPool(command_buffer, queries.statistics_pool, 0, 1);
+        }
+    }
+
+    // counts the draws recorded in between, at most once per frame and outside of render passes
+    void begin_statistics(VkCommandBuffer command_buffer, uint32_t frame) {
+        auto &queries = *frames_[frame];
+        if (!pipeline_statistics_ || queries.statistics_written) {
+            return;
+        }
+
+        state_.dispatch().cmdBeginQuery(command_buffer, queries.statistics_pool, 0, 0);
+        queries.statistics_written = true;
+    }
+
+    void end_statistics(VkCommandBuffer command_buffer, uint32_t frame) {
+        if (pipeline_statistics_) {
+            state_.dispatch().cmdEndQuery(command_buffer, frames_[frame]->statistics_pool, 0);
+        }
+    }
+
+    // returns kNoScope once the frame ran out of scopes, ending it does nothing
+    uint32_t begin_scope(VkCommandBuffer command_buffer, uint32_t frame, std::string name) {
+        auto &queries = *frames_[frame];
+        uint32_t scope = queries.num_scopes.fetch_add(1);
+        if (scope >= kMaxScopes) {
+            return kNoScope;
+        }
+
+        queries.names[scope] = std::move(name);
+        state_.dispatch().cmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries.pool, 2 * scope);
+        return scope;
+    }
+
+    void end_scope(VkCommandBuffer command_buffer, uint32_t frame, uint32_t scope) {
+        if (scope == kNoScope) {
+            return;
+        }
+
+        state_.dispatch().cmdWriteTimestamp(
+            command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frames_[frame]->pool, 2 * scope + 1);
+    }
+
+    // empty when the graphics queue does not write timestamps
+    static std::unique_ptr<GpuProfiler> initialize(ProgramState &state, uint32_t num_frames) {
+        auto family = state.device().get_queue_index(vkb::QueueType::graphics).value();
+        uint32_t valid_bits = state.device().queue_families[family].timestampValidBits;
+        float period = state.phys_dev().properties.limits.timestampPeriod;
+
+        if (valid_bits == 0 || period <= 0.0f) {
+            LOG_INFO("graphics queue does not support timestamps, gpu profiling is disabled");
+            return {};
+        }
+
+        std::unique_ptr<GpuProfiler> profiler{new GpuProfiler(state)};
+        profiler->ms_per_tick_ = static_cast<double>(period) * 1e-6;
+        profiler->tick_mask_ = valid_bits >= 64 ? UINT64_MAX : (uint64_t{1} << valid_bits) - 1;
+        profiler->pipeline_statistics_ = state.pipeline_statistics();
+
+        VkQueryPoolCreateInfo pool_desc = {};
+        pool_desc.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        pool_desc.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        pool_desc.queryCount = 2 * kMaxScopes;
+
+        VkQueryPoolCreateInfo statistics_desc = {};
+        statistics_desc.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        statistics_desc.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        statistics_desc.queryCount = 1;
+        statistics_desc.pipelineStatistics = kStatistics;
+
+        for (uint32_t i = 0; i < num_frames; ++i) {
+            auto queries = std::make_unique<FrameQueries>();
+
+            VkResult res = state.dispatch().createQueryPool(&pool_desc, nullptr, &queries->pool);
+            if (VK_SUCCESS != res) {
+                LOG_ERROR("failed to create timestamp query pool: %s", string_VkResult(res));
+                return {};
+            }
+
+            if (profiler->pipeline_statistics_) {
+                res = state.dispatch().createQueryPool(&statistics_desc, nullptr, &queries->statistics_pool);
+                if (VK_SUCCESS != res) {
+                    state.dispatch().destroyQueryPool(queries->pool, nullptr);
+                    LOG_ERROR("failed to create pipeline statistics query pool: %s", string_VkResult(res));
+                    return {};
+                }
+            }
+
+            profiler->frames_.push_back(std::move(queries));
+        }
+
+        LOG_INFO("gpu profiling with %u bit timestamps of %.2f ns", valid_bits, period);
+        return profiler;
+    }
+};
+
+struct SceneState final {
+public:
+    static constexpr size_t kMaxStaticMeshes = 128;
+    static constexpr size_t kMaxObjects = 1024;
+
+    // below this many draws per recorder the cost of handing work to another thread outweighs recording it
+    static constexpr size_t kMinDrawsPerRecorder = 256;
+    static constexpr size_t kMaxMaterials = 256;
+
+    // meshes get up to this many levels of detail. a level is drawn while its error stays under kLodPixelError
+    // pixels on screen, switching to a coarser one waits until it is under kLodHysteresis of that
+    static constexpr size_t kMaxMeshLods = 8;
+    static constexpr float kLodPixelError = 1.0f;
+    static constexpr float kLodHysteresis = 0.75f;
+
+    // on the gpu driven path the full mesh of meshes with at least kMinMeshClusters meshlets is culled meshlet by
+    // meshlet. the meshlets of all meshes share one table, each cull phase has room for kMaxClusterCommands draws
+    static constexpr size_t kMinMeshClusters = 4;
+    static constexpr size_t kMaxMeshClusters = 1 << 16;
+    static constexpr size_t kMaxClusterCommands = 1 << 16;
+
+    template <typename T> struct Identifier {
+    private:
+        static constexpr uint32_t kInvalidId = UINT32_MAX;
+
+        uint32_t id_;
+        Identifier(uint32_t id) : id_{id} {}
+
+        friend class SceneState;
+
+    public:
+        Identifier() : id_{kInvalidId} {}
+        Identifier(const Identifier &) = default;
+        Identifier &operator=(const Identifier &) = default;
+        ~Identifier() = default;
+
+        Identifier(Identifier &&i) {
+            id_ = i.id_;
+            i.id_ = kInvalidId;
+        }
+
+        Identifier &operator=(Identifier &&i) {
+            if (this != &i) {
+                id_ = i.id_;
+                i.id_ = kInvalidId;
+            }
+
+            return *this;
+        }
+
+        bool valid() const { return id_ != kInvalidId; }
+
+        operator bool() const { return valid(); }
+        bool operator<(const Identifier<T> &other) const { return id_ < other.id_; }
+        bool operator>(const Identifier<T> &other) const { return id_ > other.id_; }
+        bool operator==(const Identifier<T> &other) const { return id_ == other.id_; }
+    };
+
+    struct Material final {
+    public:
+        using Id = Identifier<Material>;
+
+    private:
+        SamplerCache *sampler_cache_;
+        Id id_;
+        Image image_;
+        Image::View image_view_;
+        VkSampler sampler_;
+        VkDescriptorSet descriptor_set_;
+        std::optional<TextureAtlas::Region> atlas_region_;
+
+        // pipeline variants drawing this material for every vertex format, the fallback is used while a variant is
+        // still compiling
+        RenderState render_state_;
+        ShaderFeatures features_;
+        std::array<const PipelineManager::Variant *, kVertexFormats> variants_;
+        std::array<const PipelineManager::Variant *, kVertexFormats> fallbacks_;
+
+        Material(SamplerCache &sampler_cache, const Id &id, Image &&image, Image::View &&image_view, VkSampler sampler,
+            VkDescriptorSet descriptor_set)
+            : sampler_cache_{&sampler_cache}, id_{id}, image_{std::move(image)}, image_view_{std::move(image_view)},
+              sampler_{sampler}, descriptor_set_{descriptor_set}, render_state_{RenderState::opaque()},
+              features_{ShaderFeatures::standard()}, variants_{}, fallbacks_{} {}
+
+        friend struct SceneState;
+
+    public:
+        const Id &id() const { return id_; }
+        Image &image() { return image_; }
+        Image::View &image_view() { return image_view_; }
+        VkSampler sampler() { return sampler_; }
+        VkDescriptorSet descriptor_set() { return descriptor_set_; }
+        const VkDescriptorSet *descriptor_set_addr() const { return &descriptor_set_; }
+        const std::optional<TextureAtlas::Region> &atlas_region() const { return atlas_region_; }
+        const RenderState &render_state() const { return render_state_; }
+        const ShaderFeatures &features() const { return features_; }
+        const PipelineManager::Variant *variant(VertexFormat format) const {
+            return variants_[static_cast<size_t>(format)];
+        }
+
+        // may change from one call to the next while the variant compiles
+        VkPipeline pipeline(VertexFormat format) const {
+            const auto *variant = variants_[static_cast<size_t>(format)];
+            VkPipeline pipeline = variant ? variant->pipeline() : VK_NULL_HANDLE;
+            return pipeline != VK_NULL_HANDLE ? pipeline : fallbacks_[static_cast<size_t>(format)]->pipeline();
+        }
+
+        ~Material() { release(); }
+
+        Material(const Material &) = delete;
+        Material &operator=(const Material &) = delete;
+
+        Material(Material &&m) : image_view_{std::move(m.image_view_)} {
+            sampler_cache_ = m.sampler_cache_;
+            id_ = std::move(m.id_);
+            image_ = std::move(m.image_);
+            sampler_ = m.sampler_;
+            descriptor_set_ = m.descriptor_set_;
+            atlas_region_ = m.atlas_region_;
+            render_state_ = m.render_state_;
+            features_ = m.features_;
+            variants_ = m.variants_;
+            fallbacks_ = m.fallbacks_;
+
+            m.sampler_cache_ = nullptr;
+            m.sampler_ = VK_NULL_HANDLE;
+            m.descriptor_set_ = VK_NULL_HANDLE;
+        }
+
+        Material &operator=(Material &&m) {
+            if (this != &m) {
+                release();
+                sampler_cache_ = m.sampler_cache_;
+                id_ = std::move(m.id_);
+                image_ = std::move(m.image_);
+                sampler_ = m.sampler_;
+                descriptor_set_ = m.descriptor_set_;
+                atlas_region_ = m.atlas_region_;
+                render_state_ = m.render_state_;
+                features_ = m.features_;
+                variants_ = m.variants_;
+                fallbacks_ = m.fallbacks_;
+                image_view_ = std::move(m.image_view_);
+
+                m.sampler_cache_ = nullptr;
+                m.sampler_ = VK_NULL_HANDLE;
+                m.descriptor_set_ = VK_NULL_HANDLE;
+            }
+
+            return *this;
+        }
+
+    private:
+        void release() {
+            if (sampler_cache_ && sampler_ != VK_NULL_HANDLE) {
+                sampler_cache_->release(sampler_);
+            }
+
+            sampler_cache_ = nullptr;
+            sampler_ = VK_NULL_HANDLE;
+        }
+    };
+
+    struct StaticMesh final {
+    public:
+        using Id = Identifier<StaticMesh>;
+
+        // range of the index buffer drawing one level of detail, error is how far its surface strays from the full
+        // mesh in mesh units. level 0 is the full mesh, every further level is coarser and strays further
+        struct Lod {
+            uint32_t first_index;
+            uint32_t num_indices;
+            float error;
+        };
+
+        // how the buffers store the mesh, dequantize maps compact positions back into mesh units
+        struct Encoding {
+            VertexFormat vertex_format;
+            VkIndexType index_type;
+            glm::fmat4 dequantize;
+        };
+
+        // range of the scene's cluster table splitting the full mesh, empty when the mesh is drawn whole
+        struct Clusters {
+            uint32_t first;
+            uint32_t count;
+        };
+
+    private:
+        Id id_;
+        Buffer vertex_buffer_;
+        Buffer index_buffer_;
+        uint32_t num_vertices_;
+        uint32_t num_indices_;
+        Bounds bounds_;
+        std::vector<Lod> lods_;
+        Encoding encoding_;
+        Clusters clusters_;
+
+        StaticMesh(const Id &id, Buffer &&vertex_buffer, Buffer &&index_buffer, uint32_t num_vertices,
+            uint32_t num_indices, const Bounds &bounds, std::vector<Lod> &&lods, const Encoding &encoding,
+            const Clusters &clusters)
+            : id_{id}, vertex_buffer_{std::move(vertex_buffer)}, index_buffer_{std::move(index_buffer)},
+              num_vertices_{num_vertices}, num_indices_{num_indices}, bounds_{bounds}, lods_{std::move(lods)},
+              encoding_{encoding}, clusters_{clusters} {}
+
+        friend struct SceneState;
+
+    public:
+        const Id &id() const { return id_; }
+        Buffer &vertex_buffer() { return vertex_buffer_; }
+        Buffer &index_buffer() { return index_buffer_; }
+        uint32_t num_vertices() const { return num_vertices_; }
+        uint32_t num_indices() const { return num_indices_; }
+        const Bounds &bounds() const { return bounds_; }
+        const std::vector<Lod> &lods() const { return lods_; }
+        const Encoding &encoding() const { return encoding_; }
+        const Clusters &clusters() const { return clusters_; }
+
+        ~StaticMesh() = default;
+
+        StaticMesh(const StaticMesh &) = delete;
+        StaticMesh &operator=(const StaticMesh &) = delete;
+
+        StaticMesh(StaticMesh &&m) {
+            id_ = std::move(m.id_);
+            vertex_buffer_ = std::move(m.vertex_buffer_);
+            index_buffer_ = std::move(m.index_buffer_);
+            num_vertices_ = m.num_vertices_;
+            num_indices_ = m.num_indices_;
+            bounds_ = m.bounds_;
+            lods_ = std::move(m.lods_);
+            encoding_ = m.encoding_;
+            clusters_ = m.clusters_;
+
+            m.num_vertices_ = 0;
+            m.num_vertices_ = 0;
+        }
+
+        StaticMesh &operator=(StaticMesh &&m) {
+            if (this != &m) {
+                id_ = std::move(m.id_);
+                vertex_buffer_ = std::move(m.vertex_buffer_);
+                index_buffer_ = std::move(m.index_buffer_);
+                num_vertices_ = m.num_vertices_;
+                num_indices_ = m.num_indices_;
+                bounds_ = m.bounds_;
+                lods_ = std::move(m.lods_);
+                encoding_ = m.encoding_;
+                clusters_ = m.clusters_;
+
+                m.num_vertices_ = 0;
+                m.num_vertices_ = 0;
+            }
+
+            return *this;
+        }
+
+        void bind(vkb::DispatchTable &dispatch, VkCommandBuffer command_buffer) {
+            VkDeviceSize buf_offset = 0;
+            dispatch.cmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffer_.addr_of(), &buf_offset);
+            dispatch.cmdBindIndexBuffer(command_buffer, index_buffer_.buffer(), 0, encoding_.index_type);
+        }
+
+        // instanced variants locate the object record through the first instance
+        void draw(vkb::DispatchTable &dispatch, VkCommandBuffer command_buffer, uint32_t first_instance = 0,
+            uint32_t lod = 0) {
+            bind(dispatch, command_buffer);
+            const auto &range = lods_[lod];
+            dispatch.cmdDrawIndexed(command_buffer, range.num_indices, 1, range.first_index, 0, first_instance);
+        }
+    };
+
+    struct SceneObject final {
+    public:
+        using Id = Identifier<SceneObject>;
+
+    private:
+        Id id_;
+        glm::fvec3 translation_;
+        glm::fvec3 scale_;
+        glm::fquat rotation_;
+
+        glm::fmat4x4 transform_;
+        StaticMesh::Id mesh_id_;
+        Material::Id material_id_;
+
+        // world space bounds are refreshed lazily before the next cull
+        bool bounds_dirty_;
+
+        // level of detail the cpu path last drew the mesh with
+        uint32_t lod_;
+
+        SceneObject(const Id &id)
+            : id_{id}, translation_{0.0f, 0.0f, 0.0f}, scale_{1.0f, 1.0f, 1.0f}, rotation_{0.0f, 0.0f, 0.0f, 1.0f},
+              transform_(1.0f), mesh_id_{}, bounds_dirty_{true}, lod_{0} {}
+
+        friend struct SceneState;
+
+        void recalculate_transform() {
+            transform_ = glm::translate(glm::mat4(1.0f), translation_) * glm::mat4_cast(rotation_) *
+                         glm::scale(glm::mat4(1.0f), scale_);
+            bounds_dirty_ = true;
+        }
+
+    public:
+        SceneObject(const SceneObject &) = delete;
+        SceneObject &operator=(const SceneObject &) = delete;
+
+        SceneObject(SceneObject &&o) noexcept
+            : id_{std::move(o.id_)}, translation_(std::move(o.translation_)), scale_(std::move(o.scale_)),
+              rotation_(std::move(o.rotation_)), transform_(std::move(o.transform_)), mesh_id_(std::move(o.mesh_id_)),
+              bounds_dirty_{true}, lod_{o.lod_} {}
+
+        SceneObject &operator=(SceneObject &&o) noexcept {
+            if (this != &o) {
+                id_ = std::move(o.id_);
+                translation_ = std::move(o.translation_);
+                scale_ = std::move(o.scale_);
+                rotation_ = std::move(o.rotation_);
+                transform_ = std::move(o.transform_);
+                mesh_id_ = std::move(o.mesh_id_);
+                bounds_dirty_ = true;
+                lod_ = o.lod_;
+
+                o.translation_ = {0.0f, 0.0f, 0.0f};
+                o.scale_ = {1.0f, 1.0f, 1.0f};
+                o.rotation_ = {0.0f, 0.0f, 0.0f, 1.0f};
+                o.transform_ = glm::mat4(1.0f);
+                o.mesh_id_ = {};
+            }
+
+            return *this;
+        }
+
+        const Id &id() const { return id_; }
+        const glm::fvec3 &translation() const { return translation_; }
+        const glm::fvec3 &scale() const { return scale_; }
+        const glm::fquat &rotation() const { return rotation_; }
+        const glm::fmat4x4 &transform() const { return transform_; }
+        const StaticMesh::Id &mesh_id() const { return mesh_id_; }
+        const Material::Id &material_id() const { return material_id_; }
+
+        void set_translation(const glm::fvec3 &translation) {
+            translation_ = translation;
+            recalculate_transform();
+        }
+
+        void set_scale(const glm::fvec3 &scale) {
+            scale_ = scale;
+            recalculate_transform();
+        }
+
+        void set_rotation(const glm::fquat &rotation) {
+            rotation_ = rotation;
+            recalculate_transform();
+        }
+
+        void set_mesh_id(const StaticMesh::Id &mesh_id) {
+            mesh_id_ = mesh_id;
+            bounds_dirty_ = true;
+            lod_ = 0;
+        }
+        void set_material_id(const Material::Id &material_id) { material_id_ = material_id; }
+    };
+
+    enum DescriptorSet { PerFrame, PerMaterial, PerObject, Count };
+
+    struct FrameSubmitData final {
+    private:
+        ProgramState &state_;
+        SceneState &scene_;
+
+        VkCommandBuffer command_buffer_;
+        VkSemaphore sem_image_avaliable_, sem_render_done_;
+        VkFence fence_in_flight_;
+
+        VkDescriptorSet per_frame_set_;
+        Buffer per_frame_buffer_;
+
+        // camera of the last per frame update, the scene is only culled once one was given
+        std::optional<glm::fmat4> view_proj_;
+
+        // camera position and how many pixels a world unit covers at distance one, levels of detail are picked by
+        // it. w is 0 until a camera was given
+        glm::fvec4 lod_view_;
+
+        // secondary command buffers the scene draws are recorded into, each recorder has its own pool so
+        // recorders can run on different threads, pools are reset as a whole once the frame's fence is signaled
+        std::vector<VkCommandPool> recorder_pools_;
+        std::vector<VkCommandBuffer> recorder_buffers_;
+
+        // gpu culling input, the commands the cull pass writes and one draw count per batch. object slots whose
+        // input or record changed since this frame was last drawn are queued in stale_objects_. commands and counts
+        // hold one range per cull phase, deferred_objects_ flags what the first phase left to the second
+        Buffer cull_objects_;
+        Buffer draw_commands_;
+        Buffer draw_counts_;
+        Buffer deferred_objects_;
+        Buffer cull_view_;
+
+        // objects whose clusters are culled by the cluster pass, the commands it writes and the size of its
+        // dispatch, one range per cull phase. the cluster counts follow the object counts in draw_counts_
+        Buffer expanded_objects_;
+        Buffer cluster_commands_;
+        Buffer cluster_dispatch_;
+        VkDescriptorSet cull_set_;
+        std::vector<uint32_t> stale_objects_;
+
+        // scene frame number of the last submission of this frame, see completed_frame_
+        uint64_t serial_;
+
+        FrameSubmitData(ProgramState &state, SceneState &scene)
+            : state_{state}, scene_{scene}, command_buffer_{VK_NULL_HANDLE}, sem_image_avaliable_{VK_NULL_HANDLE},
+              sem_render_done_{VK_NULL_HANDLE}, fence_in_flight_{VK_NULL_HANDLE}, per_frame_set_{VK_NULL_HANDLE},
+              lod_view_{0.0f}, cull_set_{VK_NULL_HANDLE}, serial_{0} {}
+
+    public:
+        VkCommandBuffer command_buffer() { return command_buffer_; }
+        Buffer &per_frame_buffer() { return per_frame_buffer_; }
+
+        void update_per_frame(const cbPerFrame &data) {
+            memcpy(per_frame_buffer_.alloc_info().pMappedData, &data, sizeof(cbPerFrame));
+            view_proj_ = data.proj * data.view;
+
+            // the projection scales y by the cotangent of half the vertical field of view
+            float height = static_cast<float>(state_.swapchain().extent.height);
+            float pixels_per_unit = std::abs(data.proj[1][1]) * 0.5f * height;
+            lod_view_ = glm::fvec4{glm::fvec3{glm::inverse(data.view)[3]}, pixels_per_unit};
+
+            if (!per_frame_buffer_.flush()) {
+                LOG_ERROR("cannot flush per frame uniform buffer");
+            }
+        }
+
+        FrameSubmitData(const FrameSubmitData &) = delete;
+        FrameSubmitData &operator=(const FrameSubmitData &) = delete;
+
+        FrameSubmitData(FrameSubmitData &&f) : state_{f.state_}, scene_{f.scene_} {
+            command_buffer_ = f.command_buffer_;
+            sem_image_avaliable_ = f.sem_image_avaliable_;
+            sem_render_done_ = f.sem_render_done_;
+            fence_in_flight_ = f.fence_in_flight_;
+            per_frame_set_ = std::move(f.per_frame_set_);
+            per_frame_buffer_ = std::move(f.per_frame_buffer_);
+            view_proj_ = f.view_proj_;
+            lod_view_ = f.lod_view_;
+            recorder_pools_ = std::move(f.recorder_pools_);
+            recorder_buffers_ = std::move(f.recorder_buffers_);
+            cull_objects_ = std::move(f.cull_objects_);
+            draw_commands_ = std::move(f.draw_commands_);
+            draw_counts_ = std::move(f.draw_counts_);
+            deferred_objects_ = std::move(f.deferred_objects_);
+            cull_view_ = std::move(f.cull_view_);
+            expanded_objects_ = std::move(f.expanded_objects_);
+            cluster_commands_ = std::move(f.cluster_commands_);
+            cluster_dispatch_ = std::move(f.cluster_dispatch_);
+            cull_set_ = f.cull_set_;
+            stale_objects_ = std::move(f.stale_objects_);
+            serial_ = f.serial_;
+
+            f.command_buffer_ = VK_NULL_HANDLE;
+            f.sem_image_avaliable_ = VK_NULL_HANDLE;
+            f.sem_render_done_ = VK_NULL_HANDLE;
+            f.fence_in_flight_ = VK_NULL_HANDLE;
+            f.per_frame_set_ = VK_NULL_HANDLE;
+            f.cull_set_ = VK_NULL_HANDLE;
+        }
+
+        ~FrameSubmitData() {
+            state_.dispatch().destroySemaphore(sem_image_avaliable_, nullptr);
+            state_.dispatch().destroySemaphore(sem_render_done_, nullptr);
+            state_.dispatch().destroyFence(fence_in_flight_, nullptr);
+
+            for (auto pool : recorder_pools_) {
+                state_.dispatch().destroyCommandPool(pool, nullptr);
+            }
+        }
+
+        friend struct SceneState;
+    };
+
+private:
+    ProgramState &state_;
+    std::unique_ptr<MemoryHelper> memory_;
+    std::unique_ptr<SamplerCache> sampler_cache_;
+    std::unique_ptr<GpuProfiler> profiler_;
+    std::unique_ptr<ShaderLibrary> shaders_;
+    std::unique_ptr<PipelineManager> pipelines_;
+
+    // default variants compiled up front, drawn with until a material's own variant is ready
+    std::array<const PipelineManager::Variant *, kVertexFormats> fallback_variants_;
+    std::array<const PipelineManager::Variant *, kVertexFormats> atlas_fallback_variants_;
+
+    VkRenderPass render_pass_;
+    VkRenderPass resume_render_pass_; // loads what render_pass_ left for the second cull phase's draws
+    VkPipelineLayout pipeline_layout_;
+    VkCommandPool command_pool_;
+
+    // object uniforms
+    std::optional<MemoryHelper::DynamicUniformBuffer<cbPerObject>> object_uniforms_;
+
+    // descriptor set layouts, owned by the shader library
+    VkDescriptorPool descriptor_pool_;
+    std::array<VkDescriptorSetLayout, DescriptorSet::Count> descriptor_layout_;
+
+    VkDescriptorSet per_object_set_;
+
+    // bindless material table, used instead of per-material sets when descriptor indexing is available
+    bool bindless_;
+    VkDescriptorPool bindless_pool_;
+    VkDescriptorSet bindless_set_;
+
+    // small textures are packed into a shared array texture drawn by dedicated pipeline variants
+    std::unique_ptr<TextureAtlas> atlas_;
+    VkDescriptorSetLayout atlas_layout_;
+    VkPipelineLayout atlas_pipeline_layout_;
+    VkSampler atlas_sampler_;
+    VkDescriptorSet atlas_set_;
+
+    // swapchain images
+    std::vector<VkImage> swapchain_images_;
+    std::vector<VkImageView> swapchain_views_;
+    std::vector<VkFramebuffer> swapchain_fbs_;
+    std::vector<FrameSubmitData> frame_data_;
+
+    std::array<std::optional<SceneObject>, kMaxObjects> scene_objects_;
+    std::array<std::optional<StaticMesh>, kMaxStaticMeshes> static_meshes_;
+    std::array<std::optional<Material>, kMaxMaterials> materials_;
+
+    // world space boxes of every drawable object, indexed by object slot. objects handed out by with_object are
+    // queued and brought up to date before the next cull or query
+    Bvh object_tree_;
+    std::vector<uint32_t> changed_objects_;
+    std::vector<uint32_t> visible_objects_;
+
+    // pipeline of every material for every vertex format, taken once per frame while variants compile
+    using MaterialPipelines = std::array<std::array<VkPipeline, kVertexFormats>, kMaxMaterials>;
+
+    // gpu driven path, a compute pass culls every object slot and writes one indirect command per drawn object.
+    // objects sharing pipeline, mesh and material set form a batch drawn by a single indirect call
+    struct IndirectBatch {
+        VkPipeline pipeline;
+        VkDescriptorSet material_set; // null when the material reads a shared set
+        bool in_atlas;
+        bool blend; // transparent batches are sorted after all opaque ones
+        uint32_t mesh;
+        uint32_t first_command;
+        uint32_t num_commands;
+
+        // draws of the clusters of objects drawn with a clustered full mesh
+        uint32_t first_cluster_command;
+        uint32_t num_cluster_commands;
+    };
+
+    static constexpr uint64_t kNotBatched = UINT64_MAX;
+
+    bool indirect_draws_;
+    VkDescriptorSetLayout cull_set_layout_;
+    VkPipelineLayout cull_pipeline_layout_;
+    VkPipeline cull_pipeline_;
+    VkPipeline cluster_cull_pipeline_;
+
+    // compute shaders replaced by a reload, their pipelines are rebuilt at the next frame boundary
+    bool cull_shaders_reloaded_;
+    bool pyramid_shader_reloaded_;
+
+    // batches are only regrouped when an object changes mesh, material or drawability or when a material switches
+    // pipelines. cull_objects_ holds what the frames upload, batched_as_ the mesh and material each slot was grouped by
+    std::vector<IndirectBatch> indirect_batches_;
+    std::vector<CullObject> cull_objects_;
+    std::vector<uint64_t> batched_as_;
+    MaterialPipelines batched_pipelines_;
+    bool batches_dirty_;
+
+    // kMaxMeshLods index ranges per mesh slot written as meshes are created, and the level every object slot was
+    // last drawn with so the cull pass can hold it near a switching distance. both are shared by all frames
+    Buffer mesh_lods_;
+    Buffer object_lods_;
+
+    // meshlet bounds of every clustered mesh, handed out front to back as meshes are created. the cluster pass
+    // dispatches enough workgroups for the mesh with the most clusters
+    Buffer mesh_clusters_;
+    uint32_t num_mesh_clusters_;
+    uint32_t max_mesh_clusters_;
+
+    // meshes loaded in the background. a worker decodes the streams into a staging buffer, then every frame copies up
+    // to kStreamingBytesPerFrame of the oldest loads into their mesh buffers. the slot is reserved from the start, so
+    // objects can use the id right away, they are drawn once the frame that copied the last bytes has finished
+    static constexpr VkDeviceSize kStreamingBytesPerFrame = 8 << 20;
+
+    struct MeshLoad {
+        StaticMesh::Id id;
+        std::string name;
+
+        // written by the worker, read once decoded is done
+        JobCounter decoded;
+        bool valid;
+        MeshDesc desc;
+        std::vector<MeshLodRecord> lods;
+        std::vector<MeshletRecord> meshlets;
+        std::optional<Buffer> staging; // vertices followed by indices
+        std::optional<Buffer> vertex_buffer;
+        std::optional<Buffer> index_buffer;
+        VkDeviceSize vertex_bytes;
+        VkDeviceSize index_bytes;
+
+        // bytes of the staging buffer copied so far and the frame that copied the last of them
+        VkDeviceSize copied;
+        uint64_t copied_by;
+
+        MeshLoad() : valid{false}, desc{}, vertex_bytes{0}, index_bytes{0}, copied{0}, copied_by{0} {}
+    };
+
+    std::deque<std::unique_ptr<MeshLoad>> mesh_loads_;
+    std::array<bool, kMaxStaticMeshes> mesh_loading_;
+
+    Image depth_image_;
+    std::optional<Image::View> depth_view_;
+
+    // farthest depth pyramid of the first cull phase's draws, every level halves the one below rounding up. the
+    // second phase and the next frame's first phase test against it, pyramid_view_proj_ is the camera it was
+    // rendered with and is empty while there is no depth to test against
+    static constexpr uint32_t kMaxPyramidLevels = 16;
+
+    Image depth_pyramid_;
+    std::optional<Image::View> depth_pyramid_view_;
+    std::vector<Image::View> depth_pyramid_levels_;
+    std::optional<glm::fmat4> pyramid_view_proj_;
+    bool depth_pyramid_written_;
+
+    VkSampler depth_sampler_;
+    VkDescriptorSetLayout pyramid_set_layout_;
+    VkPipelineLayout pyramid_pipeline_layout_;
+    VkPipeline pyramid_pipeline_;
+    std::array<VkDescriptorSet, kMaxPyramidLevels> pyramid_sets_;
+
+    // currently rendered frame out of frames in flight
+    uint32_t current_frame_;
+
+    // frames are numbered as they are submitted, every frame up to completed_frame_ has finished executing
+    uint64_t next_frame_;
+    uint64_t completed_frame_;
+
+    SceneState(ProgramState &state)
+        : state_{state}, fallback_variants_{}, atlas_fallback_variants_{},
+          render_pass_{VK_NULL_HANDLE}, resume_render_pass_{VK_NULL_HANDLE}, pipeline_layout_{VK_NULL_HANDLE},
+          command_pool_{VK_NULL_HANDLE},
+          descriptor_pool_{VK_NULL_HANDLE}, per_object_set_{VK_NULL_HANDLE}, bindless_{state.descriptor_indexing()},
+          bindless_pool_{VK_NULL_HANDLE}, bindless_set_{VK_NULL_HANDLE}, atlas_layout_{VK_NULL_HANDLE},
+          atlas_pipeline_layout_{VK_NULL_HANDLE}, atlas_sampler_{VK_NULL_HANDLE}, atlas_set_{VK_NULL_HANDLE},
+          indirect_draws_{state.indirect_draws()}, cull_set_layout_{VK_NULL_HANDLE},
+          cull_pipeline_layout_{VK_NULL_HANDLE}, cull_pipeline_{VK_NULL_HANDLE},
+          cluster_cull_pipeline_{VK_NULL_HANDLE}, cull_shaders_reloaded_{false}, pyramid_shader_reloaded_{false},
+          batches_dirty_{true}, num_mesh_clusters_{0}, max_mesh_clusters_{0},
+          depth_pyramid_written_{false}, depth_sampler_{VK_NULL_HANDLE}, pyramid_set_layout_{VK_NULL_HANDLE},
+          pyramid_pipeline_layout_{VK_NULL_HANDLE}, pyramid_pipeline_{VK_NULL_HANDLE}, current_frame_{0},
+          next_frame_{0}, completed_frame_{0} {
+        descriptor_layout_.fill(VK_NULL_HANDLE);
+        pyramid_sets_.fill(VK_NULL_HANDLE);
+        mesh_loading_.fill(false);
+
+        visible_objects_.resize(kMaxObjects);
+        cull_objects_.resize(kMaxObjects);
+        batched_as_.resize(kMaxObjects, kNotBatched);
+        batched_pipelines_.fill(VK_NULL_HANDLE);
+    }
+
+    SceneState(const SceneState &) = delete;
+    SceneState &operator=(const SceneState &) = delete;
+
+    bool create_framebuffers() {
+        // create the depth image, the depth pyramid is built from it on the gpu driven path
+        VkImageUsageFlags depth_usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        if (indirect_draws_) {
+            depth_usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+        }
+
+        auto depth_image = memory_->create_image(VK_FORMAT_D32_SFLOAT, depth_usage, VK_IMAGE_TYPE_2D,
+            VkExtent3D{state_.swapchain().extent.width, state_.swapchain().extent.height, 1});
+
+        if (!depth_image) {
+            LOG_ERROR("failed to initialize depth image");
+            return false;
+        }
+
+        depth_image_ = std::move(depth_image.value());
+        depth_view_ = depth_image_.create_view(
+            state_.dispatch(), VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT);
+
+        if (!depth_view_) {
+            LOG_ERROR("failed to create depth view");
+            return false;
+        }
+
+        swapchain_images_ = state_.swapchain().get_images().value();
+        swapchain_views_ = state_.swapchain().get_image_views().value();
+
+        VkResult res;
+
+        swapchain_fbs_.resize(swapchain_views_.size());
+        for (size_t i = 0; i < swapchain_views_.size(); ++i) {
+            std::array<VkImageView, 2> attachments = {swapchain_views_[i], depth_view_->view()};
+
+            VkFramebufferCreateInfo framebuffer_info = {};
+            framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebuffer_info.renderPass = render_pass_;
+            framebuffer_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+            framebuffer_info.pAttachments = attachments.data();
+            framebuffer_info.width = state_.swapchain().extent.width;
+            framebuffer_info.height = state_.swapchain().extent.height;
+            framebuffer_info.layers = 1;
+
+            res = state_.dispatch().createFramebuffer(&framebuffer_info, nullptr, &swapchain_fbs_[i]);
+
+            if (VK_SUCCESS != res) {
+                LOG_ERROR("failed to create swapchain fb: %s", string_VkResult(res));
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // sized after the depth buffer, so it is recreated with the swapchain. the descriptor sets reading it are
+    // rewritten in place
+    bool create_depth_pyramid() {
+        uint32_t width = (state_.swapchain().extent.width + 1) / 2;
+        uint32_t height = (state_.swapchain().extent.height + 1) / 2;
+
+        uint32_t num_levels = 1;
+        for (uint32_t w = width, h = height; (w > 1 || h > 1) && num_levels < kMaxPyramidLevels; ++num_levels) {
+            w = (w + 1) / 2;
+            h = (h + 1) / 2;
+        }
+
+        depth_pyramid_levels_.clear();
+        depth_pyramid_view_.reset();
+
+        auto image = memory_->create_image(VK_FORMAT_R32_SFLOAT,
+            VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_IMAGE_TYPE_2D, VkExtent3D{width, height, 1},
+            num_levels);
+
+        if (!image) {
+            LOG_ERROR("failed to create depth pyramid");
+            return false;
+        }
+
+        depth_pyramid_ = std::move(image.value());
+        depth_pyramid_view_ = depth_pyramid_.create_view(state_.dispatch(), VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R32_SFLOAT,
+            VK_IMAGE_ASPECT_COLOR_BIT, 1, 0, num_levels);
+
+        if (!depth_pyramid_view_) {
+            LOG_ERROR("failed to create depth pyramid view");
+            return false;
+        }
+
+        for (uint32_t level = 0; level < num_levels; ++level) {
+            auto view = depth_pyramid_.create_view(
+                state_.dispatch(), VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 1, level);
+
+            if (!view) {
+                LOG_ERROR("failed to create view of depth pyramid level %u", level);
+                return false;
+            }
+
+            depth_pyramid_levels_.push_back(std::move(*view));
+        }
+
+        // each level reads the one below it, the first one reads the depth buffer
+        std::vector<VkDescriptorImageInfo> image_descs;
+        std::vector<VkWriteDescriptorSet> write_sets;
+        image_descs.reserve(num_levels * 2 + frame_data_.size());
+
+        auto write_image = [&](VkDescriptorSet set, uint32_t binding, VkDescriptorType type, VkImageView view,
+                               VkImageLayout layout) {
+            image_descs.push_back(VkDescriptorImageInfo{depth_sampler_, view, layout});
+
+            VkWriteDescriptorSet write_set = {};
+            write_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_set.dstBinding = binding;
+            write_set.dstSet = set;
+            write_set.descriptorCount = 1;
+            write_set.descriptorType = type;
+            write_set.pImageInfo = &image_descs.back();
+            write_sets.push_back(write_set);
+        };
+
+        for (uint32_t level = 0; level < num_levels; ++level) {
+            if (level == 0) {
+                write_image(pyramid_sets_[level], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, depth_view_->view(),
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            } else {
+                write_image(pyramid_sets_[level], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    depth_pyramid_levels_[level - 1].view(), VK_IMAGE_LAYOUT_GENERAL);
+            }
+
+            write_image(pyramid_sets_[level], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, depth_pyramid_levels_[level].view(),
+                VK_IMAGE_LAYOUT_GENERAL);
+        }
+
+        for (auto &frame : frame_data_) {
+            write_image(frame.cull_set_, 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, depth_pyramid_view_->view(),
+                VK_IMAGE_LAYOUT_GENERAL);
+        }
+
+        state_.dispatch().updateDescriptorSets(static_cast<uint32_t>(write_sets.size()), write_sets.data(), 0, nullptr);
+
+        // the new pyramid holds nothing yet
+        pyramid_view_proj_.reset();
+        depth_pyramid_written_ = false;
+
+        return true;
+    }
+
+    bool create_atlas() {
+        auto atlas = TextureAtlas::initialize(state_, *memory_);
+        if (!atlas) {
+            LOG_ERROR("failed to create texture atlas");
+            return false;
+        }
+
+        // filtering is shared by every atlas material, wrapping is emulated in the shader
+        VkSamplerCreateInfo sampler_desc = {};
+        sampler_desc.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        sampler_desc.magFilter = VK_FILTER_LINEAR;
+        sampler_desc.minFilter = VK_FILTER_LINEAR;
+        sampler_desc.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_desc.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_desc.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+        VkSampler sampler = sampler_cache_->acquire(sampler_desc);
+        if (sampler == VK_NULL_HANDLE) {
+            LOG_ERROR("failed to acquire atlas sampler");
+            return false;
+        }
+
+        VkDescriptorSetAllocateInfo set_alloc_info = {};
+        set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        set_alloc_info.descriptorPool = descriptor_pool_;
+        set_alloc_info.descriptorSetCount = 1;
+        set_alloc_info.pSetLayouts = &atlas_layout_;
+
+        VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+        VkResult res = state_.dispatch().allocateDescriptorSets(&set_alloc_info, &descriptor_set);
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to allocate atlas descriptor set: %s", string_VkResult(res));
+            sampler_cache_->release(sampler);
+            return false;
+        }
+
+        VkDescriptorImageInfo descriptor_image_info = {};
+        descriptor_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        descriptor_image_info.imageView = atlas->view();
+        descriptor_image_info.sampler = sampler;
+
+        VkWriteDescriptorSet atlas_write_set = {};
+        atlas_write_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        atlas_write_set.dstBinding = 0;
+        atlas_write_set.dstSet = descriptor_set;
+        atlas_write_set.descriptorCount = 1;
+        atlas_write_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        atlas_write_set.pImageInfo = &descriptor_image_info;
+
+        state_.dispatch().updateDescriptorSets(1, &atlas_write_set, 0, nullptr);
+
+        atlas_ = std::move(atlas);
+        atlas_sampler_ = sampler;
+        atlas_set_ = descriptor_set;
+
+        LOG_INFO("created texture atlas");
+        return true;
+    }
+
+    // the variant depends on where the material's texture lives, on its render state, on its shader features and on
+    // the vertex format of the mesh it is drawn on
+    PipelineManager::Desc material_pipeline_desc(bool in_atlas, const RenderState &render_state,
+        const ShaderFeatures &features, VertexFormat vertex_format) const {
+        PipelineManager::Desc desc = {};
+        desc.vertex_shader = "vertex.spv";
+        desc.vertex_format = vertex_format;
+        desc.render_state = render_state;
+        desc.features = features;
+        desc.features.object_stride = static_cast<uint32_t>(object_uniforms_->aligned_size() / 16);
+        desc.features.compact_vertices = vertex_format == VertexFormat::Compact ? VK_TRUE : VK_FALSE;
+        desc.render_pass = render_pass_;
+        desc.subpass = 0;
+
+        // indirect draws only tell the vertex shader which object it draws through the instance index
+        if (indirect_draws_) {
+            desc.features.instanced = VK_TRUE;
+        }
+
+        if (in_atlas) {
+            // samples a layer of the texture atlas through the per-object uv rect
+            desc.fragment_shader = "fragment_atlas.spv";
+            desc.layout = atlas_pipeline_layout_;
+        } else if (bindless_) {
+            // samples the bindless material table instead of a per-material texture
+            desc.fragment_shader = "fragment_bindless.spv";
+            desc.layout = pipeline_layout_;
+        } else {
+            desc.fragment_shader = "fragment.spv";
+            desc.layout = pipeline_layout_;
+        }
+
+        return desc;
+    }
+
+    // queues the compiles of a material's variants, the material is drawn with the fallbacks until they are ready
+    bool assign_material_pipeline(Material &material, const RenderState &render_state, const ShaderFeatures &features) {
+        bool in_atlas = material.atlas_region().has_value();
+
+        std::array<const PipelineManager::Variant *, kVertexFormats> variants;
+        for (size_t format = 0; format < kVertexFormats; ++format) {
+            variants[format] = pipelines_->request(
+                material_pipeline_desc(in_atlas, render_state, features, static_cast<VertexFormat>(format)));
+            if (!variants[format]) {
+                return false;
+            }
+        }
+
+        material.render_state_ = render_state;
+        material.features_ = features;
+        material.variants_ = variants;
+        material.fallbacks_ = in_atlas ? atlas_fallback_variants_ : fallback_variants_;
+        return true;
+    }
+
+    bool create_atlas_material(const Material::Id &id, const Bitmap &bitmap, VkSamplerAddressMode address_mode,
+        const RenderState &render_state) {
+        if (!atlas_ && !create_atlas()) {
+            return false;
+        }
+
+        auto region = atlas_->insert(bitmap, address_mode);
+        if (!region) {
+            return false;
+        }
+
+        // atlas materials own no image or sampler, they all share the atlas descriptor set
+        Material material(*sampler_cache_, id, Image{}, Image::View{}, VK_NULL_HANDLE, atlas_set_);
+        material.atlas_region_ = region;
+        if (!assign_material_pipeline(material, render_state, ShaderFeatures::standard())) {
+            return false;
+        }
+
+        materials_[id.id_].emplace(std::move(material));
+
+        return true;
+    }
+
+public:
+    ~SceneState() {
+        // workers of unfinished loads create buffers through the memory helper
+        for (auto &load : mesh_loads_) {
+            state_.jobs().wait(load->decoded);
+        }
+
+        VkResult res = state_.dispatch().deviceWaitIdle();
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to wait device idle: %s", string_VkResult(res));
+        }
+
+        LOG_INFO("destroying the scene state");
+
+        memory_.reset(); // manually release to prevent validation errors
+
+        for (auto &fb : swapchain_fbs_) {
+            state_.dispatch().destroyFramebuffer(fb, nullptr);
+        }
+
+        state_.swapchain().destroy_image_views(swapchain_views_);
+
+        if (atlas_sampler_ != VK_NULL_HANDLE) {
+            sampler_cache_->release(atlas_sampler_);
+        }
+
+        if (depth_sampler_ != VK_NULL_HANDLE) {
+            sampler_cache_->release(depth_sampler_);
+        }
+
+        state_.dispatch().destroyPipeline(cull_pipeline_, nullptr);
+        state_.dispatch().destroyPipeline(cluster_cull_pipeline_, nullptr);
+        state_.dispatch().destroyPipeline(pyramid_pipeline_, nullptr);
+        state_.dispatch().destroyDescriptorPool(descriptor_pool_, nullptr);
+        state_.dispatch().destroyDescriptorPool(bindless_pool_, nullptr);
+        state_.dispatch().destroyCommandPool(command_pool_, nullptr);
+        state_.dispatch().destroyRenderPass(render_pass_, nullptr);
+        state_.dispatch().destroyRenderPass(resume_render_pass_, nullptr);
+        pipelines_.reset();
+        shaders_.reset();
+    }
+
+    MemoryHelper &memory() { return *memory_; }
+    SamplerCache &sampler_cache() { return *sampler_cache_; }
+    PipelineManager &pipelines() { return *pipelines_; }
+    GpuProfiler *profiler() { return profiler_.get(); } // null without timestamp support
+    ShaderLibrary &shaders() { return *shaders_; }
+
+    // the cull and depth pyramid pipelines live outside the pipeline manager. returns how many of them use the
+    // reloaded shader, they are rebuilt at the next frame boundary
+    size_t rebuild_compute_pipelines(const std::string &asset) {
+        if (!indirect_draws_) {
+            return 0;
+        }
+
+        if (asset == "cull.spv" || asset == "cluster_cull.spv") {
+            cull_shaders_reloaded_ = true;
+            return 2;
+        }
+
+        if (asset == "depth_pyramid.spv") {
+            pyramid_shader_reloaded_ = true;
+            return 1;
+        }
+
+        return 0;
+    }
+
+    bool bindless() const { return bindless_; }
+    MemoryHelper::DynamicUniformBuffer<cbPerObject> &object_uniforms() { return *object_uniforms_; }
+
+    template <typename F> void with_object(const SceneObject::Id &id, F f) const {
+        if (id.valid()) {
+            f(scene_objects_[id.id_]);
+        }
+    }
+
+    template <typename F> void with_object(const SceneObject::Id &id, F f) {
+        if (id.valid()) {
+            f(*scene_objects_[id.id_]);
+            changed_objects_.push_back(id.id_);
+        }
+    }
+
+    // meshes that are still loading are skipped
+    template <typename F> void with_static_mesh(const StaticMesh::Id &id, F f) {
+        if (id.valid() && static_meshes_[id.id_]) {
+            f(*static_meshes_[id.id_]);
+        }
+    }
+
+    template <typename F> void with_material(const Material::Id &id, F f) {
+        if (id.valid()) {
+            f(*materials_[id.id_]);
+        }
+    }
+
+    SceneObject::Id create_scene_object() {
+        auto iter = std::find_if(scene_objects_.begin(), scene_objects_.end(), [&](const auto &slot) { return !slot; });
+        if (iter == scene_objects_.end()) {
+            LOG_ERROR("too many objects allocated, the limit is %lld", kMaxStaticMeshes);
+            return {};
+        }
+
+        auto id = SceneObject::Id{static_cast<uint32_t>(std::distance(scene_objects_.begin(), iter))};
+        iter->emplace(SceneObject(id));
+
+        return id;
+    }
+
+    // nearest drawable object whose bounding box the ray hits, invalid if there is none
+    SceneObject::Id pick(const glm::fvec3 &origin, const glm::fvec3 &direction, float max_distance) {
+        update_object_tree();
+
+        uint32_t slot;
+        float distance;
+        if (!object_tree_.raycast(&origin[0], &direction[0], max_distance, slot, distance)) {
+            return {};
+        }
+
+        return SceneObject::Id{slot};
+    }
+
+    // drawable objects whose bounding boxes overlap the given box
+    std::vector<SceneObject::Id> objects_in(const glm::fvec3 &min, const glm::fvec3 &max) {
+        update_object_tree();
+
+        std::vector<SceneObject::Id> objects;
+        object_tree_.query(Aabb{{min.x, min.y, min.z}, {max.x, max.y, max.z}},
+            [&](uint32_t slot) { objects.push_back(SceneObject::Id{slot}); });
+        return objects;
+    }
+
+    // builds the streams of a mesh made in code, see MeshBuilder
+    StaticMesh::Id create_static_mesh(const Geometry &geometry) {
+        auto mesh = MeshBuilder::build(geometry, kMaxMeshLods, /* split meshlets */ indirect_draws_);
+
+        LOG_INFO("optimized mesh, acmr %.3f -> %.3f, atvr %.3f -> %.3f, %u of %zu vertices used",
+            mesh.cache_before.acmr, mesh.cache_after.acmr, mesh.cache_before.atvr, mesh.cache_after.atvr,
+            mesh.desc.vertex_count, mesh.source_vertex_count);
+
+        return create_static_mesh(mesh.streams());
+    }
+
+    // streams of mesh files point into the mapping and go from there straight into the staging buffer
+    StaticMesh::Id create_static_mesh(const MeshStreams &streams) {
+        // find empty slot for this mesh
+        auto slot = free_mesh_slot();
+        if (!slot) {
+            LOG_ERROR("too many meshes allocated, the limit is %lld", kMaxStaticMeshes);
+            return {};
+        }
+
+        const auto &desc = streams.desc;
+        if (desc.vertex_count == 0 || desc.lod_count == 0) {
+            LOG_ERROR("mesh has no vertices or no levels of detail");
+            return {};
+        }
+
+        // create geometry and upload to a VRAM buffer
+        auto vertex_buffer = memory_->create_buffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, streams.vertices,
+            streams.vertex_bytes(), /* use staging buffer */ true);
+
+        if (!vertex_buffer) {
+            LOG_ERROR("failed to create a vertex buffer");
+            return {};
+        }
+
+        if (vertex_buffer->mem_prop_flags() & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            LOG_INFO("vertex buffer is host-mappable");
+        } else {
+            LOG_INFO("vertex buffer is device-local");
+        }
+
+        LOG_INFO("vertex buffer upload complete");
+
+        auto index_buffer = memory_->create_buffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, streams.indices,
+            streams.index_bytes(), /* use staging buffer */ true);
+
+        if (!index_buffer) {
+            LOG_ERROR("failed to create an index buffer");
+            return {};
+        }
+
+        if (index_buffer->mem_prop_flags() & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            LOG_INFO("index buffer is host-mappable");
+        } else {
+            LOG_INFO("index buffer is device-local");
+        }
+
+        LOG_INFO("index buffer upload complete");
+
+        auto id = StaticMesh::Id{*slot};
+        emplace_static_mesh(id, std::move(*vertex_buffer), std::move(*index_buffer), desc, streams.lods,
+            streams.meshlets);
+
+        return id;
+    }
+
+    // returns at once and maps the mesh file on a worker, see MeshLoad
+    StaticMesh::Id load_static_mesh(const std::string &path) {
+        return queue_mesh_load(path, [this, path](MeshLoad &load) {
+            std::string error;
+            auto file = MeshFile::open(path, error);
+            if (!file) {
+                LOG_ERROR("failed to open mesh file %s: %s", path.c_str(), error.c_str());
+                return;
+            }
+
+            stage_mesh_load(load, file->streams());
+        });
+    }
+
+    // returns at once and builds the streams on a worker, see MeshLoad
+    StaticMesh::Id load_static_mesh(Geometry &&geometry) {
+        auto shared = std::make_shared<Geometry>(std::move(geometry));
+        return queue_mesh_load("geometry", [this, shared](MeshLoad &load) {
+            auto mesh = MeshBuilder::build(*shared, kMaxMeshLods, /* split meshlets */ indirect_draws_);
+            stage_mesh_load(load, mesh.streams());
+        });
+    }
+
+    // loading meshes hold an id but cannot be drawn yet
+    bool resident(const StaticMesh::Id &id) const { return id.valid() && static_meshes_[id.id_].has_value(); }
+
+    size_t pending_mesh_loads() const { return mesh_loads_.size(); }
+
+    // slots of meshes that are still loading are taken as well
+    std::optional<uint32_t> free_mesh_slot() const {
+        for (uint32_t slot = 0; slot < kMaxStaticMeshes; ++slot) {
+            if (!static_meshes_[slot] && !mesh_loading_[slot]) {
+                return slot;
+            }
+        }
+
+        return {};
+    }
+
+    template <typename F> StaticMesh::Id queue_mesh_load(const std::string &name, F decode) {
+        auto slot = free_mesh_slot();
+        if (!slot) {
+            LOG_ERROR("too many meshes allocated, the limit is %lld", kMaxStaticMeshes);
+            return {};
+        }
+
+        auto load = std::make_unique<MeshLoad>();
+        load->id = StaticMesh::Id{*slot};
+        load->name = name;
+
+        auto *queued = load.get();
+        state_.jobs().submit(queued->decoded, [queued, decode]() { decode(*queued); });
+
+        mesh_loading_[*slot] = true;
+        mesh_loads_.push_back(std::move(load));
+        return queued->id;
+    }
+
+    // runs on the worker, everything the frames need is copied out of the streams so the source can go away
+    void stage_mesh_load(MeshLoad &load, const MeshStreams &streams) {
+        const auto &desc = streams.desc;
+        if (desc.vertex_count == 0 || desc.lod_count == 0) {
+            LOG_ERROR("mesh %s has no vertices or no levels of detail", load.name.c_str());
+            return;
+        }
+
+        load.vertex_bytes = streams.vertex_bytes();
+        load.index_bytes = streams.index_bytes();
+        load.staging = memory_->create_staging_buffer(load.vertex_bytes + load.index_bytes);
+        load.vertex_buffer = memory_->create_device_buffer(
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, load.vertex_bytes);
+        load.index_buffer = memory_->create_device_buffer(
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, load.index_bytes);
+
+        if (!load.staging || !load.vertex_buffer || !load.index_buffer) {
+            LOG_ERROR("failed to allocate the buffers of mesh %s", load.name.c_str());
+            return;
+        }
+
+        void *mapped_mem;
+        VkResult res = vmaMapMemory(state_.allocator(), load.staging->allocation(), &mapped_mem);
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("cannot map staging buffer: %s", string_VkResult(res));
+            return;
+        }
+
+        memcpy(mapped_mem, streams.vertices, load.vertex_bytes);
+        memcpy(static_cast<uint8_t *>(mapped_mem) + load.vertex_bytes, streams.indices, load.index_bytes);
+        bool flushed = load.staging->flush();
+        vmaUnmapMemory(state_.allocator(), load.staging->allocation());
+
+        if (!flushed) {
+            LOG_ERROR("cannot flush staging buffer write");
+            return;
+        }
+
+        load.desc = desc;
+        load.lods.assign(streams.lods, streams.lods + desc.lod_count);
+        load.meshlets.assign(streams.meshlets, streams.meshlets + desc.meshlet_count);
+        load.valid = true;
+    }
+
+    // finishes the loads whose last copy has executed and records this frame's share of the copies, oldest load
+    // first
+    void stream_meshes(FrameSubmitData &frame) {
+        VkCommandBuffer command_buffer = frame.command_buffer_;
+        VkDeviceSize budget = kStreamingBytesPerFrame;
+        bool copied = false;
+
+        for (auto iter = mesh_loads_.begin(); iter != mesh_loads_.end();) {
+            auto &load = **iter;
+            if (!load.decoded.done()) {
+                ++iter;
+                continue;
+            }
+
+            if (!load.valid) {
+                LOG_ERROR("failed to load mesh %s, its slot is given back", load.name.c_str());
+                mesh_loading_[load.id.id_] = false;
+                iter = mesh_loads_.erase(iter);
+                continue;
+            }
+
+            VkDeviceSize total = load.vertex_bytes + load.index_bytes;
+            if (load.copied == total) {
+                if (load.copied_by <= completed_frame_) {
+                    finish_mesh_load(load);
+                    iter = mesh_loads_.erase(iter);
+                } else {
+                    ++iter;
+                }
+
+                continue;
+            }
+
+            if (budget == 0) {
+                ++iter;
+                continue;
+            }
+
+            // the range may straddle the end of the vertices
+            VkDeviceSize begin = load.copied, end = load.copied + std::min(budget, total - load.copied);
+            if (begin < load.vertex_bytes) {
+                VkBufferCopy region{begin, begin, std::min(end, load.vertex_bytes) - begin};
+                state_.dispatch().cmdCopyBuffer(
+                    command_buffer, load.staging->buffer(), load.vertex_buffer->buffer(), 1, &region);
+            }
+
+            if (end > load.vertex_bytes) {
+                VkDeviceSize first = std::max(begin, load.vertex_bytes);
+                VkBufferCopy region{first, first - load.vertex_bytes, end - first};
+                state_.dispatch().cmdCopyBuffer(
+                    command_buffer, load.staging->buffer(), load.index_buffer->buffer(), 1, &region);
+            }
+
+            budget -= end - begin;
+            load.copied = end;
+            load.copied_by = frame.serial_;
+            copied = true;
+            ++iter;
+        }
+
+        // the frames drawing the meshes are submitted after this one
+        if (copied) {
+            VkMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+
+            state_.dispatch().cmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+    }
+
+    // the mesh takes its reserved slot and the objects using it become drawable
+    void finish_mesh_load(MeshLoad &load) {
+        mesh_loading_[load.id.id_] = false;
+        emplace_static_mesh(load.id, std::move(*load.vertex_buffer), std::move(*load.index_buffer), load.desc,
+            load.lods.data(), load.meshlets.data());
+
+        for (uint32_t slot = 0; slot < kMaxObjects; ++slot) {
+            if (scene_objects_[slot] && scene_objects_[slot]->mesh_id_ == load.id) {
+                changed_objects_.push_back(slot);
+            }
+        }
+
+        LOG_INFO("mesh %s is resident", load.name.c_str());
+    }
+
+    // fills the slot with a mesh whose buffers hold the streams described by desc
+    void emplace_static_mesh(StaticMesh::Id id, Buffer &&vertex_buffer, Buffer &&index_buffer, const MeshDesc &desc,
+        const MeshLodRecord *lod_records, const MeshletRecord *meshlets) {
+        bool compact = desc.vertex_format == VertexFormat::Compact;
+        size_t vertex_bytes = size_t{desc.vertex_count} * vertex_stride(desc.vertex_format);
+        LOG_INFO("mesh uses %s vertices and %s indices, %zu bytes instead of %zu", compact ? "compact" : "full",
+            desc.index_size == 2 ? "16 bit" : "32 bit", vertex_bytes + size_t{desc.index_count} * desc.index_size,
+            sizeof(Vertex) * desc.vertex_count + sizeof(uint32_t) * desc.index_count);
+
+        glm::fvec3 center{desc.center[0], desc.center[1], desc.center[2]};
+        glm::fvec3 extents{desc.extents[0], desc.extents[1], desc.extents[2]};
+        Bounds bounds{center, extents, desc.radius};
+
+        StaticMesh::Encoding encoding = {};
+        encoding.vertex_format = desc.vertex_format;
+        encoding.index_type = desc.index_size == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        encoding.dequantize = glm::fmat4{1.0f};
+        if (compact) {
+            encoding.dequantize =
+                glm::scale(glm::translate(glm::fmat4{1.0f}, center), CompactVertex::scale_of(extents));
+        }
+
+        // levels past the table are never selected
+        std::vector<StaticMesh::Lod> lods;
+        for (uint32_t i = 0; i < desc.lod_count && i < kMaxMeshLods; ++i) {
+            const auto &lod = lod_records[i];
+            lods.push_back(StaticMesh::Lod{lod.first_index, lod.index_count, lod.error});
+        }
+
+        // no object uses the slot yet, so the cull pass does not read these entries
+        if (indirect_draws_) {
+            auto *table = static_cast<MeshLod *>(mesh_lods_.alloc_info().pMappedData) + id.id_ * kMaxMeshLods;
+            for (size_t i = 0; i < kMaxMeshLods; ++i) {
+                table[i] = i < lods.size() ? MeshLod{lods[i].first_index, lods[i].num_indices, lods[i].error, 0}
+                                           : MeshLod{0, 0, 0.0f, 0};
+            }
+
+            mesh_lods_.flush();
+        }
+
+        LOG_INFO("mesh has %zu levels of detail, the coarsest draws %u of %u indices", lods.size(),
+            lods.back().num_indices, lods[0].num_indices);
+
+        auto clusters = indirect_draws_ ? write_clusters(meshlets, desc.meshlet_count) : StaticMesh::Clusters{0, 0};
+        uint32_t num_indices = lods[0].num_indices;
+
+        static_meshes_[id.id_].emplace(std::move(StaticMesh(id, std::move(vertex_buffer), std::move(index_buffer),
+            desc.vertex_count, num_indices, bounds, std::move(lods), encoding, clusters)));
+    }
+
+    // appends the bounds of the full mesh's meshlets to the cluster table. the meshlets are runs of the level's
+    // cache ordered triangles, so each one draws a range of the index buffer. meshes with too few meshlets to gain
+    // from culling them, or too many for the table, are drawn whole
+    StaticMesh::Clusters write_clusters(const MeshletRecord *meshlets, uint32_t count) {
+        if (count < kMinMeshClusters || num_mesh_clusters_ + count > kMaxMeshClusters) {
+            LOG_INFO("mesh has %u meshlets and is drawn whole", count);
+            return StaticMesh::Clusters{0, 0};
+        }
+
+        // no object uses the new entries yet, so the cull pass does not read them
+        auto *table = static_cast<MeshCluster *>(mesh_clusters_.alloc_info().pMappedData) + num_mesh_clusters_;
+        for (uint32_t i = 0; i < count; ++i) {
+            const auto &meshlet = meshlets[i];
+            table[i] = MeshCluster{
+                glm::fvec4{meshlet.center[0], meshlet.center[1], meshlet.center[2], meshlet.radius},
+                glm::fvec4{meshlet.cone_axis[0], meshlet.cone_axis[1], meshlet.cone_axis[2], meshlet.cone_cutoff},
+                meshlet.first_index, meshlet.index_count, {0, 0}};
+        }
+
+        mesh_clusters_.flush();
+
+        StaticMesh::Clusters clusters{num_mesh_clusters_, count};
+        num_mesh_clusters_ += clusters.count;
+        max_mesh_clusters_ = std::max(max_mesh_clusters_, clusters.count);
+
+        LOG_INFO("split mesh into %u clusters", clusters.count);
+        return clusters;
+    }
+
+    // level an object is drawn with from where the camera is, the full mesh when the camera is inside its bounds
+    uint32_t object_lod(const SceneObject &object, const glm::fvec4 &lod_view) const {
+        if (lod_view.w <= 0.0f) {
+            return 0;
+        }
+
+        const auto &mesh = *static_meshes_[object.mesh_id_.id_];
+        auto bounds = mesh.bounds().transformed(object.transform_);
+        float distance = std::max(glm::length(bounds.center - glm::fvec3{lod_view}) - bounds.radius, 1e-4f);
+        return select_lod(mesh, lod_view.w * Bounds::max_scale(object.transform_) / distance, object.lod_);
+    }
+
+    // coarsest level of the mesh whose error stays under the pixel limit at the given scale, see kLodHysteresis
+    static uint32_t select_lod(const StaticMesh &mesh, float pixels_per_unit, uint32_t current) {
+        const auto &lods = mesh.lods();
+
+        uint32_t lod = 0;
+        for (uint32_t i = 1; i < lods.size(); ++i) {
+            float limit = kLodPixelError * (i > current ? kLodHysteresis : 1.0f);
+            if (lods[i].error * pixels_per_unit > limit) {
+                break;
+            }
+
+            lod = i;
+        }
+
+        return lod;
+    }
+
+    Material::Id create_material(const Bitmap &albedo_bitmap, VkFilter filter, VkSamplerAddressMode address_mode,
+        const RenderState &render_state = RenderState::opaque()) {
+        auto iter = std::find_if(materials_.begin(), materials_.end(), [&](const auto &slot) { return !slot; });
+        if (iter == materials_.end()) {
+            LOG_ERROR("too many materials allocated, the limit is %lld", kMaxStaticMeshes);
+            return {};
+        }
+
+        // small linearly filtered textures are packed into the atlas instead of getting their own image
+        if (filter == VK_FILTER_LINEAR && TextureAtlas::fits(albedo_bitmap)) {
+            auto id = Material::Id{static_cast<uint32_t>(std::distance(materials_.begin(), iter))};
+            if (create_atlas_material(id, albedo_bitmap, address_mode, render_state)) {
+                return id;
+            }
+
+            LOG_INFO("texture atlas is full, falling back to a dedicated image");
+        }
+
+        auto image = memory_->create_image_rgba(
+            VK_IMAGE_USAGE_SAMPLED_BIT, albedo_bitmap.width(), albedo_bitmap.height(), albedo_bitmap.raw_pixels());
+
+        if (!image) {
+            LOG_ERROR("failed to uplaod image to the gpu memory");
+            return {};
+        }
+
+        auto image_view = image->create_view(
+            state_.dispatch(), VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        if (!image_view) {
+            LOG_ERROR("failed to create image view from uploaded image");
+            return {};
+        }
+
+        // create sampler
+        VkSamplerCreateInfo sampler_desc = {};
+        sampler_desc.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        sampler_desc.magFilter = filter;
+        sampler_desc.minFilter = filter;
+        sampler_desc.addressModeU = address_mode;
+        sampler_desc.addressModeV = address_mode;
+        sampler_desc.addressModeW = address_mode;
+
+        VkResult res;
+        VkSampler sampler = sampler_cache_->acquire(sampler_desc);
+        if (sampler == VK_NULL_HANDLE) {
+            LOG_ERROR("failed to acquire sampler");
+            return {};
+        }
+
+        auto id = Material::Id{static_cast<uint32_t>(std::distance(materials_.begin(), iter))};
+        VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+
+        VkDescriptorImageInfo descriptor_image_info = {};
+        descriptor_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        descriptor_image_info.imageView = image_view->view();
+        descriptor_image_info.sampler = sampler;
+
+        VkWriteDescriptorSet per_material_write_set = {};
+        per_material_write_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        per_material_write_set.dstBinding = 0;
+        per_material_write_set.descriptorCount = 1;
+        per_material_write_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        per_material_write_set.pImageInfo = &descriptor_image_info;
+
+        if (bindless_) {
+            // the material index is the slot in the bindless table, the set is update-after-bind so this is safe
+            // even while previous frames are still in flight
+            per_material_write_set.dstSet = bindless_set_;
+            per_material_write_set.dstArrayElement = id.id_;
+        } else {
+            // create per material descriptor set
+            VkDescriptorSetAllocateInfo set_alloc_info = {};
+            set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            set_alloc_info.descriptorPool = descriptor_pool_;
+            set_alloc_info.descriptorSetCount = 1;
+            set_alloc_info.pSetLayouts = &descriptor_layout_[DescriptorSet::PerMaterial];
+
+            res = state_.dispatch().allocateDescriptorSets(&set_alloc_info, &descriptor_set);
+            if (VK_SUCCESS != res) {
+                LOG_ERROR("failed to allocate per material descriptor set: %s", string_VkResult(res));
+                sampler_cache_->release(sampler);
+                return {};
+            }
+
+            per_material_write_set.dstSet = descriptor_set;
+        }
+
+        state_.dispatch().updateDescriptorSets(1, &per_material_write_set, 0, nullptr);
+
+        iter->emplace(
+            Material(*sampler_cache_, id, std::move(*image), std::move(*image_view), sampler, descriptor_set));
+
+        if (!assign_material_pipeline(**iter, render_state, ShaderFeatures::standard())) {
+            LOG_ERROR("failed to request pipeline variant for material");
+            iter->reset();
+            return {};
+        }
+
+        return id;
+    }
+
+    // switches a material to another pipeline variant, e.g. to make it double sided or transparent
+    bool set_material_render_state(const Material::Id &id, const RenderState &render_state) {
+        if (!id.valid() || !materials_[id.id_]) {
+            return false;
+        }
+
+        auto &material = *materials_[id.id_];
+        return assign_material_pipeline(material, render_state, material.features_);
+    }
+
+    // switches a material to a variant with other shader features, e.g. alpha tested foliage
+    bool set_material_features(const Material::Id &id, const ShaderFeatures &features) {
+        if (!id.valid() || !materials_[id.id_]) {
+            return false;
+        }
+
+        auto &material = *materials_[id.id_];
+        return assign_material_pipeline(material, material.render_state_, features);
+    }
+
+    bool rebuild_swapchain() {
+        LOG_INFO("rebuilding swapchain");
+
+        if (!swapchain_fbs_.empty()) {
+            state_.dispatch().deviceWaitIdle();
+
+            for (auto &fb : swapchain_fbs_) {
+                state_.dispatch().destroyFramebuffer(fb, nullptr);
+            }
+
+            state_.swapchain().destroy_image_views(swapchain_views_);
+            swapchain_images_.clear();
+            swapchain_views_.clear();
+            swapchain_fbs_.clear();
+        }
+
+        if (!state_.init_swapchain()) {
+            LOG_ERROR("failed to initialize swapchain");
+            return false;
+        }
+
+        if (!create_framebuffers()) {
+            LOG_ERROR("failed to create swapchain framebuffers");
+            return false;
+        }
+
+        if (indirect_draws_ && !create_depth_pyramid()) {
+            LOG_ERROR("failed to recreate depth pyramid");
+            return false;
+        }
+
+        return true;
+    }
+
+    // begins one of the frame's secondary command buffers inside the scene render pass. secondary buffers inherit no
+    // state, so the shared sets and the dynamic state are set here
+    VkCommandBuffer begin_recorder(FrameSubmitData &frame, size_t recorder, VkFramebuffer framebuffer) {
+        VkCommandBuffer command_buffer = frame.recorder_buffers_[recorder];
+
+        VkCommandBufferInheritanceInfo inheritance_desc = {};
+        inheritance_desc.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritance_desc.renderPass = render_pass_;
+        inheritance_desc.subpass = 0;
+        inheritance_desc.framebuffer = framebuffer;
+        inheritance_desc.pipelineStatistics = profiler_ ? profiler_->inherited_statistics() : 0;
+
+        VkCommandBufferBeginInfo cmd_begin_desc = {};
+        cmd_begin_desc.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        cmd_begin_desc.flags =
+            VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        cmd_begin_desc.pInheritanceInfo = &inheritance_desc;
+
+        VkResult res = state_.dispatch().beginCommandBuffer(command_buffer, &cmd_begin_desc);
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to begin recorder command buffer: %s", string_VkResult(res));
+            return VK_NULL_HANDLE;
+        }
+
+        state_.dispatch().cmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_,
+            DescriptorSet::PerFrame, 1, &frame.per_frame_set_, 0, nullptr);
+
+        // with the bindless table all materials are reachable through a single set
+        if (bindless_) {
+            state_.dispatch().cmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_,
+                DescriptorSet::PerMaterial, 1, &bindless_set_, 0, nullptr);
+        }
+
+        // dynamic state
+        VkViewport vp = {};
+        vp.width = state_.swapchain().extent.width;
+        vp.height = state_.swapchain().extent.height;
+        vp.x = 0;
+        vp.y = 0;
+        vp.minDepth = 0.0f;
+        vp.maxDepth = 1.0f;
+
+        VkRect2D scissor{{0, 0}, state_.swapchain().extent};
+
+        state_.dispatch().cmdSetViewport(command_buffer, 0, 1, &vp);
+        state_.dispatch().cmdSetScissor(command_buffer, 0, 1, &scissor);
+
+        return command_buffer;
+    }
+
+    // pipeline drawing an object, its material's variant for the vertex format of its mesh
+    VkPipeline object_pipeline(const MaterialPipelines &material_pipelines, const SceneObject &object) const {
+        auto format = static_meshes_[object.mesh_id_.id_]->encoding().vertex_format;
+        return material_pipelines[object.material_id_.id_][static_cast<size_t>(format)];
+    }
+
+    // what the shaders read about an object, atlas materials also pass where their texture lives
+    static cbPerObject object_record(const SceneObject &object, const StaticMesh &mesh, const Material &material) {
+        cbPerObject object_data;
+        object_data.world = object.transform_ * mesh.encoding().dequantize;
+        object_data.material_index = object.material_id_.id_;
+
+        if (material.atlas_region()) {
+            const auto &region = *material.atlas_region();
+            object_data.uv_rect = region.uv_rect;
+            object_data.texture_layer = region.layer;
+            object_data.uv_wrap = region.wrap ? 1 : 0;
+        } else {
+            object_data.uv_rect = glm::fvec4{0.0f, 0.0f, 1.0f, 1.0f};
+            object_data.texture_layer = 0;
+            object_data.uv_wrap = 0;
+        }
+
+        return object_data;
+    }
+
+    // records a range of the sorted render queue into one of the frame's secondary command buffers, different
+    // recorders may run on different threads
+    bool record_draws(FrameSubmitData &frame, size_t recorder, VkFramebuffer framebuffer,
+        const SceneObject *const *first, const SceneObject *const *last,
+        const MaterialPipelines &material_pipelines) {
+        VkCommandBuffer command_buffer = begin_recorder(frame, recorder, framebuffer);
+        if (command_buffer == VK_NULL_HANDLE) {
+            return false;
+        }
+
+        Material::Id current_material;
+        const Material *material = nullptr;
+        VkPipeline current_pipeline = VK_NULL_HANDLE;
+        bool current_in_atlas = false;
+
+        // a material split across recorders gets a scope in each of them
+        bool profile_batches = batch_scopes();
+        uint32_t batch_scope = GpuProfiler::kNoScope;
+
+        for (auto iter = first; iter != last; ++iter) {
+            const auto &object = *iter;
 
-    // object uniforms
-    std::optional<MemoryHelper::DynamicUniformBuffer<cbPerObject>> object_uniforms_;
+            auto &mesh = *static_meshes_[object->mesh_id_.id_];
 
-    // descriptor set layouts
-    VkDescriptorPool descriptor_pool_;
-    std::array<VkDescriptorSetLayout, DescriptorSet::Count> descriptor_layout_;
+            // consecutive materials often share a variant, only rebind when it actually changes
+            VkPipeline pipeline = object_pipeline(material_pipelines, *object);
+            if (pipeline != current_pipeline) {
+                current_pipeline = pipeline;
+                state_.dispatch().cmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, current_pipeline);
+            }
 
-    VkDescriptorSet per_object_set_;
+            if (object->material_id() != current_material) {
+                current_material = object->material_id();
+                material = &materials_[current_material.id_].value();
 
-    // swapchain images
-    std::vector<VkImage> swapchain_images_;
-    std::vector<VkImageView> swapchain_views_;
-    std::vector<VkFramebuffer> swapchain_fbs_;
-    std::vector<FrameSubmitData> frame_data_;
+                if (profile_batches) {
+                    end_scope(command_buffer, batch_scope);
+                    batch_scope = begin_scope(command_buffer, "material " + std::to_string(current_material.id_));
+                }
 
-    std::array<std::optional<SceneObject>, kMaxObjects> scene_objects_;
-    std::array<std::optional<StaticMesh>, kMaxStaticMeshes> static_meshes_;
-    std::array<std::optional<Material>, kMaxMaterials> materials_;
+                // the atlas layout may be the very same object as the regular one, so track which set is bound
+                bool in_atlas = material->atlas_region().has_value();
+                if (in_atlas != current_in_atlas) {
+                    current_in_atlas = in_atlas;
+
+                    // atlas materials read a different set from the per-material slot, restore the shared one
+                    if (current_in_atlas) {
+                        state_.dispatch().cmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            atlas_pipeline_layout_, DescriptorSet::PerMaterial, 1, &atlas_set_, 0, nullptr);
+                    } else if (bindless_) {
+                        state_.dispatch().cmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            pipeline_layout_, DescriptorSet::PerMaterial, 1, &bindless_set_, 0, nullptr);
+                    }
+                }
 
-    Image depth_image_;
-    std::optional<Image::View> depth_view_;
+                if (!material->atlas_region() && !bindless_) {
+                    // bind material
+                    state_.dispatch().cmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        pipeline_layout_, DescriptorSet::PerMaterial, 1, material->descriptor_set_addr(), 0, nullptr);
+                }
+            }
 
-    // currently rendered frame out of frames in flight
-    uint32_t current_frame_;
+            // bind uniforms, every object owns its slot so recorders never write the same memory
+            auto object_index = object->id_.id_;
+            auto ubo_slot = kMaxObjects * current_frame_ + object_index;
+            auto ubo_offset = uint32_t(object_uniforms_->slot_offset(ubo_slot));
 
-    SceneState(ProgramState &state)
-        : state_{state}, render_pass_{VK_NULL_HANDLE}, pipeline_layout_{VK_NULL_HANDLE},
-          graphics_pipeline_{VK_NULL_HANDLE}, command_pool_{VK_NULL_HANDLE}, descriptor_pool_{VK_NULL_HANDLE},
-          current_frame_{0} {
-        descriptor_layout_.fill(VK_NULL_HANDLE);
-    }
+            object_uniforms_->write_slot(ubo_slot, object_record(*object, mesh, *material), false);
 
-    SceneState(const SceneState &) = delete;
-    SceneState &operator=(const SceneState &) = delete;
+            VkPipelineLayout layout = current_in_atlas ? atlas_pipeline_layout_ : pipeline_layout_;
+            state_.dispatch().cmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout,
+                DescriptorSet::PerObject, 1, &per_object_set_, 1, &ubo_offset);
+            mesh.draw(state_.dispatch(), command_buffer, static_cast<uint32_t>(ubo_slot), object->lod_);
+        }
 
-    bool create_framebuffers() {
-        // create the depth image
-        auto depth_image = memory_->create_image(VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-            VK_IMAGE_TYPE_2D, VkExtent3D{state_.swapchain().extent.width, state_.swapchain().extent.height, 1});
+        end_scope(command_buffer, batch_scope);
 
-        if (!depth_image) {
-            LOG_ERROR("failed to initialize depth image");
+        VkResult res = state_.dispatch().endCommandBuffer(command_buffer);
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to end recorder command buffer: %s", string_VkResult(res));
             return false;
         }
 
-        depth_image_ = std::move(depth_image.value());
-        depth_view_ = depth_image_.create_view(
-            state_.dispatch(), VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT);
+        return true;
+    }
 
-        if (!depth_view_) {
-            LOG_ERROR("failed to create depth view");
+    // indirect calls of the batches drawn in the render pass of the given phase, the commands and draw counts were
+    // written by the cull phases of this frame. transparent batches do not write depth, so phase 1 could draw opaque
+    // objects over what they blended. they are left out of phase 0 and drawn last in phase 1, with both phases' draws
+    bool record_indirect_draws(FrameSubmitData &frame, size_t recorder, VkFramebuffer framebuffer, uint32_t phase) {
+        VkCommandBuffer command_buffer = begin_recorder(frame, recorder, framebuffer);
+        if (command_buffer == VK_NULL_HANDLE) {
             return false;
         }
 
-        swapchain_images_ = state_.swapchain().get_images().value();
-        swapchain_views_ = state_.swapchain().get_image_views().value();
+        auto draw_indexed_indirect_count = state_.draw_indexed_indirect_count();
+        constexpr uint32_t kCommandStride = sizeof(VkDrawIndexedIndirectCommand);
 
-        VkResult res;
+        VkPipeline current_pipeline = VK_NULL_HANDLE;
+        bool current_in_atlas = false;
 
-        swapchain_fbs_.resize(swapchain_views_.size());
-        for (size_t i = 0; i < swapchain_views_.size(); ++i) {
-            std::array<VkImageView, 2> attachments = {swapchain_views_[i], depth_view_->view()};
+        bool profile_batches = batch_scopes();
+        uint32_t batch_scope = GpuProfiler::kNoScope;
 
-            VkFramebufferCreateInfo framebuffer_info = {};
-            framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            framebuffer_info.renderPass = render_pass_;
-            framebuffer_info.attachmentCount = static_cast<uint32_t>(attachments.size());
-            framebuffer_info.pAttachments = attachments.data();
-            framebuffer_info.width = state_.swapchain().extent.width;
-            framebuffer_info.height = state_.swapchain().extent.height;
-            framebuffer_info.layers = 1;
+        for (size_t i = 0; i < indirect_batches_.size(); ++i) {
+            const auto &batch = indirect_batches_[i];
+            if (phase == 0 && batch.blend) {
+                break;
+            }
 
-            res = state_.dispatch().createFramebuffer(&framebuffer_info, nullptr, &swapchain_fbs_[i]);
+            if (profile_batches) {
+                end_scope(command_buffer, batch_scope);
+                auto name = (phase == 0 ? "batch " : "deferred batch ") + std::to_string(i);
+                batch_scope = begin_scope(command_buffer, std::move(name));
+            }
 
-            if (VK_SUCCESS != res) {
-                LOG_ERROR("failed to create swapchain fb: %s", string_VkResult(res));
-                return false;
+            if (batch.pipeline != current_pipeline) {
+                current_pipeline = batch.pipeline;
+                state_.dispatch().cmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, current_pipeline);
             }
-        }
 
-        return true;
-    }
+            // same set switching as the cpu path, batches are sorted so each switch happens about once
+            if (batch.in_atlas != current_in_atlas) {
+                current_in_atlas = batch.in_atlas;
 
-public:
-    ~SceneState() {
-        VkResult res = state_.dispatch().deviceWaitIdle();
-        if (VK_SUCCESS != res) {
-            LOG_ERROR("failed to wait device idle: %s", string_VkResult(res));
-        }
+                if (current_in_atlas) {
+                    state_.dispatch().cmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        atlas_pipeline_layout_, DescriptorSet::PerMaterial, 1, &atlas_set_, 0, nullptr);
+                } else if (bindless_) {
+                    state_.dispatch().cmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        pipeline_layout_, DescriptorSet::PerMaterial, 1, &bindless_set_, 0, nullptr);
+                }
+            }
 
-        LOG_INFO("destroying the scene state");
+            if (batch.material_set != VK_NULL_HANDLE) {
+                state_.dispatch().cmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    pipeline_layout_, DescriptorSet::PerMaterial, 1, &batch.material_set, 0, nullptr);
+            }
 
-        memory_.reset(); // manually release to prevent validation errors
+            // instanced variants read every record through the storage view, the dynamic offset is unused
+            uint32_t ubo_offset = 0;
+            VkPipelineLayout layout = current_in_atlas ? atlas_pipeline_layout_ : pipeline_layout_;
+            state_.dispatch().cmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout,
+                DescriptorSet::PerObject, 1, &per_object_set_, 1, &ubo_offset);
+
+            static_meshes_[batch.mesh]->bind(state_.dispatch(), command_buffer);
+
+            // each cull phase writes its own range of commands and counts
+            for (uint32_t cull_phase = batch.blend ? 0 : phase; cull_phase <= phase; ++cull_phase) {
+                size_t phase_base = cull_phase * kMaxObjects;
+
+                VkDeviceSize offset = (phase_base + batch.first_command) * kCommandStride;
+                if (draw_indexed_indirect_count) {
+                    draw_indexed_indirect_count(command_buffer, frame.draw_commands_.buffer(), offset,
+                        frame.draw_counts_.buffer(), (phase_base + i) * sizeof(uint32_t), batch.num_commands,
+                        kCommandStride);
+                } else {
+                    state_.dispatch().cmdDrawIndexedIndirect(
+                        command_buffer, frame.draw_commands_.buffer(), offset, batch.num_commands, kCommandStride);
+                }
 
-        for (auto &fb : swapchain_fbs_) {
-            state_.dispatch().destroyFramebuffer(fb, nullptr);
+                // clusters of the batch's objects drawn with the full mesh, counted after the object counts
+                if (batch.num_cluster_commands == 0) {
+                    continue;
+                }
+
+                offset = (cull_phase * kMaxClusterCommands + batch.first_cluster_command) * kCommandStride;
+                if (draw_indexed_indirect_count) {
+                    draw_indexed_indirect_count(command_buffer, frame.cluster_commands_.buffer(), offset,
+                        frame.draw_counts_.buffer(), ((2 + cull_phase) * kMaxObjects + i) * sizeof(uint32_t),
+                        batch.num_cluster_commands, kCommandStride);
+                } else {
+                    state_.dispatch().cmdDrawIndexedIndirect(command_buffer, frame.cluster_commands_.buffer(),
+                        offset, batch.num_cluster_commands, kCommandStride);
+                }
+            }
         }
 
-        state_.swapchain().destroy_image_views(swapchain_views_);
+        end_scope(command_buffer, batch_scope);
 
-        for (auto &layout : descriptor_layout_) {
-            state_.dispatch().destroyDescriptorSetLayout(layout, nullptr);
+        VkResult res = state_.dispatch().endCommandBuffer(command_buffer);
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to end recorder command buffer: %s", string_VkResult(res));
+            return false;
         }
 
-        state_.dispatch().destroyDescriptorPool(descriptor_pool_, nullptr);
-        state_.dispatch().destroyCommandPool(command_pool_, nullptr);
-        state_.dispatch().destroyRenderPass(render_pass_, nullptr);
-        state_.dispatch().destroyPipelineLayout(pipeline_layout_, nullptr);
-        state_.dispatch().destroyPipeline(graphics_pipeline_, nullptr);
+        return true;
     }
 
-    MemoryHelper &memory() { return *memory_; }
-    MemoryHelper::DynamicUniformBuffer<cbPerObject> &object_uniforms() { return *object_uniforms_; }
-
-    template <typename F> void with_object(const SceneObject::Id &id, F f) const {
-        if (id.valid()) {
-            f(scene_objects_[id.id_]);
-        }
+    // objects are drawn once they have a material and a mesh that finished loading
+    bool drawable(const std::optional<SceneObject> &object) const {
+        return object && resident(object->mesh_id()) && object->material_id().valid();
     }
 
-    template <typename F> void with_object(const SceneObject::Id &id, F f) {
-        if (id.valid()) {
-            f(*scene_objects_[id.id_]);
+    // mesh and material an object is batched by, objects that are not drawable are left out
+    uint64_t batch_key(uint32_t slot) const {
+        const auto &object = scene_objects_[slot];
+        if (!drawable(object)) {
+            return kNotBatched;
         }
+
+        return uint64_t{object->mesh_id_.id_} << 32 | object->material_id_.id_;
     }
 
-    template <typename F> void with_static_mesh(const StaticMesh::Id &id, F f) {
-        if (id.valid()) {
-            f(*static_meshes_[id.id_]);
+    // sorts the drawable objects into batches and assigns every object its command range, runs only when the
+    // grouping changed. every slot is rewritten by every frame afterwards
+    void rebuild_batches(const MaterialPipelines &material_pipelines) {
+        std::vector<uint32_t> slots;
+        for (uint32_t slot = 0; slot < kMaxObjects; ++slot) {
+            batched_as_[slot] = batch_key(slot);
+            if (batched_as_[slot] != kNotBatched) {
+                slots.push_back(slot);
+            } else {
+                cull_objects_[slot] = CullObject{glm::fvec4{0.0f, 0.0f, 0.0f, -1.0f}, glm::fvec4{0.0f}, 0, 0, 0, 0};
+            }
         }
-    }
 
-    template <typename F> void with_material(const Material::Id &id, F f) {
-        if (id.valid()) {
-            f(*materials_[id.id_]);
+        auto material_of = [&](uint32_t slot) -> const Material & {
+            return *materials_[scene_objects_[slot]->material_id_.id_];
+        };
+        auto pipeline_of = [&](uint32_t slot) { return object_pipeline(material_pipelines, *scene_objects_[slot]); };
+
+        // only materials without a shared set split batches by material
+        auto material_set_of = [&](uint32_t slot) -> VkDescriptorSet {
+            const auto &material = material_of(slot);
+            return material.atlas_region() || bindless_ ? VK_NULL_HANDLE : *material.descriptor_set_addr();
+        };
+
+        // transparent materials go last, then the same grouping the cpu path sorts by
+        std::sort(slots.begin(), slots.end(), [&](uint32_t first, uint32_t second) {
+            bool first_blend = material_of(first).render_state().blend;
+            bool second_blend = material_of(second).render_state().blend;
+            if (first_blend != second_blend) {
+                return second_blend;
+            }
+
+            bool first_atlas = material_of(first).atlas_region().has_value();
+            bool second_atlas = material_of(second).atlas_region().has_value();
+            if (first_atlas != second_atlas) {
+                return second_atlas;
+            }
+
+            if (pipeline_of(first) != pipeline_of(second)) {
+                return std::less<VkPipeline>{}(pipeline_of(first), pipeline_of(second));
+            }
+
+            if (material_set_of(first) != material_set_of(second)) {
+                return std::less<VkDescriptorSet>{}(material_set_of(first), material_set_of(second));
+            }
+
+            return scene_objects_[first]->mesh_id_ < scene_objects_[second]->mesh_id_;
+        });
+
+        indirect_batches_.clear();
+        uint32_t cluster_commands = 0;
+
+        for (uint32_t i = 0; i < static_cast<uint32_t>(slots.size()); ++i) {
+            uint32_t slot = slots[i];
+            const auto &object = *scene_objects_[slot];
+
+            IndirectBatch key = {};
+            key.pipeline = pipeline_of(slot);
+            key.material_set = material_set_of(slot);
+            key.in_atlas = material_of(slot).atlas_region().has_value();
+            key.blend = material_of(slot).render_state().blend;
+            key.mesh = object.mesh_id_.id_;
+
+            if (indirect_batches_.empty() || indirect_batches_.back().pipeline != key.pipeline ||
+                indirect_batches_.back().material_set != key.material_set ||
+                indirect_batches_.back().in_atlas != key.in_atlas || indirect_batches_.back().blend != key.blend ||
+                indirect_batches_.back().mesh != key.mesh) {
+                key.first_command = i;
+                key.num_commands = 0;
+                key.first_cluster_command = cluster_commands;
+                key.num_cluster_commands = 0;
+                indirect_batches_.push_back(key);
+            }
+
+            auto &batch = indirect_batches_.back();
+            auto &entry = cull_objects_[slot];
+            entry.mesh = key.mesh;
+            entry.batch = static_cast<uint32_t>(indirect_batches_.size() - 1);
+            entry.command = state_.draw_indexed_indirect_count() ? batch.first_command : i;
+            ++batch.num_commands;
+
+            // every object of a clustered mesh reserves a command per cluster, objects past the last command are
+            // drawn whole
+            const auto &clusters = static_meshes_[key.mesh]->clusters();
+            bool clustered = clusters.count > 0 && cluster_commands + clusters.count <= kMaxClusterCommands;
+
+            entry.first_cluster = clustered ? clusters.first : 0;
+            entry.cluster_count = clustered ? clusters.count : 0;
+            entry.cluster_command =
+                state_.draw_indexed_indirect_count() ? batch.first_cluster_command : cluster_commands;
+
+            if (clustered) {
+                cluster_commands += clusters.count;
+                batch.num_cluster_commands += clusters.count;
+            }
         }
-    }
 
-    SceneObject::Id create_scene_object() {
-        auto iter = std::find_if(scene_objects_.begin(), scene_objects_.end(), [&](const auto &slot) { return !slot; });
-        if (iter == scene_objects_.end()) {
-            LOG_ERROR("too many objects allocated, the limit is %lld", kMaxStaticMeshes);
-            return {};
+        for (auto &frame : frame_data_) {
+            frame.stale_objects_.resize(kMaxObjects);
+            std::iota(frame.stale_objects_.begin(), frame.stale_objects_.end(), 0);
         }
 
-        auto id = SceneObject::Id{static_cast<uint32_t>(std::distance(scene_objects_.begin(), iter))};
-        iter->emplace(SceneObject(id));
+        batched_pipelines_ = material_pipelines;
+        batches_dirty_ = false;
 
-        return id;
+        LOG_INFO("grouped %zu objects into %zu indirect batches with %u cluster commands", slots.size(),
+            indirect_batches_.size(), cluster_commands);
     }
 
-    StaticMesh::Id create_static_mesh(const Geometry &geometry) {
-        // find empty slot for this mesh
-        auto iter = std::find_if(static_meshes_.begin(), static_meshes_.end(), [&](const auto &slot) { return !slot; });
-        if (iter == static_meshes_.end()) {
-            LOG_ERROR("too many meshes allocated, the limit is %lld", kMaxStaticMeshes);
-            return {};
+    // brings this frame's cull input and object records up to date, only touching what changed since the frame was
+    // last drawn. a material that switched pipelines regroups the batches
+    void update_indirect_draws(
+        FrameSubmitData &frame, const MaterialPipelines &material_pipelines) {
+        update_object_tree();
+
+        if (batches_dirty_ || material_pipelines != batched_pipelines_) {
+            rebuild_batches(material_pipelines);
         }
 
-        // create geometry and upload to a VRAM buffer
-        auto vertex_buffer = memory_->create_buffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, geometry.vertices.data(),
-            sizeof(Vertex) * std::size(geometry.vertices), /* use staging buffer */ true);
+        auto *uploaded = static_cast<CullObject *>(frame.cull_objects_.alloc_info().pMappedData);
+        for (auto slot : frame.stale_objects_) {
+            auto &entry = cull_objects_[slot];
 
-        if (!vertex_buffer) {
-            LOG_ERROR("failed to create a vertex buffer");
-            return {};
-        }
+            if (batched_as_[slot] != kNotBatched) {
+                const auto &object = *scene_objects_[slot];
+                auto bounds = static_meshes_[object.mesh_id_.id_]->bounds().transformed(object.transform_);
+                entry.sphere = glm::fvec4{bounds.center, bounds.radius};
+                entry.extents = glm::fvec4{bounds.extents, Bounds::max_scale(object.transform_)};
 
-        if (vertex_buffer->mem_prop_flags() & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
-            LOG_INFO("vertex buffer is host-mappable");
-        } else {
-            LOG_INFO("vertex buffer is device-local");
-        }
+                const auto &mesh = *static_meshes_[object.mesh_id_.id_];
+                const auto &material = *materials_[object.material_id_.id_];
 
-        LOG_INFO("vertex buffer upload complete");
+                // clusters are bounded in mesh units. they may only be dropped for facing away where the
+                // rasterizer would cull them too, a mirroring transform flips which way they face
+                auto rows = glm::transpose(object.transform_);
+                for (size_t i = 0; i < 3; ++i) {
+                    entry.transform[i] = rows[i];
+                }
 
-        auto index_buffer = memory_->create_buffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, geometry.indices.data(),
-            sizeof(uint32_t) * std::size(geometry.indices), /* use staging buffer */ true);
+                const auto &render_state = material.render_state();
+                bool culls_back = render_state.cull_mode == VK_CULL_MODE_BACK_BIT &&
+                                  render_state.front_face == VK_FRONT_FACE_COUNTER_CLOCKWISE;
+                entry.cone_culling = culls_back && glm::determinant(glm::fmat3{object.transform_}) > 0.0f ? 1 : 0;
 
-        if (!index_buffer) {
-            LOG_ERROR("failed to create an index buffer");
-            return {};
-        }
+                auto ubo_slot = kMaxObjects * current_frame_ + slot;
+                object_uniforms_->write_slot(ubo_slot, object_record(object, mesh, material), false);
+            }
 
-        if (index_buffer->mem_prop_flags() & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
-            LOG_INFO("index buffer is host-mappable");
-        } else {
-            LOG_INFO("index buffer is device-local");
+            uploaded[slot] = entry;
         }
 
-        LOG_INFO("index buffer upload complete");
+        frame.stale_objects_.clear();
+        frame.cull_objects_.flush();
+    }
 
-        auto id = StaticMesh::Id{static_cast<uint32_t>(std::distance(static_meshes_.begin(), iter))};
-        iter->emplace(std::move(StaticMesh(id, std::move(*vertex_buffer), std::move(*index_buffer),
-            static_cast<uint32_t>(geometry.vertices.size()), static_cast<uint32_t>(geometry.indices.size()))));
+    // runs one phase of the cull pass, the draws of that phase wait for its commands. objects drawn with a
+    // clustered full mesh are handed on to the cluster pass, which culls them cluster by cluster. the first phase
+    // also clears the draw counts of both and sets up what they test against
+    void record_cull_pass(FrameSubmitData &frame, uint32_t phase) {
+        VkCommandBuffer command_buffer = frame.command_buffer_;
+        bool compact = state_.draw_indexed_indirect_count() != nullptr;
+        bool clusters = max_mesh_clusters_ > 0;
+
+        if (phase == 0) {
+            if (compact) {
+                state_.dispatch().cmdFillBuffer(command_buffer, frame.draw_counts_.buffer(), 0, VK_WHOLE_SIZE, 0);
+            }
 
-        return id;
-    }
+            // both phases start with no expanded objects. without draw counts the cluster commands the cluster
+            // pass does not write are left drawing nothing
+            if (clusters) {
+                uint32_t groups = (max_mesh_clusters_ + 63) / 64;
+                std::array<uint32_t, 6> dispatch = {groups, 0, 1, groups, 0, 1};
+                state_.dispatch().cmdUpdateBuffer(
+                    command_buffer, frame.cluster_dispatch_.buffer(), 0, sizeof(dispatch), dispatch.data());
+
+                if (!compact) {
+                    state_.dispatch().cmdFillBuffer(
+                        command_buffer, frame.cluster_commands_.buffer(), 0, VK_WHOLE_SIZE, 0);
+                }
+            }
 
-    Material::Id create_material(const Bitmap &albedo_bitmap, VkFilter filter, VkSamplerAddressMode address_mode) {
-        auto iter = std::find_if(materials_.begin(), materials_.end(), [&](const auto &slot) { return !slot; });
-        if (iter == materials_.end()) {
-            LOG_ERROR("too many materials allocated, the limit is %lld", kMaxStaticMeshes);
-            return {};
-        }
+            if (compact || clusters) {
+                VkMemoryBarrier clear_barrier = {};
+                clear_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                clear_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                clear_barrier.dstAccessMask =
+                    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
 
-        auto image = memory_->create_image_rgba(
-            VK_IMAGE_USAGE_SAMPLED_BIT, albedo_bitmap.width(), albedo_bitmap.height(), albedo_bitmap.raw_pixels());
+                state_.dispatch().cmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &clear_barrier,
+                    0, nullptr, 0, nullptr);
+            }
 
-        if (!image) {
-            LOG_ERROR("failed to uplaod image to the gpu memory");
-            return {};
+            // the pyramid and the object levels were last written by the previous frame, a new pyramid is moved out
+            // of its undefined layout
+            VkMemoryBarrier lod_barrier = {};
+            lod_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            lod_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            lod_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+            VkImageMemoryBarrier pyramid_barrier = {};
+            pyramid_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            pyramid_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            pyramid_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            pyramid_barrier.oldLayout = depth_pyramid_written_ ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED;
+            pyramid_barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+            pyramid_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            pyramid_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            pyramid_barrier.image = depth_pyramid_.image();
+            pyramid_barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1};
+
+            state_.dispatch().cmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &lod_barrier, 0, nullptr, 1, &pyramid_barrier);
+
+            // the first phase projects onto the previous frame's depth with that frame's camera, the second onto
+            // this frame's depth
+            cbCullView view = {};
+            view.occlusion_view_proj[0] = pyramid_view_proj_.value_or(glm::fmat4{1.0f});
+            view.occlusion_view_proj[1] = frame.view_proj_.value_or(glm::fmat4{1.0f});
+            view.depth_size = glm::uvec4{state_.swapchain().extent.width, state_.swapchain().extent.height,
+                static_cast<uint32_t>(depth_pyramid_levels_.size()), 0};
+            view.camera = frame.lod_view_;
+            view.lod_error = glm::fvec4{kLodPixelError, kLodHysteresis, 0.0f, 0.0f};
+
+            memcpy(frame.cull_view_.alloc_info().pMappedData, &view, sizeof(cbCullView));
+            frame.cull_view_.flush();
+        }
+
+        // without a camera every plane passes everything
+        CullConstants constants = {};
+        for (size_t i = 0; i < Frustum::kPlanes; ++i) {
+            constants.planes[i] = glm::fvec4{0.0f, 0.0f, 0.0f, 1.0f};
+        }
+
+        if (frame.view_proj_) {
+            Frustum frustum = Frustum::from_matrix(&(*frame.view_proj_)[0][0]);
+            for (size_t i = 0; i < Frustum::kPlanes; ++i) {
+                constants.planes[i] = glm::fvec4{frustum.nx[i], frustum.ny[i], frustum.nz[i], frustum.d[i]};
+            }
         }
 
-        auto image_view = image->create_view(
-            state_.dispatch(), VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
+        constants.first_record = static_cast<uint32_t>(kMaxObjects * current_frame_);
+        constants.object_count = static_cast<uint32_t>(kMaxObjects);
+        constants.phase = phase;
 
-        if (!image_view) {
-            LOG_ERROR("failed to create image view from uploaded image");
-            return {};
-        }
+        bool has_depth = phase == 0 ? pyramid_view_proj_.has_value() : frame.view_proj_.has_value();
+        constants.occlusion = has_depth ? 1 : 0;
 
-        // create sampler
-        VkSamplerCreateInfo sampler_desc = {};
-        sampler_desc.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-        sampler_desc.magFilter = filter;
-        sampler_desc.minFilter = filter;
-        sampler_desc.addressModeU = address_mode;
-        sampler_desc.addressModeV = address_mode;
-        sampler_desc.addressModeW = address_mode;
+        state_.dispatch().cmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline_);
+        state_.dispatch().cmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline_layout_,
+            0, 1, &frame.cull_set_, 0, nullptr);
+        state_.dispatch().cmdPushConstants(command_buffer, cull_pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+            sizeof(CullConstants), &constants);
+        state_.dispatch().cmdDispatch(command_buffer, static_cast<uint32_t>((kMaxObjects + 63) / 64), 1, 1);
 
-        VkResult res;
-        VkSampler sampler = VK_NULL_HANDLE;
+        // one row of workgroups per expanded object, the object pass counted them into the dispatch arguments.
+        // the cluster pass shares the object pass's layout, set and constants
+        if (clusters) {
+            VkMemoryBarrier expand_barrier = {};
+            expand_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            expand_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            expand_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
 
-        res = state_.dispatch().createSampler(&sampler_desc, nullptr, &sampler);
-        if (VK_SUCCESS != res) {
-            LOG_ERROR("failed to create sampler: %s", string_VkResult(res));
-            return {};
+            state_.dispatch().cmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &expand_barrier, 0,
+                nullptr, 0, nullptr);
+
+            state_.dispatch().cmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cluster_cull_pipeline_);
+            state_.dispatch().cmdDispatchIndirect(
+                command_buffer, frame.cluster_dispatch_.buffer(), phase * 3 * sizeof(uint32_t));
         }
 
-        VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+        VkMemoryBarrier cull_barrier = {};
+        cull_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        cull_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        cull_barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
 
-        // create per material descriptor set
-        VkDescriptorSetAllocateInfo set_alloc_info = {};
-        set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        set_alloc_info.descriptorPool = descriptor_pool_;
-        set_alloc_info.descriptorSetCount = 1;
-        set_alloc_info.pSetLayouts = &descriptor_layout_[DescriptorSet::PerMaterial];
+        state_.dispatch().cmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &cull_barrier, 0, nullptr, 0, nullptr);
+    }
 
-        res = state_.dispatch().allocateDescriptorSets(&set_alloc_info, &descriptor_set);
-        if (VK_SUCCESS != res) {
-            LOG_ERROR("failed to allocate per material descriptor set: %s", string_VkResult(res));
-            return {};
+    // reduces the depth of the first phase's draws into the pyramid one level at a time, the second cull phase sees
+    // every level and the deferred objects written by the first
+    void build_depth_pyramid(FrameSubmitData &frame) {
+        VkCommandBuffer command_buffer = frame.command_buffer_;
+
+        VkMemoryBarrier level_barrier = {};
+        level_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        level_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        level_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        state_.dispatch().cmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramid_pipeline_);
+
+        PyramidConstants constants = {};
+        constants.source_size = glm::ivec2{
+            static_cast<int>(state_.swapchain().extent.width), static_cast<int>(state_.swapchain().extent.height)};
+
+        for (uint32_t level = 0; level < depth_pyramid_levels_.size(); ++level) {
+            constants.level_size = (constants.source_size + 1) / 2;
+
+            state_.dispatch().cmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                pyramid_pipeline_layout_, 0, 1, &pyramid_sets_[level], 0, nullptr);
+            state_.dispatch().cmdPushConstants(command_buffer, pyramid_pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT,
+                0, sizeof(PyramidConstants), &constants);
+            state_.dispatch().cmdDispatch(command_buffer, static_cast<uint32_t>(constants.level_size.x + 7) / 8,
+                static_cast<uint32_t>(constants.level_size.y + 7) / 8, 1);
+
+            state_.dispatch().cmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &level_barrier, 0, nullptr, 0, nullptr);
+
+            constants.source_size = constants.level_size;
         }
 
-        VkDescriptorImageInfo descriptor_image_info = {};
-        descriptor_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        descriptor_image_info.imageView = image_view->view();
-        descriptor_image_info.sampler = sampler;
+        pyramid_view_proj_ = frame.view_proj_;
+        depth_pyramid_written_ = true;
+    }
 
-        VkWriteDescriptorSet per_material_write_set = {};
-        per_material_write_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        per_material_write_set.dstBinding = 0;
-        per_material_write_set.dstSet = descriptor_set;
-        per_material_write_set.descriptorCount = 1;
-        per_material_write_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        per_material_write_set.pImageInfo = &descriptor_image_info;
+    // second cull phase, objects the previous frame's depth hid are tested against the depth drawn so far and the
+    // ones that came into view are drawn on top in a render pass resuming the first, followed by every transparent
+    // object either phase kept
+    bool record_deferred_draws(FrameSubmitData &frame, VkFramebuffer framebuffer) {
+        build_depth_pyramid(frame);
+        record_cull_pass(frame, 1);
 
-        state_.dispatch().updateDescriptorSets(1, &per_material_write_set, 0, nullptr);
+        VkRenderPassBeginInfo render_begin_desc = {};
+        render_begin_desc.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        render_begin_desc.renderPass = resume_render_pass_;
+        render_begin_desc.framebuffer = framebuffer;
+        render_begin_desc.renderArea = VkRect2D{{0, 0}, state_.swapchain().extent};
 
-        auto id = Material::Id{static_cast<uint32_t>(std::distance(materials_.begin(), iter))};
-        iter->emplace(Material(state_, id, std::move(*image), std::move(*image_view), sampler, descriptor_set));
+        state_.dispatch().cmdBeginRenderPass(
+            frame.command_buffer_, &render_begin_desc, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-        return id;
+        if (!record_indirect_draws(frame, 1, framebuffer, 1)) {
+            state_.dispatch().cmdEndRenderPass(frame.command_buffer_);
+            return false;
+        }
+
+        state_.dispatch().cmdExecuteCommands(frame.command_buffer_, 1, &frame.recorder_buffers_[1]);
+        state_.dispatch().cmdEndRenderPass(frame.command_buffer_);
+        return true;
     }
 
-    bool rebuild_swapchain() {
-        LOG_INFO("rebuilding swapchain");
+    // objects that moved or changed mesh are refitted, objects that stopped being drawable leave the tree
+    void update_object_tree() {
+        for (auto slot : changed_objects_) {
+            auto &object = scene_objects_[slot];
+
+            // the gpu copies of the object are refreshed by each frame in turn
+            if (indirect_draws_) {
+                batches_dirty_ = batches_dirty_ || batch_key(slot) != batched_as_[slot];
+                for (auto &frame : frame_data_) {
+                    frame.stale_objects_.push_back(slot);
+                }
+            }
+
+            // only render objects that are valid, have a resident mesh and a material
+            if (!drawable(object)) {
+                object_tree_.remove(slot);
+                continue;
+            }
+
+            if (object->bounds_dirty_ || !object_tree_.contains(slot)) {
+                auto bounds = static_meshes_[object->mesh_id_.id_]->bounds().transformed(object->transform_);
+                object_tree_.update(slot, bounds.box());
+                object->bounds_dirty_ = false;
+            }
+        }
+
+        changed_objects_.clear();
+        object_tree_.optimize();
+    }
 
-        if (!swapchain_fbs_.empty()) {
-            state_.dispatch().deviceWaitIdle();
+    // culls every drawable object against the camera into visible_objects_, without a camera everything is kept
+    size_t cull_objects(const std::optional<glm::fmat4> &view_proj) {
+        update_object_tree();
 
-            for (auto &fb : swapchain_fbs_) {
-                state_.dispatch().destroyFramebuffer(fb, nullptr);
+        size_t num_visible = 0;
+        if (!view_proj) {
+            for (uint32_t slot = 0; slot < kMaxObjects; ++slot) {
+                if (object_tree_.contains(slot)) {
+                    visible_objects_[num_visible++] = slot;
+                }
             }
 
-            state_.swapchain().destroy_image_views(swapchain_views_);
-            swapchain_images_.clear();
-            swapchain_views_.clear();
-            swapchain_fbs_.clear();
+            return num_visible;
         }
 
-        if (!state_.init_swapchain()) {
-            LOG_ERROR("failed to initialize swapchain");
-            return false;
+        object_tree_.query(Frustum::from_matrix(&(*view_proj)[0][0]),
+            [&](uint32_t slot) { visible_objects_[num_visible++] = slot; });
+        return num_visible;
+    }
+
+    // compiles the compute pipelines of reloaded shaders on the calling thread, there are only a few of them. the
+    // replaced ones are retired through the pipeline manager, a failed compile keeps them
+    void update_compute_pipelines() {
+        if (cull_shaders_reloaded_) {
+            cull_shaders_reloaded_ = false;
+
+            std::array<VkPipeline, 2> pipelines = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+            if (compile_cull_pipelines(state_, *this, pipelines)) {
+                pipelines_->retire(cull_pipeline_);
+                pipelines_->retire(cluster_cull_pipeline_);
+                cull_pipeline_ = pipelines[0];
+                cluster_cull_pipeline_ = pipelines[1];
+            } else {
+                for (auto pipeline : pipelines) {
+                    state_.dispatch().destroyPipeline(pipeline, nullptr);
+                }
+            }
         }
 
-        if (!create_framebuffers()) {
-            LOG_ERROR("failed to create swapchain framebuffers");
-            return false;
+        if (pyramid_shader_reloaded_) {
+            pyramid_shader_reloaded_ = false;
+
+            VkPipeline pipeline = VK_NULL_HANDLE;
+            if (compile_pyramid_pipeline(state_, *this, pipeline)) {
+                pipelines_->retire(pyramid_pipeline_);
+                pyramid_pipeline_ = pipeline;
+            }
         }
+    }
 
-        return true;
+    // scopes of the current frame, see GpuProfiler
+    uint32_t begin_scope(VkCommandBuffer command_buffer, std::string name) {
+        return profiler_ ? profiler_->begin_scope(command_buffer, current_frame_, std::move(name))
+                         : GpuProfiler::kNoScope;
+    }
+
+    void end_scope(VkCommandBuffer command_buffer, uint32_t scope) {
+        if (profiler_) {
+            profiler_->end_scope(command_buffer, current_frame_, scope);
+        }
     }
 
+    bool batch_scopes() const { return profiler_ && profiler_->batch_scopes(); }
+
     template <typename F> bool draw_frame(F draw_commands) {
         auto &frame = frame_data_[current_frame_];
         VkResult res;
@@ -1696,6 +5879,13 @@ public:
             return false;
         }
 
+        // a fence also covers everything submitted before its frame
+        completed_frame_ = std::max(completed_frame_, frame.serial_);
+
+        // frame boundary, rebuilt pipelines can be swapped in without waiting for the device
+        pipelines_->update(kFramesInFlight);
+        update_compute_pipelines();
+
         uint32_t image_index;
         {
             res = state_.dispatch().acquireNextImageKHR(
@@ -1720,6 +5910,8 @@ public:
             return false;
         }
 
+        frame.serial_ = ++next_frame_;
+
         res = state_.dispatch().resetCommandBuffer(frame.command_buffer_, 0);
         if (VK_SUCCESS != res) {
             LOG_ERROR("failed to reset command buffer: %s", string_VkResult(res));
@@ -1738,94 +5930,178 @@ public:
             return false;
         }
 
-        std::array<VkClearValue, 2> clear_values;
-        clear_values[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-        clear_values[1].depthStencil = {1.0f, 0};
-
-        VkRenderPassBeginInfo render_begin_desc = {};
-        render_begin_desc.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        render_begin_desc.renderPass = render_pass_;
-        render_begin_desc.framebuffer = swapchain_fbs_[image_index];
-        render_begin_desc.renderArea = VkRect2D{{0, 0}, state_.swapchain().extent};
-        render_begin_desc.pClearValues = clear_values.data();
-        render_begin_desc.clearValueCount = static_cast<uint32_t>(clear_values.size());
-
-        state_.dispatch().cmdBeginRenderPass(frame.command_buffer_, &render_begin_desc, VK_SUBPASS_CONTENTS_INLINE);
-        state_.dispatch().cmdBindPipeline(frame.command_buffer_, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline_);
-        state_.dispatch().cmdBindDescriptorSets(frame.command_buffer_, VK_PIPELINE_BIND_POINT_GRAPHICS,
-            pipeline_layout_, DescriptorSet::PerFrame, 1, &frame.per_frame_set_, 0, nullptr);
+        // everything recorded into the recorders of this frame has finished executing
+        for (auto pool : frame.recorder_pools_) {
+            res = state_.dispatch().resetCommandPool(pool, 0);
+            if (VK_SUCCESS != res) {
+                LOG_ERROR("failed to reset recorder command pool: %s", string_VkResult(res));
+                return false;
+            }
+        }
 
-        // dynamic state
-        VkViewport vp = {};
-        vp.width = state_.swapchain().extent.width;
-        vp.height = state_.swapchain().extent.height;
-        vp.x = 0;
-        vp.y = 0;
-        vp.minDepth = 0.0f;
-        vp.maxDepth = 1.0f;
+        // the fence covers what the profiler wrote into this frame last time
+        if (profiler_) {
+            profiler_->begin_frame(frame.command_buffer_, current_frame_);
+        }
 
-        VkRect2D scissor{{0, 0}, state_.swapchain().extent};
+        uint32_t frame_scope = begin_scope(frame.command_buffer_, "frame");
 
-        state_.dispatch().cmdSetViewport(frame.command_buffer_, 0, 1, &vp);
-        state_.dispatch().cmdSetScissor(frame.command_buffer_, 0, 1, &scissor);
+        // meshes become resident here, before anything looks at which objects are drawable
+        uint32_t streaming_scope = begin_scope(frame.command_buffer_, "streaming");
+        stream_meshes(frame);
+        end_scope(frame.command_buffer_, streaming_scope);
 
+        // the render pass only executes secondary command buffers, anything the sample records goes before it
         res = draw_commands(frame);
         if (VK_SUCCESS != res) {
             LOG_ERROR("draw_commands returned %s", string_VkResult(res));
             return false;
         }
 
-        // render scene objects
-        cbPerObject object_data;
+        // variants finish compiling on worker threads, so take one consistent snapshot for sorting and drawing
+        MaterialPipelines material_pipelines;
+        for (size_t i = 0; i < kMaxMaterials; ++i) {
+            for (size_t format = 0; format < kVertexFormats; ++format) {
+                material_pipelines[i][format] =
+                    materials_[i] ? materials_[i]->pipeline(static_cast<VertexFormat>(format)) : VK_NULL_HANDLE;
+            }
+        }
+
+        // on the gpu driven path the cpu only uploads what changed, visibility is decided by the cull pass
+        if (indirect_draws_) {
+            update_indirect_draws(frame, material_pipelines);
+
+            uint32_t cull_scope = begin_scope(frame.command_buffer_, "cull");
+            record_cull_pass(frame, 0);
+            end_scope(frame.command_buffer_, cull_scope);
+        }
+
+        // render scene objects, only the ones inside the camera frustum reach sorting and recording
+        size_t num_visible = indirect_draws_ ? 0 : cull_objects(frame.view_proj_);
 
         std::array<const SceneObject *, kMaxObjects> render_queue;
         auto render_queue_end = render_queue.begin();
-        for (const auto &object : scene_objects_) {
-            // only render objects that are valid, have valid mesh and material
-            if (object && object->mesh_id().valid() && object->material_id().valid()) {
-                *render_queue_end = &object.value();
-                render_queue_end++;
-            }
+        for (size_t i = 0; i < num_visible; ++i) {
+            auto &object = scene_objects_[visible_objects_[i]].value();
+            object.lod_ = object_lod(object, frame.lod_view_);
+
+            *render_queue_end = &object;
+            render_queue_end++;
         }
 
+        auto material_of = [&](const SceneObject *object) -> const Material & {
+            return *materials_[object->material_id_.id_];
+        };
+
+        auto pipeline_of = [&](const SceneObject *object) { return object_pipeline(material_pipelines, *object); };
+
         // TODO: cache the order instead of recalculating each frame
-        // sort by material
+        // transparent materials go last, then group by pipeline layout, pipeline and material to minimize binds
         std::sort(render_queue.begin(), render_queue_end, [&](const SceneObject *first, const SceneObject *second) {
+            const auto &first_material = material_of(first), &second_material = material_of(second);
+
+            bool first_blend = first_material.render_state().blend, second_blend = second_material.render_state().blend;
+            if (first_blend != second_blend) {
+                return second_blend;
+            }
+
+            bool first_atlas = first_material.atlas_region().has_value();
+            bool second_atlas = second_material.atlas_region().has_value();
+            if (first_atlas != second_atlas) {
+                return second_atlas;
+            }
+
+            if (pipeline_of(first) != pipeline_of(second)) {
+                return std::less<VkPipeline>{}(pipeline_of(first), pipeline_of(second));
+            }
+
             return first->material_id() < second->material_id();
         });
 
-        Material::Id current_material;
-        for (auto iter = render_queue.begin(); iter != render_queue_end; ++iter) {
-            const auto &object = *iter;
+        std::array<VkClearValue, 2> clear_values;
+        clear_values[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+        clear_values[1].depthStencil = {1.0f, 0};
 
-            if (object->material_id() != current_material) {
-                current_material = object->material_id();
+        VkRenderPassBeginInfo render_begin_desc = {};
+        render_begin_desc.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        render_begin_desc.renderPass = render_pass_;
+        render_begin_desc.framebuffer = swapchain_fbs_[image_index];
+        render_begin_desc.renderArea = VkRect2D{{0, 0}, state_.swapchain().extent};
+        render_begin_desc.pClearValues = clear_values.data();
+        render_begin_desc.clearValueCount = static_cast<uint32_t>(clear_values.size());
 
-                // bind material
-                with_material(current_material, [&](const Material &mat) {
-                    state_.dispatch().cmdBindDescriptorSets(frame.command_buffer_, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                        pipeline_layout_, DescriptorSet::PerMaterial, 1, mat.descriptor_set_addr(), 0, nullptr);
-                });
+        // counts the draws of both cull phases, the compute work in between adds nothing to the counters asked for
+        if (profiler_) {
+            profiler_->begin_statistics(frame.command_buffer_, current_frame_);
+        }
+
+        uint32_t render_scope = begin_scope(frame.command_buffer_, "render pass");
+        state_.dispatch().cmdBeginRenderPass(
+            frame.command_buffer_, &render_begin_desc, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+        // split the sorted queue into contiguous ranges, one per recorder
+        size_t num_draws = static_cast<size_t>(std::distance(render_queue.begin(), render_queue_end));
+        size_t num_recorders = std::min(frame.recorder_buffers_.size(),
+            (num_draws + kMinDrawsPerRecorder - 1) / kMinDrawsPerRecorder);
+        size_t draws_per_recorder = num_recorders > 0 ? (num_draws + num_recorders - 1) / num_recorders : 0;
+
+        auto record_range = [&, framebuffer = swapchain_fbs_[image_index]](size_t recorder) {
+            auto first = render_queue.data() + std::min(num_draws, recorder * draws_per_recorder);
+            auto last = render_queue.data() + std::min(num_draws, (recorder + 1) * draws_per_recorder);
+            return record_draws(frame, recorder, framebuffer, first, last, material_pipelines);
+        };
+
+        // the calling thread records ranges too, so a frame never waits behind pipeline compiles queued on the workers
+        std::vector<uint8_t> recorded(num_recorders, 0);
+        state_.jobs().parallel_for(num_recorders, 1, [&](size_t begin, size_t end) {
+            for (size_t recorder = begin; recorder < end; ++recorder) {
+                recorded[recorder] = record_range(recorder) ? 1 : 0;
             }
+        });
 
-            // bind uniforms
-            auto object_index = object->id_.id_;
-            auto ubo_slot = kMaxObjects * current_frame_ + object_index;
-            auto ubo_offset = uint32_t(object_uniforms_->slot_offset(ubo_slot));
+        if (static_cast<size_t>(std::count(recorded.begin(), recorded.end(), 1)) != num_recorders) {
+            LOG_ERROR("failed to record scene draws");
+            return false;
+        }
 
-            object_data.world = object->transform_;
-            object_uniforms_->write_slot(ubo_slot, object_data, false);
+        // a single recorder is plenty for a handful of indirect calls
+        if (indirect_draws_) {
+            if (!record_indirect_draws(frame, 0, swapchain_fbs_[image_index], 0)) {
+                LOG_ERROR("failed to record indirect scene draws");
+                return false;
+            }
+
+            num_recorders = 1;
+        }
 
-            state_.dispatch().cmdBindDescriptorSets(frame.command_buffer_, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                pipeline_layout_, DescriptorSet::PerObject, 1, &per_object_set_, 1, &ubo_offset);
-            with_static_mesh(
-                object->mesh_id_, [&](StaticMesh &mesh) { mesh.draw(state_.dispatch(), frame.command_buffer()); });
+        if (num_recorders > 0) {
+            state_.dispatch().cmdExecuteCommands(
+                frame.command_buffer_, static_cast<uint32_t>(num_recorders), frame.recorder_buffers_.data());
         }
 
         // flush caches on uniforms before submitting the command buffer
         object_uniforms_->buffer().flush();
 
         state_.dispatch().cmdEndRenderPass(frame.command_buffer_);
+        end_scope(frame.command_buffer_, render_scope);
+
+        if (indirect_draws_) {
+            // depth pyramid, second cull phase and the draws it found
+            uint32_t deferred_scope = begin_scope(frame.command_buffer_, "deferred pass");
+            if (!record_deferred_draws(frame, swapchain_fbs_[image_index])) {
+                LOG_ERROR("failed to record deferred scene draws");
+                return false;
+            }
+
+            end_scope(frame.command_buffer_, deferred_scope);
+        }
+
+        if (profiler_) {
+            profiler_->end_statistics(frame.command_buffer_, current_frame_);
+        }
+
+        end_scope(frame.command_buffer_, frame_scope);
+
         state_.dispatch().endCommandBuffer(frame.command_buffer_);
 
         // submitting the recorder buffer
@@ -1872,48 +6148,34 @@ public:
             }
         }
 
-        current_frame_ = current_frame_ % static_cast<uint32_t>(frame_data_.size());
+        current_frame_ = (current_frame_ + 1) % static_cast<uint32_t>(frame_data_.size());
         return true;
     }
 
-    static VkShaderModule shader_from_bytecode(ProgramState &state, const void *buffer, size_t size) {
-        VkResult res;
-
-        VkShaderModuleCreateInfo create_info = {};
-        create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        create_info.codeSize = size;
-        create_info.pCode = reinterpret_cast<const uint32_t *>(buffer);
-
-        VkShaderModule module = VK_NULL_HANDLE;
-        res = state.dispatch().createShaderModule(&create_info, nullptr, &module);
-        if (VK_SUCCESS != res) {
-            LOG_ERROR("failed to create shader module: %s", string_VkResult(res));
-            return VK_NULL_HANDLE;
-        }
-
-        return module;
-    }
-
-    static bool create_render_pass(ProgramState &state, VkRenderPass *render_pass) {
+    // every variant is compatible with the others. a pass that does not clear continues where another one left
+    // off, a pass that does not present leaves its depth to be read by the depth pyramid
+    static bool create_render_pass(ProgramState &state, bool clear, bool present, VkRenderPass *render_pass) {
         VkAttachmentDescription color_attachment = {};
         color_attachment.format = state.swapchain().image_format;
         color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-        color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        color_attachment.loadOp = clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
         color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
         color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        color_attachment.initialLayout = clear ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        color_attachment.finalLayout =
+            present ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
         VkAttachmentDescription depth_attachment = {};
         depth_attachment.format = VK_FORMAT_D32_SFLOAT;
         depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-        depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depth_attachment.loadOp = clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
         depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
         depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
         depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depth_attachment.initialLayout = clear ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        depth_attachment.finalLayout =
+            present ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
         VkAttachmentReference color_attachment_ref = {};
         color_attachment_ref.attachment = 0;
@@ -1942,6 +6204,28 @@ public:
         dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
                                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
+        // the depth pyramid is done reading the depth before it becomes an attachment again
+        if (!clear) {
+            dependency.srcStageMask |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+            dependency.dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+        }
+
+        // color and depth are visible to the pyramid and to the pass resuming this one
+        VkSubpassDependency resume_dependency = {};
+        resume_dependency.srcSubpass = 0;
+        resume_dependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+        resume_dependency.srcStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        resume_dependency.srcAccessMask =
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        resume_dependency.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                         VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        resume_dependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                                          VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+
+        std::array<VkSubpassDependency, 2> dependencies{dependency, resume_dependency};
         std::array<VkAttachmentDescription, 2> attachments{color_attachment, depth_attachment};
 
         VkRenderPassCreateInfo render_pass_info = {};
@@ -1950,8 +6234,8 @@ public:
         render_pass_info.pAttachments = attachments.data();
         render_pass_info.subpassCount = 1;
         render_pass_info.pSubpasses = &subpass;
-        render_pass_info.dependencyCount = 1;
-        render_pass_info.pDependencies = &dependency;
+        render_pass_info.dependencyCount = present ? 1 : 2;
+        render_pass_info.pDependencies = dependencies.data();
 
         VkResult res = state.dispatch().createRenderPass(&render_pass_info, nullptr, render_pass);
         if (VK_SUCCESS != res) {
@@ -1964,259 +6248,142 @@ public:
     }
 
     static bool create_descriptor_data(ProgramState &state, SceneState &scene) {
-        // layout of the per-frame descriptor set
-        std::array<VkDescriptorSetLayoutBinding, 1> per_frame_bindings = {};
-        per_frame_bindings[0] = {};
-        per_frame_bindings[0].binding = 0;
-        per_frame_bindings[0].descriptorCount = 1;
-        per_frame_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        per_frame_bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
-        VkDescriptorSetLayoutCreateInfo per_frame_set_desc = {};
-        per_frame_set_desc.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        per_frame_set_desc.flags = 0;
-        per_frame_set_desc.bindingCount = static_cast<uint32_t>(per_frame_bindings.size());
-        per_frame_set_desc.pBindings = per_frame_bindings.data();
-
-        VkResult res = state.dispatch().createDescriptorSetLayout(
-            &per_frame_set_desc, nullptr, &scene.descriptor_layout_[DescriptorSet::PerFrame]);
-        if (VK_SUCCESS != res) {
-            LOG_ERROR("failed to create descriptor set layout: %s", string_VkResult(res));
+        // set layouts are reflected from the shaders, every material variant shares the vertex stage
+        const auto *vertex_shader = scene.shaders_->get("vertex.spv");
+        const auto *fragment_shader = scene.shaders_->get(scene.bindless_ ? "fragment_bindless.spv" : "fragment.spv");
+        const auto *atlas_shader = scene.shaders_->get("fragment_atlas.spv");
+        if (!vertex_shader || !fragment_shader || !atlas_shader) {
+            LOG_ERROR("failed to load shaders for layout reflection");
             return false;
         }
 
-        // layout of the per-material descriptor set
-        std::array<VkDescriptorSetLayoutBinding, 1> per_material_bindings = {};
-        per_material_bindings[0] = {};
-        per_material_bindings[0].binding = 0;
-        per_material_bindings[0].descriptorCount = 1;
-        per_material_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        per_material_bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        VkDescriptorSetLayoutCreateInfo per_material_set_desc = {};
-        per_material_set_desc.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        per_material_set_desc.flags = 0;
-        per_material_set_desc.bindingCount = static_cast<uint32_t>(per_material_bindings.size());
-        per_material_set_desc.pBindings = per_material_bindings.data();
+        for (uint32_t set = 0; set < DescriptorSet::Count; ++set) {
+            auto desc = ShaderLibrary::reflect_set({vertex_shader, fragment_shader}, set);
+            adjust_set_layout(scene, set, desc);
 
-        res = state.dispatch().createDescriptorSetLayout(
-            &per_material_set_desc, nullptr, &scene.descriptor_layout_[DescriptorSet::PerMaterial]);
-        if (VK_SUCCESS != res) {
-            LOG_ERROR("failed to create descriptor set layout: %s", string_VkResult(res));
-            return false;
+            scene.descriptor_layout_[set] = scene.shaders_->descriptor_set_layout(desc);
+            if (scene.descriptor_layout_[set] == VK_NULL_HANDLE) {
+                LOG_ERROR("failed to create layout of descriptor set %u", set);
+                return false;
+            }
         }
 
-        // layout of the per-object descriptor set
-        std::array<VkDescriptorSetLayoutBinding, 1> per_object_bindings = {};
-        per_object_bindings[0] = {};
-        per_object_bindings[0].binding = 0;
-        per_object_bindings[0].descriptorCount = 1;
-        per_object_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-        per_object_bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
-        VkDescriptorSetLayoutCreateInfo per_object_set_desc = {};
-        per_object_set_desc.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        per_object_set_desc.flags = 0;
-        per_object_set_desc.bindingCount = static_cast<uint32_t>(per_object_bindings.size());
-        per_object_set_desc.pBindings = per_object_bindings.data();
-
-        res = state.dispatch().createDescriptorSetLayout(
-            &per_object_set_desc, nullptr, &scene.descriptor_layout_[DescriptorSet::PerObject]);
-        if (VK_SUCCESS != res) {
-            LOG_ERROR("failed to create descriptor set layout: %s", string_VkResult(res));
+        // layout of the atlas descriptor set, bound in place of the per-material set
+        auto atlas_desc = ShaderLibrary::reflect_set({atlas_shader}, DescriptorSet::PerMaterial);
+        scene.atlas_layout_ = scene.shaders_->descriptor_set_layout(atlas_desc);
+        if (scene.atlas_layout_ == VK_NULL_HANDLE) {
+            LOG_ERROR("failed to create layout of the atlas descriptor set");
             return false;
         }
 
         // allocate descriptor pool
         // clang-format off
-        std::array<VkDescriptorPoolSize, 3> pool_sizes = {
+        std::array<VkDescriptorPoolSize, 5> pool_sizes = {
             VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 10},
             VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 10},
-            VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 10}
+            VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 40},
+            VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                static_cast<uint32_t>(kMaxMaterials) + 1 + kMaxPyramidLevels + kFramesInFlight},
+            VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, kMaxPyramidLevels}
         };
         // clang-format on
 
         VkDescriptorPoolCreateInfo pool_desc = {};
         pool_desc.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
         pool_desc.flags = 0;
-        pool_desc.maxSets = 100;
+        pool_desc.maxSets = 100 + static_cast<uint32_t>(kMaxMaterials) + 1 + kMaxPyramidLevels;
         pool_desc.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
         pool_desc.pPoolSizes = pool_sizes.data();
 
-        res = state.dispatch().createDescriptorPool(&pool_desc, nullptr, &scene.descriptor_pool_);
+        VkResult res = state.dispatch().createDescriptorPool(&pool_desc, nullptr, &scene.descriptor_pool_);
         if (VK_SUCCESS != res) {
             LOG_ERROR("failed to allocate descriptor pool: %s", string_VkResult(res));
             return false;
         }
 
-        return true;
-    }
-
-    static bool create_pipeline_layout(ProgramState &state, SceneState &scene) {
-        VkPipelineLayoutCreateInfo pipeline_layout_info = {};
-        pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipeline_layout_info.setLayoutCount = static_cast<uint32_t>(DescriptorSet::Count);
-        pipeline_layout_info.pSetLayouts = scene.descriptor_layout_.data();
-        pipeline_layout_info.pushConstantRangeCount = 0;
-
-        VkResult res;
-        res = state.dispatch().createPipelineLayout(&pipeline_layout_info, nullptr, &scene.pipeline_layout_);
-        if (VK_SUCCESS != res) {
-            scene.pipeline_layout_ = VK_NULL_HANDLE;
-            LOG_ERROR("failed to pipeline layout: %s", string_VkResult(res));
+        if (scene.bindless_ && !create_bindless_table(state, scene)) {
+            LOG_ERROR("failed to create bindless material table");
             return false;
         }
 
         return true;
     }
 
-    static bool create_graphics_pipeline(ProgramState &state, VkPipelineLayout layout, VkRenderPass render_pass,
-        uint32_t subpass_index, VkPipeline *pipeline) {
-        constexpr std::array<VkDynamicState, 2> kDynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
-
-        // shader modules
-        VkShaderModule vs_module = shader_from_bytecode(state, kVertex_spv.data(), kVertex_spv.size());
-        if (vs_module == VK_NULL_HANDLE) {
-            LOG_ERROR("fatal error when creating vertex shader module");
-            return false;
-        }
+    // reflection cannot tell how a binding is used, apply what the scene knows about its sets
+    static void adjust_set_layout(SceneState &scene, uint32_t set, DescriptorSetLayoutDesc &desc) {
+        for (auto &binding : desc.bindings) {
+            // object uniforms live in one buffer addressed with dynamic offsets
+            if (set == DescriptorSet::PerObject && binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+                binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+            }
 
-        VkShaderModule fs_module = shader_from_bytecode(state, kFragment_spv.data(), kFragment_spv.size());
-        if (fs_module == VK_NULL_HANDLE) {
-            LOG_ERROR("fatal error when creating fragment shader module");
-            state.dispatch().destroyShaderModule(vs_module, nullptr);
-            return false;
+            // runtime arrays hold the bindless material table, unused slots are never accessed and new
+            // materials are written while the table is bound
+            if (binding.descriptorCount == 0) {
+                binding.descriptorCount = static_cast<uint32_t>(kMaxMaterials);
+                desc.binding_flags.resize(desc.bindings.size(), 0);
+                desc.binding_flags[&binding - desc.bindings.data()] =
+                    VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT;
+                desc.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+            }
         }
+    }
 
-        VkPipelineShaderStageCreateInfo vert_stage_info = {};
-        vert_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        vert_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
-        vert_stage_info.module = vs_module;
-        vert_stage_info.pName = "main";
-
-        VkPipelineShaderStageCreateInfo frag_stage_info = {};
-        frag_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        frag_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        frag_stage_info.module = fs_module;
-        frag_stage_info.pName = "main";
-
-        std::array<VkPipelineShaderStageCreateInfo, 2> shader_stages = {vert_stage_info, frag_stage_info};
-
-        // set viewport and scissor as dynamic state
-        VkPipelineDynamicStateCreateInfo dynamic_state_desc = {};
-        dynamic_state_desc.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-        dynamic_state_desc.pDynamicStates = kDynamicStates.data();
-        dynamic_state_desc.dynamicStateCount = static_cast<uint32_t>(kDynamicStates.size());
-
-        // input state using the vertex struct
-        constexpr std::array<VkVertexInputAttributeDescription, 3> kVertexAttribDesc = {
-            VkVertexInputAttributeDescription{0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position)},
-            VkVertexInputAttributeDescription{1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal)},
-            VkVertexInputAttributeDescription{2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv)},
-        };
-
-        VkVertexInputBindingDescription vertex_binding_desc = {};
-        vertex_binding_desc.binding = 0;
-        vertex_binding_desc.stride = sizeof(Vertex);
-        vertex_binding_desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-        VkPipelineVertexInputStateCreateInfo input_state_desc = {};
-        input_state_desc.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        input_state_desc.pVertexAttributeDescriptions = kVertexAttribDesc.data();
-        input_state_desc.vertexAttributeDescriptionCount = static_cast<uint32_t>(kVertexAttribDesc.size());
-        input_state_desc.pVertexBindingDescriptions = &vertex_binding_desc;
-        input_state_desc.vertexBindingDescriptionCount = 1;
-
-        // input assembly
-        VkPipelineInputAssemblyStateCreateInfo assembly_desc = {};
-        assembly_desc.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        assembly_desc.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        assembly_desc.primitiveRestartEnable = false;
-
-        // dynamic state
-        VkPipelineViewportStateCreateInfo viewport_desc = {};
-        viewport_desc.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-        viewport_desc.viewportCount = 1;
-        viewport_desc.scissorCount = 1;
-
-        // rasterization
-        VkPipelineRasterizationStateCreateInfo rasterizer_desc = {};
-        rasterizer_desc.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterizer_desc.depthClampEnable = false;
-        rasterizer_desc.rasterizerDiscardEnable = false;
-        rasterizer_desc.polygonMode = VK_POLYGON_MODE_FILL;
-        rasterizer_desc.lineWidth = 1.0f;
-        rasterizer_desc.cullMode = VK_CULL_MODE_NONE;
-        rasterizer_desc.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-        rasterizer_desc.depthBiasEnable = false;
-        rasterizer_desc.depthBiasConstantFactor = 0.0f;
-        rasterizer_desc.depthBiasClamp = 0.0f;
-        rasterizer_desc.depthBiasSlopeFactor = 0.0f;
-
-        // no multisampling
-        VkPipelineMultisampleStateCreateInfo multisample_desc = {};
-        multisample_desc.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisample_desc.sampleShadingEnable = false;
-        multisample_desc.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-        multisample_desc.minSampleShading = 1.0f;
-        multisample_desc.pSampleMask = nullptr;
-        multisample_desc.alphaToCoverageEnable = false;
-        multisample_desc.alphaToOneEnable = false;
-
-        // no blending
-        VkPipelineColorBlendAttachmentState blend_att_desc = {};
-        blend_att_desc.colorWriteMask =
-            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        blend_att_desc.blendEnable = false;
+    static bool create_bindless_table(ProgramState &state, SceneState &scene) {
+        // update-after-bind sets need a pool created with the matching flag
+        VkDescriptorPoolSize pool_size = {};
+        pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        pool_size.descriptorCount = static_cast<uint32_t>(kMaxMaterials);
 
-        VkPipelineColorBlendStateCreateInfo blend_desc = {};
-        blend_desc.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        blend_desc.logicOpEnable = false;
-        blend_desc.logicOp = VK_LOGIC_OP_COPY;
-        blend_desc.blendConstants[0] = 0.0f;
-        blend_desc.blendConstants[1] = 0.0f;
-        blend_desc.blendConstants[2] = 0.0f;
-        blend_desc.blendConstants[3] = 0.0f;
-        blend_desc.pAttachments = &blend_att_desc;
-        blend_desc.attachmentCount = 1;
+        VkDescriptorPoolCreateInfo pool_desc = {};
+        pool_desc.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_desc.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+        pool_desc.maxSets = 1;
+        pool_desc.poolSizeCount = 1;
+        pool_desc.pPoolSizes = &pool_size;
 
-        VkPipelineDepthStencilStateCreateInfo depth_desc = {};
-        depth_desc.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-        depth_desc.depthWriteEnable = VK_TRUE;
-        depth_desc.depthTestEnable = VK_TRUE;
-        depth_desc.depthCompareOp = VK_COMPARE_OP_LESS;
-        depth_desc.depthBoundsTestEnable = VK_FALSE;
-        depth_desc.stencilTestEnable = VK_FALSE;
+        VkResult res = state.dispatch().createDescriptorPool(&pool_desc, nullptr, &scene.bindless_pool_);
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to allocate bindless descriptor pool: %s", string_VkResult(res));
+            return false;
+        }
 
-        // finally, create the graphics pipeline
-        VkGraphicsPipelineCreateInfo create_info = {};
-        create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        create_info.pStages = shader_stages.data();
-        create_info.stageCount = static_cast<uint32_t>(shader_stages.size());
-        create_info.pVertexInputState = &input_state_desc;
-        create_info.pInputAssemblyState = &assembly_desc;
-        create_info.pViewportState = &viewport_desc;
-        create_info.pRasterizationState = &rasterizer_desc;
-        create_info.pMultisampleState = &multisample_desc;
-        create_info.pColorBlendState = &blend_desc;
-        create_info.pDynamicState = &dynamic_state_desc;
-        create_info.pDepthStencilState = &depth_desc;
-        create_info.layout = layout;
-        create_info.renderPass = render_pass;
-        create_info.subpass = subpass_index;
+        VkDescriptorSetAllocateInfo set_alloc_info = {};
+        set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        set_alloc_info.descriptorPool = scene.bindless_pool_;
+        set_alloc_info.descriptorSetCount = 1;
+        set_alloc_info.pSetLayouts = &scene.descriptor_layout_[DescriptorSet::PerMaterial];
 
-        VkResult res = state.dispatch().createGraphicsPipelines(VK_NULL_HANDLE, 1, &create_info, nullptr, pipeline);
+        res = state.dispatch().allocateDescriptorSets(&set_alloc_info, &scene.bindless_set_);
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to allocate bindless descriptor set: %s", string_VkResult(res));
+            return false;
+        }
 
-        // cleanup
-        state.dispatch().destroyShaderModule(vs_module, nullptr);
-        state.dispatch().destroyShaderModule(fs_module, nullptr);
+        return true;
+    }
 
-        if (VK_SUCCESS != res) {
-            *pipeline = VK_NULL_HANDLE;
-            LOG_ERROR("failed to create pipeline: %s", string_VkResult(res));
+    static bool create_pipeline_layout(ProgramState &state, SceneState &scene) {
+        std::vector<VkDescriptorSetLayout> set_layouts{
+            scene.descriptor_layout_.begin(), scene.descriptor_layout_.end()};
+        scene.pipeline_layout_ = scene.shaders_->pipeline_layout(set_layouts, {});
+        if (scene.pipeline_layout_ == VK_NULL_HANDLE) {
+            LOG_ERROR("failed to create pipeline layout");
+            return false;
+        }
+
+        // same as above, with the atlas set in the per-material slot. without bindless both sets reflect the same
+        // bindings, in which case the two layouts are one and the same object
+        set_layouts[DescriptorSet::PerMaterial] = scene.atlas_layout_;
+        scene.atlas_pipeline_layout_ = scene.shaders_->pipeline_layout(set_layouts, {});
+        if (scene.atlas_pipeline_layout_ == VK_NULL_HANDLE) {
+            LOG_ERROR("failed to create atlas pipeline layout");
             return false;
         }
 
+        LOG_INFO("reflected %zu descriptor set layouts and %zu pipeline layouts", scene.shaders_->num_set_layouts(),
+            scene.shaders_->num_pipeline_layouts());
+
         return true;
     }
 
@@ -2238,7 +6405,9 @@ public:
     }
 
     static bool create_object_data(ProgramState &state, SceneState &scene, uint32_t frames_in_flight) {
-        scene.object_uniforms_ = scene.memory_->init_dynamic_ubo<cbPerObject>(kMaxObjects * frames_in_flight);
+        // also readable as a storage buffer so instanced variants can index it
+        scene.object_uniforms_ = scene.memory_->init_dynamic_ubo<cbPerObject>(
+            kMaxObjects * frames_in_flight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
         if (!scene.object_uniforms_) {
             LOG_ERROR("failed to allocate dynamic uniform buffer");
             return false;
@@ -2260,17 +6429,61 @@ public:
         VkDescriptorBufferInfo per_object_buffer_desc = {};
         per_object_buffer_desc.buffer = scene.object_uniforms_->buffer().buffer();
         per_object_buffer_desc.offset = 0;
-        per_object_buffer_desc.range = sizeof(cbPerFrame);
+        per_object_buffer_desc.range = sizeof(cbPerObject);
+
+        VkDescriptorBufferInfo object_records_desc = {};
+        object_records_desc.buffer = scene.object_uniforms_->buffer().buffer();
+        object_records_desc.offset = 0;
+        object_records_desc.range = VK_WHOLE_SIZE;
+
+        std::array<VkWriteDescriptorSet, 2> per_object_write_sets = {};
+        per_object_write_sets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        per_object_write_sets[0].dstBinding = 0;
+        per_object_write_sets[0].dstSet = scene.per_object_set_;
+        per_object_write_sets[0].descriptorCount = 1;
+        per_object_write_sets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        per_object_write_sets[0].pBufferInfo = &per_object_buffer_desc;
+
+        // the same records as seen by instanced variants
+        per_object_write_sets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        per_object_write_sets[1].dstBinding = 1;
+        per_object_write_sets[1].dstSet = scene.per_object_set_;
+        per_object_write_sets[1].descriptorCount = 1;
+        per_object_write_sets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        per_object_write_sets[1].pBufferInfo = &object_records_desc;
+
+        state.dispatch().updateDescriptorSets(
+            static_cast<uint32_t>(per_object_write_sets.size()), per_object_write_sets.data(), 0, nullptr);
+        return true;
+    }
 
-        VkWriteDescriptorSet per_object_write_set = {};
-        per_object_write_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        per_object_write_set.dstBinding = 0;
-        per_object_write_set.dstSet = scene.per_object_set_;
-        per_object_write_set.descriptorCount = 1;
-        per_object_write_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-        per_object_write_set.pBufferInfo = &per_object_buffer_desc;
+    static bool create_recorders(ProgramState &state, FrameSubmitData &frame, uint32_t num_recorders) {
+        auto family_index = state.device().get_queue_index(vkb::QueueType::graphics).value();
+
+        for (uint32_t r = 0; r < num_recorders; ++r) {
+            VkCommandPool pool;
+            if (!create_command_pool(state, family_index, &pool)) {
+                return false;
+            }
+
+            frame.recorder_pools_.push_back(pool);
+
+            VkCommandBufferAllocateInfo buffer_info = {};
+            buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            buffer_info.commandPool = pool;
+            buffer_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            buffer_info.commandBufferCount = 1;
+
+            VkCommandBuffer command_buffer;
+            VkResult res = state.dispatch().allocateCommandBuffers(&buffer_info, &command_buffer);
+            if (VK_SUCCESS != res) {
+                LOG_ERROR("failed to allocate recorder command buffer: %s", string_VkResult(res));
+                return false;
+            }
+
+            frame.recorder_buffers_.push_back(command_buffer);
+        }
 
-        state.dispatch().updateDescriptorSets(1, &per_object_write_set, 0, nullptr);
         return true;
     }
 
@@ -2324,6 +6537,18 @@ public:
                 return false;
             }
 
+            // one recorder per worker thread plus one for the thread drawing the frame, the gpu driven path records
+            // one for each cull phase
+            uint32_t num_recorders = static_cast<uint32_t>(state.jobs().size() + 1);
+            if (scene.indirect_draws_) {
+                num_recorders = std::max(num_recorders, 2u);
+            }
+
+            if (!create_recorders(state, frame, num_recorders)) {
+                LOG_ERROR("failed to create command recorders");
+                return false;
+            }
+
             // allocate per frame ubo data
             auto buffer = scene.memory_->create_shared_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(cbPerFrame));
             if (!buffer) {
@@ -2361,6 +6586,292 @@ public:
             per_frame_write_set.pBufferInfo = &per_frame_buffer_desc;
 
             state.dispatch().updateDescriptorSets(1, &per_frame_write_set, 0, nullptr);
+
+            if (scene.indirect_draws_ && !create_cull_data(state, scene, frame)) {
+                LOG_ERROR("failed to create gpu culling buffers");
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // the lod table starts out empty and every object slot at the full mesh, the cluster table is filled as
+    // meshes are created
+    static bool create_mesh_tables(SceneState &scene) {
+        auto mesh_lods = scene.memory_->create_shared_buffer(
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(MeshLod) * kMaxStaticMeshes * kMaxMeshLods);
+        auto object_lods =
+            scene.memory_->create_shared_buffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * kMaxObjects);
+        auto mesh_clusters = scene.memory_->create_shared_buffer(
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(MeshCluster) * kMaxMeshClusters);
+
+        if (!mesh_lods || !object_lods || !mesh_clusters) {
+            LOG_ERROR("failed to allocate level of detail and cluster buffers");
+            return false;
+        }
+
+        memset(mesh_lods->alloc_info().pMappedData, 0, sizeof(MeshLod) * kMaxStaticMeshes * kMaxMeshLods);
+        memset(object_lods->alloc_info().pMappedData, 0, sizeof(uint32_t) * kMaxObjects);
+
+        if (!mesh_lods->flush() || !object_lods->flush()) {
+            return false;
+        }
+
+        scene.mesh_lods_ = std::move(*mesh_lods);
+        scene.object_lods_ = std::move(*object_lods);
+        scene.mesh_clusters_ = std::move(*mesh_clusters);
+        return true;
+    }
+
+    // compute pipelines culling every object slot, and the clusters of the objects drawn with a clustered full
+    // mesh, into indirect commands. commands are compacted when draw counts can be read from a buffer
+    static bool create_cull_pipeline(ProgramState &state, SceneState &scene) {
+        const auto *cull_shader = scene.shaders_->get("cull.spv");
+        const auto *cluster_shader = scene.shaders_->get("cluster_cull.spv");
+        if (!cull_shader || !cluster_shader) {
+            LOG_ERROR("failed to load the cull shaders");
+            return false;
+        }
+
+        scene.cull_set_layout_ =
+            scene.shaders_->descriptor_set_layout(ShaderLibrary::reflect_set({cull_shader, cluster_shader}, 0));
+        if (scene.cull_set_layout_ == VK_NULL_HANDLE) {
+            LOG_ERROR("failed to create layout of the cull descriptor set");
+            return false;
+        }
+
+        scene.cull_pipeline_layout_ = scene.shaders_->pipeline_layout(
+            {scene.cull_set_layout_}, ShaderLibrary::reflect_push_constants({cull_shader, cluster_shader}));
+        if (scene.cull_pipeline_layout_ == VK_NULL_HANDLE) {
+            LOG_ERROR("failed to create cull pipeline layout");
+            return false;
+        }
+
+        std::array<VkPipeline, 2> pipelines = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+        bool compiled = compile_cull_pipelines(state, scene, pipelines);
+        scene.cull_pipeline_ = pipelines[0];
+        scene.cluster_cull_pipeline_ = pipelines[1];
+        return compiled;
+    }
+
+    // the cull pipelines with the layout already created, from the current cull shaders
+    static bool compile_cull_pipelines(ProgramState &state, SceneState &scene, std::array<VkPipeline, 2> &pipelines) {
+        const auto *cull_shader = scene.shaders_->get("cull.spv");
+        const auto *cluster_shader = scene.shaders_->get("cluster_cull.spv");
+        if (!cull_shader || !cluster_shader) {
+            LOG_ERROR("failed to load the cull shaders");
+            return false;
+        }
+
+        // each shader reads the constants it declares
+        struct {
+            VkBool32 compact;
+            uint32_t max_mesh_lods;
+            uint32_t max_cluster_commands;
+        } specialization = {state.draw_indexed_indirect_count() ? VK_TRUE : VK_FALSE,
+            static_cast<uint32_t>(kMaxMeshLods), static_cast<uint32_t>(kMaxClusterCommands)};
+
+        std::array<VkSpecializationMapEntry, 3> specialization_entries = {
+            VkSpecializationMapEntry{0, offsetof(decltype(specialization), compact), sizeof(VkBool32)},
+            VkSpecializationMapEntry{1, offsetof(decltype(specialization), max_mesh_lods), sizeof(uint32_t)},
+            VkSpecializationMapEntry{2, offsetof(decltype(specialization), max_cluster_commands), sizeof(uint32_t)},
+        };
+
+        VkSpecializationInfo specialization_info = {};
+        specialization_info.mapEntryCount = static_cast<uint32_t>(specialization_entries.size());
+        specialization_info.pMapEntries = specialization_entries.data();
+        specialization_info.dataSize = sizeof(specialization);
+        specialization_info.pData = &specialization;
+
+        std::array<VkComputePipelineCreateInfo, 2> create_infos = {};
+        std::array<VkShaderModule, 2> modules = {cull_shader->module, cluster_shader->module};
+        for (size_t i = 0; i < create_infos.size(); ++i) {
+            create_infos[i].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            create_infos[i].stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            create_infos[i].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+            create_infos[i].stage.module = modules[i];
+            create_infos[i].stage.pName = "main";
+            create_infos[i].stage.pSpecializationInfo = &specialization_info;
+            create_infos[i].layout = scene.cull_pipeline_layout_;
+        }
+
+        VkResult res = state.dispatch().createComputePipelines(state.pipeline_cache(),
+            static_cast<uint32_t>(create_infos.size()), create_infos.data(), nullptr, pipelines.data());
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to create cull pipelines: %s", string_VkResult(res));
+            return false;
+        }
+
+        return true;
+    }
+
+    // cull input is written by the host every frame, commands, counts and deferred objects only ever by the cull
+    // pass. the depth pyramid is bound once it is created
+    static bool create_cull_data(ProgramState &state, SceneState &scene, FrameSubmitData &frame) {
+        auto cull_objects =
+            scene.memory_->create_shared_buffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(CullObject) * kMaxObjects);
+        auto draw_commands = scene.memory_->create_device_buffer(
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            sizeof(VkDrawIndexedIndirectCommand) * kMaxObjects * 2);
+        auto draw_counts = scene.memory_->create_device_buffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                                   VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                                   VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            sizeof(uint32_t) * kMaxObjects * 4);
+        auto deferred_objects =
+            scene.memory_->create_device_buffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * kMaxObjects);
+        auto cull_view = scene.memory_->create_shared_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(cbCullView));
+        auto expanded_objects = scene.memory_->create_device_buffer(
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * kMaxObjects * 2);
+        auto cluster_commands = scene.memory_->create_device_buffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                                        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                                        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            sizeof(VkDrawIndexedIndirectCommand) * kMaxClusterCommands * 2);
+        auto cluster_dispatch = scene.memory_->create_device_buffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                                        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                                        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            sizeof(VkDispatchIndirectCommand) * 2);
+
+        if (!cull_objects || !draw_commands || !draw_counts || !deferred_objects || !cull_view || !expanded_objects ||
+            !cluster_commands || !cluster_dispatch) {
+            LOG_ERROR("failed to allocate cull buffers");
+            return false;
+        }
+
+        frame.cull_objects_ = std::move(*cull_objects);
+        frame.draw_commands_ = std::move(*draw_commands);
+        frame.draw_counts_ = std::move(*draw_counts);
+        frame.deferred_objects_ = std::move(*deferred_objects);
+        frame.cull_view_ = std::move(*cull_view);
+        frame.expanded_objects_ = std::move(*expanded_objects);
+        frame.cluster_commands_ = std::move(*cluster_commands);
+        frame.cluster_dispatch_ = std::move(*cluster_dispatch);
+
+        VkDescriptorSetAllocateInfo set_alloc_info = {};
+        set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        set_alloc_info.descriptorPool = scene.descriptor_pool_;
+        set_alloc_info.descriptorSetCount = 1;
+        set_alloc_info.pSetLayouts = &scene.cull_set_layout_;
+
+        VkResult res = state.dispatch().allocateDescriptorSets(&set_alloc_info, &frame.cull_set_);
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to allocate cull descriptor set: %s", string_VkResult(res));
+            return false;
+        }
+
+        // binding 5 is the depth pyramid, written once it exists
+        std::array<VkDescriptorBufferInfo, 11> buffer_descs = {
+            VkDescriptorBufferInfo{frame.cull_objects_.buffer(), 0, VK_WHOLE_SIZE},
+            VkDescriptorBufferInfo{frame.draw_commands_.buffer(), 0, VK_WHOLE_SIZE},
+            VkDescriptorBufferInfo{frame.draw_counts_.buffer(), 0, VK_WHOLE_SIZE},
+            VkDescriptorBufferInfo{frame.deferred_objects_.buffer(), 0, VK_WHOLE_SIZE},
+            VkDescriptorBufferInfo{frame.cull_view_.buffer(), 0, sizeof(cbCullView)},
+            VkDescriptorBufferInfo{scene.mesh_lods_.buffer(), 0, VK_WHOLE_SIZE},
+            VkDescriptorBufferInfo{scene.object_lods_.buffer(), 0, VK_WHOLE_SIZE},
+            VkDescriptorBufferInfo{scene.mesh_clusters_.buffer(), 0, VK_WHOLE_SIZE},
+            VkDescriptorBufferInfo{frame.expanded_objects_.buffer(), 0, VK_WHOLE_SIZE},
+            VkDescriptorBufferInfo{frame.cluster_commands_.buffer(), 0, VK_WHOLE_SIZE},
+            VkDescriptorBufferInfo{frame.cluster_dispatch_.buffer(), 0, VK_WHOLE_SIZE},
+        };
+
+        std::array<VkWriteDescriptorSet, 11> write_sets = {};
+        for (uint32_t i = 0; i < write_sets.size(); ++i) {
+            write_sets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_sets[i].dstBinding = i < 5 ? i : i + 1;
+            write_sets[i].dstSet = frame.cull_set_;
+            write_sets[i].descriptorCount = 1;
+            write_sets[i].descriptorType =
+                i == 4 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_sets[i].pBufferInfo = &buffer_descs[i];
+        }
+
+        state.dispatch().updateDescriptorSets(static_cast<uint32_t>(write_sets.size()), write_sets.data(), 0, nullptr);
+        return true;
+    }
+
+    // compute pipeline reducing depth into one pyramid level, with a descriptor set for every level it can have
+    static bool create_pyramid_pipeline(ProgramState &state, SceneState &scene) {
+        const auto *pyramid_shader = scene.shaders_->get("depth_pyramid.spv");
+        if (!pyramid_shader) {
+            LOG_ERROR("failed to load the depth pyramid shader");
+            return false;
+        }
+
+        scene.pyramid_set_layout_ =
+            scene.shaders_->descriptor_set_layout(ShaderLibrary::reflect_set({pyramid_shader}, 0));
+        if (scene.pyramid_set_layout_ == VK_NULL_HANDLE) {
+            LOG_ERROR("failed to create layout of the depth pyramid descriptor set");
+            return false;
+        }
+
+        scene.pyramid_pipeline_layout_ = scene.shaders_->pipeline_layout(
+            {scene.pyramid_set_layout_}, ShaderLibrary::reflect_push_constants({pyramid_shader}));
+        if (scene.pyramid_pipeline_layout_ == VK_NULL_HANDLE) {
+            LOG_ERROR("failed to create depth pyramid pipeline layout");
+            return false;
+        }
+
+        if (!compile_pyramid_pipeline(state, scene, scene.pyramid_pipeline_)) {
+            return false;
+        }
+
+        // pyramid levels are read texel by texel
+        VkSamplerCreateInfo sampler_desc = {};
+        sampler_desc.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        sampler_desc.magFilter = VK_FILTER_NEAREST;
+        sampler_desc.minFilter = VK_FILTER_NEAREST;
+        sampler_desc.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        sampler_desc.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_desc.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_desc.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_desc.maxLod = VK_LOD_CLAMP_NONE;
+
+        scene.depth_sampler_ = scene.sampler_cache_->acquire(sampler_desc);
+        if (scene.depth_sampler_ == VK_NULL_HANDLE) {
+            LOG_ERROR("failed to acquire depth pyramid sampler");
+            return false;
+        }
+
+        std::array<VkDescriptorSetLayout, kMaxPyramidLevels> set_layouts;
+        set_layouts.fill(scene.pyramid_set_layout_);
+
+        VkDescriptorSetAllocateInfo set_alloc_info = {};
+        set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        set_alloc_info.descriptorPool = scene.descriptor_pool_;
+        set_alloc_info.descriptorSetCount = kMaxPyramidLevels;
+        set_alloc_info.pSetLayouts = set_layouts.data();
+
+        VkResult res = state.dispatch().allocateDescriptorSets(&set_alloc_info, scene.pyramid_sets_.data());
+        if (VK_SUCCESS != res) {
+            LOG_ERROR("failed to allocate depth pyramid descriptor sets: %s", string_VkResult(res));
+            return false;
+        }
+
+        return true;
+    }
+
+    // the depth pyramid pipeline with the layout already created, from the current shader
+    static bool compile_pyramid_pipeline(ProgramState &state, SceneState &scene, VkPipeline &pipeline) {
+        const auto *pyramid_shader = scene.shaders_->get("depth_pyramid.spv");
+        if (!pyramid_shader) {
+            LOG_ERROR("failed to load the depth pyramid shader");
+            return false;
+        }
+
+        VkComputePipelineCreateInfo create_info = {};
+        create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        create_info.stage.module = pyramid_shader->module;
+        create_info.stage.pName = "main";
+        create_info.layout = scene.pyramid_pipeline_layout_;
+
+        VkResult res =
+            state.dispatch().createComputePipelines(state.pipeline_cache(), 1, &create_info, nullptr, &pipeline);
+        if (VK_SUCCESS != res) {
+            pipeline = VK_NULL_HANDLE;
+            LOG_ERROR("failed to create depth pyramid pipeline: %s", string_VkResult(res));
+            return false;
         }
 
         return true;
@@ -2378,11 +6889,22 @@ public:
         scene->memory_ = std::move(memory);
         LOG_INFO("initialized memory helper");
 
-        if (!create_render_pass(state, &scene->render_pass_)) {
+        scene->sampler_cache_ = SamplerCache::initialize(state);
+
+        // optional, the scene is drawn the same without it
+        scene->profiler_ = GpuProfiler::initialize(state, kFramesInFlight);
+
+        // with occlusion culling the scene is drawn in two passes, the first one is resumed after the second cull
+        if (!create_render_pass(state, true, !scene->indirect_draws_, &scene->render_pass_)) {
             LOG_ERROR("failed to create render pass");
             return {};
         }
 
+        if (scene->indirect_draws_ && !create_render_pass(state, false, true, &scene->resume_render_pass_)) {
+            LOG_ERROR("failed to create resume render pass");
+            return {};
+        }
+
         LOG_INFO("created render pass");
 
         if (!scene->create_framebuffers()) {
@@ -2392,6 +6914,8 @@ public:
 
         LOG_INFO("created the swapchain framebuffers");
 
+        scene->shaders_ = ShaderLibrary::initialize(state);
+
         if (!create_descriptor_data(state, *scene)) {
             LOG_ERROR("failed to initialize descriptor data");
             return {};
@@ -2404,13 +6928,64 @@ public:
             return {};
         }
 
-        if (!create_graphics_pipeline(
-                state, scene->pipeline_layout_, scene->render_pass_, 0, &scene->graphics_pipeline_)) {
-            LOG_ERROR("failed to create pipeline");
+        // variants specialize on the layout of the object records, allocate them first
+        if (!create_object_data(state, *scene, kFramesInFlight)) {
+            LOG_ERROR("failed to create object buffers");
             return {};
         }
 
-        LOG_INFO("created graphics pipeline");
+        LOG_INFO("created per-object uniform buffer");
+
+        scene->pipelines_ = PipelineManager::initialize(state, *scene->shaders_);
+
+        auto pipelines_start = std::chrono::steady_clock::now();
+
+        // the fallbacks are compiled in parallel and waited on, every other variant compiles in the background
+        std::array<PipelineManager::Desc, kVertexFormats> fallback_descs, atlas_fallback_descs;
+        for (size_t format = 0; format < kVertexFormats; ++format) {
+            fallback_descs[format] = scene->material_pipeline_desc(
+                false, RenderState::opaque(), ShaderFeatures::standard(), static_cast<VertexFormat>(format));
+            atlas_fallback_descs[format] = scene->material_pipeline_desc(
+                true, RenderState::opaque(), ShaderFeatures::standard(), static_cast<VertexFormat>(format));
+            scene->fallback_variants_[format] = scene->pipelines_->request(fallback_descs[format]);
+            scene->atlas_fallback_variants_[format] = scene->pipelines_->request(atlas_fallback_descs[format]);
+        }
+
+        for (size_t format = 0; format < kVertexFormats; ++format) {
+            if (scene->pipelines_->get(fallback_descs[format]) == VK_NULL_HANDLE) {
+                LOG_ERROR("failed to create pipeline");
+                return {};
+            }
+
+            if (scene->pipelines_->get(atlas_fallback_descs[format]) == VK_NULL_HANDLE) {
+                LOG_ERROR("failed to create atlas pipeline");
+                return {};
+            }
+        }
+
+        auto pipelines_ms =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pipelines_start).count();
+        LOG_INFO("created fallback pipelines in %.2f ms (%s pipeline cache)", pipelines_ms,
+            state.pipeline_cache_warm() ? "warm" : "cold");
+
+        if (scene->indirect_draws_) {
+            if (!create_cull_pipeline(state, *scene)) {
+                LOG_ERROR("failed to create cull pipeline");
+                return {};
+            }
+
+            if (!create_pyramid_pipeline(state, *scene)) {
+                LOG_ERROR("failed to create depth pyramid pipeline");
+                return {};
+            }
+
+            if (!create_mesh_tables(*scene)) {
+                LOG_ERROR("failed to create level of detail and cluster tables");
+                return {};
+            }
+
+            LOG_INFO("created cull pipelines");
+        }
 
         if (!create_command_pool(
                 state, state.device().get_queue_index(vkb::QueueType::graphics).value(), &scene->command_pool_)) {
@@ -2420,13 +6995,6 @@ public:
 
         LOG_INFO("created command pool");
 
-        if (!create_object_data(state, *scene, kFramesInFlight)) {
-            LOG_ERROR("failed to create object buffers");
-            return {};
-        }
-
-        LOG_INFO("created per-object uniform buffer");
-
         if (!create_frame_data(state, *scene, kFramesInFlight)) {
             LOG_ERROR("failed to create frame submission data");
             return {};
@@ -2434,10 +7002,161 @@ public:
 
         LOG_INFO("created frame submission data");
 
+        if (scene->indirect_draws_ && !scene->create_depth_pyramid()) {
+            LOG_ERROR("failed to create depth pyramid");
+            return {};
+        }
+
         return scene;
     }
 };
 
+#if defined(SHADER_HOT_RELOAD)
+// dev mode, recompiles shader sources with glslc when they are saved and rebuilds the affected pipeline variants on
+// the worker pool and the affected compute pipelines at the next frame boundary. the scene keeps drawing with the old
+// pipelines until the new ones are swapped in
+struct ShaderReloader final {
+private:
+    using Bytecode = std::optional<std::vector<uint8_t>>;
+
+    struct Compile {
+        std::string asset; // name of the compiled shader, e.g. fragment.spv
+        std::future<Bytecode> result;
+    };
+
+    ProgramState &state_;
+    SceneState &scene_;
+    std::unique_ptr<FileWatcher> watcher_;
+    std::deque<Compile> compiles_;
+    uint32_t serial_;
+
+    ShaderReloader(ProgramState &state, SceneState &scene, std::unique_ptr<FileWatcher> &&watcher)
+        : state_{state}, scene_{scene}, watcher_{std::move(watcher)}, serial_{0} {}
+
+    static const char *glslc_stage(VkShaderStageFlagBits stage) {
+        switch (stage) {
+        case VK_SHADER_STAGE_VERTEX_BIT:
+            return "vertex";
+        case VK_SHADER_STAGE_FRAGMENT_BIT:
+            return "fragment";
+        case VK_SHADER_STAGE_COMPUTE_BIT:
+            return "compute";
+        default:
+            return nullptr;
+        }
+    }
+
+    // runs on a worker thread, glslc reports its own errors
+    static Bytecode compile(const std::filesystem::path &source, const char *stage, uint32_t serial) {
+        auto output = std::filesystem::temp_directory_path() /
+                      (source.stem().string() + "." + std::to_string(serial) + ".spv");
+
+        std::string command = std::string("glslc -fshader-stage=") + stage + " \"" + source.string() + "\" -o \"" +
+                              output.string() + "\"";
+
+        if (std::system(command.c_str()) != 0) {
+            LOG_ERROR("failed to compile %s", source.string().c_str());
+            return {};
+        }
+
+        std::ifstream file{output, std::ios::binary};
+        std::vector<uint8_t> code{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        file.close();
+
+        std::error_code ec;
+        std::filesystem::remove(output, ec);
+
+        if (code.empty()) {
+            LOG_ERROR("glslc produced no output for %s", source.string().c_str());
+            return {};
+        }
+
+        return code;
+    }
+
+    void queue(const std::string &file_name) {
+        auto source = watcher_->directory() / file_name;
+        if (source.extension() != ".glsl") {
+            return;
+        }
+
+        // sources that no pipeline has loaded yet are picked up when they are first used
+        auto asset = source.stem().string() + ".spv";
+        const auto *shader = scene_.shaders().find(asset);
+        if (!shader) {
+            return;
+        }
+
+        const char *stage = glslc_stage(shader->reflection.stage);
+        if (!stage) {
+            return;
+        }
+
+        auto task = std::make_shared<std::packaged_task<Bytecode()>>(
+            [source, stage, serial = serial_++]() { return compile(source, stage, serial); });
+
+        compiles_.push_back(Compile{asset, task->get_future()});
+        state_.jobs().submit([task]() { (*task)(); });
+
+        LOG_INFO("%s changed, recompiling", file_name.c_str());
+    }
+
+public:
+    ShaderReloader(const ShaderReloader &) = delete;
+    ShaderReloader &operator=(const ShaderReloader &) = delete;
+
+    ~ShaderReloader() {
+        for (auto &compile : compiles_) {
+            compile.result.wait();
+        }
+    }
+
+    // called once per frame before drawing, never blocks on a compile
+    void update() {
+        for (const auto &file_name : watcher_->poll()) {
+            queue(file_name);
+        }
+
+        // compiles finish in any order, apply them in the order the files were saved
+        while (!compiles_.empty() &&
+               compiles_.front().result.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            auto asset = std::move(compiles_.front().asset);
+            auto code = compiles_.front().result.get();
+            compiles_.pop_front();
+
+            if (!code) {
+                continue;
+            }
+
+            VkShaderModule old_module = scene_.shaders().reload(asset.c_str(), *code);
+            if (old_module == VK_NULL_HANDLE) {
+                LOG_ERROR("failed to reload %s, keeping the previous version", asset.c_str());
+                continue;
+            }
+
+            // compute shaders are not part of any variant, the scene rebuilds their pipelines itself
+            size_t rebuilt = scene_.pipelines().rebuild(old_module, scene_.shaders().find(asset)->module);
+            size_t rebuilt_compute = scene_.rebuild_compute_pipelines(asset);
+            LOG_INFO("reloaded %s, rebuilding %zu pipeline variants and %zu compute pipelines", asset.c_str(), rebuilt,
+                rebuilt_compute);
+        }
+    }
+
+    static std::unique_ptr<ShaderReloader> initialize(
+        ProgramState &state, SceneState &scene, const std::filesystem::path &source_dir) {
+        std::string error;
+        auto watcher = FileWatcher::open(source_dir, error);
+        if (!watcher) {
+            LOG_ERROR("failed to watch shader sources: %s", error.c_str());
+            return {};
+        }
+
+        LOG_INFO("watching %s for shader changes", source_dir.string().c_str());
+        return std::unique_ptr<ShaderReloader>{new ShaderReloader(state, scene, std::move(watcher))};
+    }
+};
+#endif
+
 struct VulkanSample final {
 private:
     using Clock = std::chrono::high_resolution_clock;
@@ -2451,6 +7170,9 @@ private:
     SceneState::StaticMesh::Id cube_mesh_;
     SceneState::SceneObject::Id cube_object_, test_object_;
 
+    // objects whose mesh is still loading, with that mesh
+    std::vector<std::pair<SceneState::SceneObject::Id, SceneState::StaticMesh::Id>> loading_objects_;
+
     cbPerFrame per_frame_;
     Clock::time_point last_time_;
     float time_elapsed_;
@@ -2482,6 +7204,8 @@ public:
 
         time_elapsed_ = time_elapsed_ + delta_time;
 
+        fit_loaded_objects();
+
         // animate objects
         scene_.with_object(cube_object_, [&](SceneState::SceneObject &object) {
             object.set_rotation(glm::angleAxis(time_elapsed_ * +0.5f * glm::pi<float>(), glm::fvec3{0.0f, 1.0f, 0.0f}));
@@ -2594,11 +7318,62 @@ return Geometry{
         // clang-format on
     }
 
-    static std::unique_ptr<VulkanSample> initialize(ProgramState &state, SceneState &scene) {
+    // every mesh file is placed in a row behind the cubes. the files load while the sample runs, objects are fitted
+    // into a unit sphere once their mesh is resident
+    void load_meshes(const std::vector<std::string> &paths) {
+        for (size_t i = 0; i < paths.size(); ++i) {
+            auto mesh = scene_.load_static_mesh(paths[i]);
+            if (!mesh.valid()) {
+                continue;
+            }
+
+            auto object = scene_.create_scene_object();
+            scene_.with_object(object, [&](SceneState::SceneObject &mesh_object) {
+                float x = (static_cast<float>(i) - static_cast<float>(paths.size() - 1) * 0.5f) * 2.5f;
+                mesh_object.set_translation(glm::fvec3{x, 0.0f, -3.0f});
+                mesh_object.set_mesh_id(mesh);
+                mesh_object.set_material_id(material_);
+            });
+
+            loading_objects_.emplace_back(object, mesh);
+        }
+    }
+
+    void fit_loaded_objects() {
+        auto fitted = [&](const std::pair<SceneState::SceneObject::Id, SceneState::StaticMesh::Id> &loading) {
+            if (!scene_.resident(loading.second)) {
+                return false;
+            }
+
+            scene_.with_static_mesh(loading.second, [&](const SceneState::StaticMesh &mesh) {
+                const auto &bounds = mesh.bounds();
+                float scale = 1.0f / std::max(bounds.radius, 1e-6f);
+
+                scene_.with_object(loading.first, [&](SceneState::SceneObject &object) {
+                    object.set_translation(object.translation() - bounds.center * scale);
+                    object.set_scale(glm::fvec3{scale});
+                });
+            });
+
+            return true;
+        };
+
+        loading_objects_.erase(
+            std::remove_if(loading_objects_.begin(), loading_objects_.end(), fitted), loading_objects_.end());
+    }
+
+    static std::unique_ptr<VulkanSample> initialize(
+        ProgramState &state, SceneState &scene, const std::vector<std::string> &mesh_paths) {
         std::unique_ptr<VulkanSample> sample{new VulkanSample(state, scene)};
 
         // load material
-        auto bitmap = load_png(kBricks_png.data(), kBricks_png.size());
+        auto bricks = state.load_asset("bricks.png").get();
+        if (!bricks.valid()) {
+            LOG_ERROR("missing asset bricks.png");
+            return {};
+        }
+
+        auto bitmap = load_png(bricks.data(), bricks.size());
         if (!bitmap) {
             LOG_ERROR("failed to load png image bricks.png");
             return {};
@@ -2640,6 +7415,8 @@ return Geometry{
         sample->cube_object_ = cube_object;
         sample->test_object_ = test_object;
 
+        sample->load_meshes(mesh_paths);
+
         return sample;
     }
 };
@@ -2652,8 +7429,12 @@ int main(int argc, char **argv) {
     LOG_INFO("using backend glfw");
     auto window = glfwCreateWindow(1366, 768, "minimal sample", nullptr, nullptr);
 
-    // init vk
-    auto program_state = ProgramState::initialize(window);
+    auto startup_start = std::chrono::steady_clock::now();
+
+    // init vk, assets.pak and the pipeline cache live next to the executable
+    auto executable_dir = std::filesystem::path{argv[0]}.parent_path();
+    auto program_state = ProgramState::initialize(
+        window, (executable_dir / "assets.pak").string(), (executable_dir / "pipeline_cache.bin").string());
 
     if (!program_state) {
         LOG_ERROR("fatal initialization error, halting");
@@ -2667,17 +7448,45 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
-    auto sample = VulkanSample::initialize(*program_state, *scene_state);
+    // every argument is a mesh file written by convert_mesh, --profile-batches times every material batch on the gpu
+    std::vector<std::string> mesh_paths;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string{argv[i]} == "--profile-batches") {
+            if (scene_state->profiler()) {
+                scene_state->profiler()->set_batch_scopes(true);
+            }
+        } else {
+            mesh_paths.push_back(argv[i]);
+        }
+    }
+
+    auto sample = VulkanSample::initialize(*program_state, *scene_state, mesh_paths);
 
     if (!sample) {
         LOG_ERROR("fatal initialization error, halting");
         return EXIT_FAILURE;
     }
 
+    auto startup_ms =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startup_start).count();
+    LOG_INFO("startup took %.2f ms, %zu pipeline variants still compiling", startup_ms,
+        scene_state->pipelines().pending());
+
+#if defined(SHADER_HOT_RELOAD)
+    // a missing source directory only disables reloading
+    auto shader_reloader = ShaderReloader::initialize(*program_state, *scene_state, SHADER_SOURCE_DIR);
+#endif
+
     // event loop of the window
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
 
+#if defined(SHADER_HOT_RELOAD)
+        if (shader_reloader) {
+            shader_reloader->update();
+        }
+#endif
+
         if (!scene_state->draw_frame([&](SceneState::FrameSubmitData &frame) -> VkResult {
             // allow the sample to record its command queue
             return sample->frame(frame);
@@ -2688,6 +7497,9 @@ int main(int argc, char **argv) {
     }
 
     // order of destruction is important here
+#if defined(SHADER_HOT_RELOAD)
+    shader_reloader.reset();
+#endif
     sample.reset();
     scene_state.reset();
     program_state.reset();
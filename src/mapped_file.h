@@ -0,0 +1,138 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// read only view of a whole file mapped into memory, pages are only loaded once they are touched
+class MappedFile final {
+private:
+    const uint8_t *base_;
+    size_t size_;
+
+#if defined(_WIN32)
+    HANDLE file_, mapping_;
+#else
+    int file_;
+#endif
+
+    MappedFile() : base_{nullptr}, size_{0} {
+#if defined(_WIN32)
+        file_ = INVALID_HANDLE_VALUE;
+        mapping_ = nullptr;
+#else
+        file_ = -1;
+#endif
+    }
+
+    bool map(const std::string &path, bool sequential, std::string &error) {
+#if defined(_WIN32)
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | (sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS), nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) {
+            error = "cannot open " + path;
+            return false;
+        }
+
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file_, &file_size) || file_size.QuadPart == 0) {
+            error = "cannot read size of " + path;
+            return false;
+        }
+
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_) {
+            error = "cannot create mapping of " + path;
+            return false;
+        }
+
+        base_ = static_cast<const uint8_t *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        size_ = static_cast<size_t>(file_size.QuadPart);
+#else
+        file_ = ::open(path.c_str(), O_RDONLY);
+        if (file_ < 0) {
+            error = "cannot open " + path;
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(file_, &st) != 0 || st.st_size == 0) {
+            error = "cannot read size of " + path;
+            return false;
+        }
+
+        void *ptr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, file_, 0);
+        if (ptr == MAP_FAILED) {
+            error = "cannot map " + path;
+            return false;
+        }
+
+        base_ = static_cast<const uint8_t *>(ptr);
+        size_ = static_cast<size_t>(st.st_size);
+
+        // whole file readers get the pages ahead of them read in
+        if (sequential) {
+            madvise(ptr, size_, MADV_SEQUENTIAL);
+        }
+#endif
+
+        if (!base_) {
+            error = "cannot map " + path;
+            return false;
+        }
+
+        return true;
+    }
+
+public:
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+#if defined(_WIN32)
+        if (base_) {
+            UnmapViewOfFile(base_);
+        }
+
+        if (mapping_) {
+            CloseHandle(mapping_);
+        }
+
+        if (file_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_);
+        }
+#else
+        if (base_) {
+            munmap(const_cast<uint8_t *>(base_), size_);
+        }
+
+        if (file_ >= 0) {
+            ::close(file_);
+        }
+#endif
+    }
+
+    const uint8_t *data() const { return base_; }
+    size_t size() const { return size_; }
+
+    // sequential files are expected to be read front to back once, the rest at random
+    static std::unique_ptr<MappedFile> open(const std::string &path, std::string &error, bool sequential = false) {
+        std::unique_ptr<MappedFile> file{new MappedFile()};
+        if (!file->map(path, sequential, error)) {
+            return {};
+        }
+
+        return file;
+    }
+};
@@ -0,0 +1,220 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "mesh_file.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "meshlet_builder.h"
+
+struct Vertex {
+    glm::fvec3 position;
+    glm::fvec3 normal;
+    glm::fvec2 uv;
+};
+
+struct Geometry {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// half the size of Vertex. positions are snorm16 inside the mesh bounds and are scaled back by the object record's
+// world matrix, normals are octahedral snorm16 and uvs half floats
+struct CompactVertex {
+    uint64_t position; // xyz snorm16, w unused
+    uint32_t normal;
+    uint32_t uv;
+
+    // uvs keep at least 10 bits below the point up to this magnitude
+    static constexpr float kMaxUv = 2.0f;
+
+    // every position on a flat axis is the center, the scale only has to stay away from zero
+    static glm::fvec3 scale_of(const glm::fvec3 &extents) { return glm::max(extents, glm::fvec3{1e-6f}); }
+
+    static CompactVertex of(const Vertex &vertex, const glm::fvec3 &center, const glm::fvec3 &scale) {
+        // fold the lower hemisphere over the diagonals of the upper one
+        float length = std::abs(vertex.normal.x) + std::abs(vertex.normal.y) + std::abs(vertex.normal.z);
+        glm::fvec3 n = vertex.normal / std::max(length, 1e-6f);
+        glm::fvec2 octahedral{n.x, n.y};
+        if (n.z < 0.0f) {
+            octahedral = (1.0f - glm::abs(glm::fvec2{n.y, n.x})) *
+                         glm::fvec2{n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f};
+        }
+
+        CompactVertex compact;
+        compact.position = glm::packSnorm4x16(glm::fvec4{(vertex.position - center) / scale, 0.0f});
+        compact.normal = glm::packSnorm2x16(octahedral);
+        compact.uv = glm::packHalf2x16(vertex.uv);
+        return compact;
+    }
+};
+
+static_assert(sizeof(Vertex) == 32, "vertex layout changed");
+static_assert(sizeof(CompactVertex) == 16, "compact vertex layout changed");
+
+// turns geometry into the streams a mesh is drawn from: a chain of simplified levels of detail, all reordered for the
+// vertex cache and overdraw, the full mesh split into meshlets, and the smallest vertex and index formats that hold
+// it. the sample runs it on meshes built in code, the mesh converter on everything it writes to mesh files
+class MeshBuilder final {
+public:
+    // owns the streams, streams() views them
+    struct Mesh {
+        MeshDesc desc;
+        std::vector<uint8_t> vertex_data;
+        std::vector<uint8_t> index_data;
+        std::vector<MeshLodRecord> lods;
+        std::vector<MeshletRecord> meshlets;
+
+        // vertex cache efficiency of the full mesh before and after reordering, and the vertices of the geometry
+        // before unused ones were dropped
+        MeshOptimizer::CacheStatistics cache_before;
+        MeshOptimizer::CacheStatistics cache_after;
+        size_t source_vertex_count;
+
+        MeshStreams streams() const {
+            return MeshStreams{desc, vertex_data.data(), index_data.data(), lods.data(), meshlets.data()};
+        }
+    };
+
+    static Mesh build(const Geometry &geometry, size_t max_lods, bool split_meshlets) {
+        Mesh mesh = {};
+        mesh.source_vertex_count = geometry.vertices.size();
+
+        // every level of detail is a range of the same index buffer over the same vertices
+        std::vector<Vertex> vertices = geometry.vertices;
+        std::vector<uint32_t> indices;
+        build_lods(geometry, max_lods, indices, mesh.lods);
+        optimize(vertices, indices, mesh);
+
+        if (split_meshlets) {
+            const auto &full = mesh.lods[0];
+            auto meshlets = MeshletBuilder::build(indices.data() + full.first_index, full.index_count,
+                vertices.data(), vertices.size(), sizeof(Vertex));
+
+            for (const auto &meshlet : meshlets) {
+                mesh.meshlets.push_back(MeshletRecord{full.first_index + meshlet.first_index, meshlet.index_count,
+                    {meshlet.center[0], meshlet.center[1], meshlet.center[2]}, meshlet.radius,
+                    {meshlet.cone_axis[0], meshlet.cone_axis[1], meshlet.cone_axis[2]}, meshlet.cone_cutoff});
+            }
+        }
+
+        encode(vertices, indices, mesh);
+
+        mesh.desc.lod_count = static_cast<uint32_t>(mesh.lods.size());
+        mesh.desc.meshlet_count = static_cast<uint32_t>(mesh.meshlets.size());
+        return mesh;
+    }
+
+private:
+    // simplifies the full mesh to half the triangles of the previous level until it stops getting much smaller or
+    // max_lods levels exist. the levels are appended to indices one after another
+    static void build_lods(const Geometry &geometry, size_t max_lods, std::vector<uint32_t> &indices,
+        std::vector<MeshLodRecord> &lods) {
+        indices = geometry.indices;
+        lods.push_back(MeshLodRecord{0, static_cast<uint32_t>(indices.size()), 0.0f, 0});
+
+        while (lods.size() < max_lods) {
+            size_t previous = lods.back().index_count;
+
+            float error = 0.0f;
+            auto simplified = MeshSimplifier::simplify(geometry.vertices.data(), geometry.vertices.size(),
+                sizeof(Vertex), geometry.indices, previous / 6 * 3, error);
+
+            if (simplified.empty() || simplified.size() * 5 > previous * 4) {
+                break;
+            }
+
+            // each level starts from the full mesh, keep the errors growing with the level anyway
+            lods.push_back(MeshLodRecord{static_cast<uint32_t>(indices.size()),
+                static_cast<uint32_t>(simplified.size()), std::max(error, lods.back().error), 0});
+            indices.insert(indices.end(), simplified.begin(), simplified.end());
+        }
+    }
+
+    // reorders the triangles of every level for the vertex cache and then for overdraw, and the vertices for the
+    // order all levels fetch them in. vertices no level uses are dropped
+    static void optimize(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices, Mesh &mesh) {
+        const auto &full = mesh.lods[0];
+        std::vector<uint32_t> range{indices.begin(), indices.begin() + full.index_count};
+        mesh.cache_before = MeshOptimizer::analyze_vertex_cache(range, vertices.size());
+
+        for (const auto &lod : mesh.lods) {
+            auto first = indices.begin() + lod.first_index;
+            range.assign(first, first + lod.index_count);
+
+            MeshOptimizer::optimize_vertex_cache(range, vertices.size());
+            MeshOptimizer::optimize_overdraw(range, vertices.data(), vertices.size(), sizeof(Vertex));
+            std::copy(range.begin(), range.end(), first);
+        }
+
+        range.assign(indices.begin(), indices.begin() + full.index_count);
+        mesh.cache_after = MeshOptimizer::analyze_vertex_cache(range, vertices.size());
+
+        MeshOptimizer::optimize_vertex_fetch(vertices, indices);
+    }
+
+    // meshes with up to 65536 vertices get 16 bit indices, meshes whose uvs fit half floats get compact vertices
+    // with positions quantized inside the mesh bounds
+    static void encode(const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices, Mesh &mesh) {
+        auto &desc = mesh.desc;
+
+        glm::fvec3 min{0.0f}, max{0.0f};
+        if (!vertices.empty()) {
+            min = max = vertices[0].position;
+        }
+
+        for (const auto &vertex : vertices) {
+            min = glm::min(min, vertex.position);
+            max = glm::max(max, vertex.position);
+        }
+
+        glm::fvec3 center = (min + max) * 0.5f, extents = (max - min) * 0.5f;
+        float radius = 0.0f;
+        for (const auto &vertex : vertices) {
+            radius = std::max(radius, glm::length(vertex.position - center));
+        }
+
+        memcpy(desc.center, &center[0], sizeof(desc.center));
+        memcpy(desc.extents, &extents[0], sizeof(desc.extents));
+        desc.radius = radius;
+
+        bool compact = std::all_of(vertices.begin(), vertices.end(), [](const Vertex &vertex) {
+            return std::abs(vertex.uv.x) <= CompactVertex::kMaxUv && std::abs(vertex.uv.y) <= CompactVertex::kMaxUv;
+        });
+
+        desc.vertex_format = compact ? VertexFormat::Compact : VertexFormat::Standard;
+        desc.index_size = vertices.size() <= UINT16_MAX + 1 ? 2 : 4;
+        desc.vertex_count = static_cast<uint32_t>(vertices.size());
+        desc.index_count = static_cast<uint32_t>(indices.size());
+
+        if (compact) {
+            glm::fvec3 scale = CompactVertex::scale_of(extents);
+            mesh.vertex_data.resize(sizeof(CompactVertex) * vertices.size());
+            auto *compact_vertices = reinterpret_cast<CompactVertex *>(mesh.vertex_data.data());
+            for (size_t i = 0; i < vertices.size(); ++i) {
+                compact_vertices[i] = CompactVertex::of(vertices[i], center, scale);
+            }
+        } else {
+            mesh.vertex_data.resize(sizeof(Vertex) * vertices.size());
+            memcpy(mesh.vertex_data.data(), vertices.data(), mesh.vertex_data.size());
+        }
+
+        if (desc.index_size == 2) {
+            mesh.index_data.resize(sizeof(uint16_t) * indices.size());
+            auto *short_indices = reinterpret_cast<uint16_t *>(mesh.index_data.data());
+            for (size_t i = 0; i < indices.size(); ++i) {
+                short_indices[i] = static_cast<uint16_t>(indices[i]);
+            }
+        } else {
+            mesh.index_data.resize(sizeof(uint32_t) * indices.size());
+            memcpy(mesh.index_data.data(), indices.data(), mesh.index_data.size());
+        }
+    }
+};
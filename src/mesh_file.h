@@ -0,0 +1,237 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "mapped_file.h"
+
+// vertex layouts meshes are stored and drawn in, 32 byte Vertex and 16 byte CompactVertex
+enum class VertexFormat : uint32_t { Standard = 0, Compact = 1 };
+
+inline uint32_t vertex_stride(VertexFormat format) { return format == VertexFormat::Compact ? 16 : 32; }
+
+// on disk layout: MeshFileHeader, then the vertex stream, the index stream, the lod table and the meshlet table,
+// each starting on a kMeshAlignment boundary. streams are stored exactly as the gpu reads them, so the mapped bytes
+// are copied into the staging buffer as they are
+constexpr uint32_t kMeshMagic = 0x534d564b; // "KVMS"
+constexpr uint32_t kMeshVersion = 1;
+constexpr uint64_t kMeshAlignment = 16;
+
+// what the streams of one mesh hold, shared by meshes built at runtime and meshes read from a file
+struct MeshDesc {
+    VertexFormat vertex_format;
+    uint32_t index_size; // 2 or 4 bytes
+    uint32_t vertex_count;
+    uint32_t index_count; // of all levels of detail together
+    uint32_t lod_count;
+    uint32_t meshlet_count; // 0 when the full mesh is not split
+
+    // box and sphere around the vertices sharing one center, compact positions are quantized inside the box
+    float center[3];
+    float extents[3];
+    float radius;
+    uint32_t reserved;
+};
+
+// index range of one level of detail, error is how far its surface strays from the full mesh in mesh units
+struct MeshLodRecord {
+    uint32_t first_index;
+    uint32_t index_count;
+    float error;
+    uint32_t reserved;
+};
+
+// index range of one meshlet of the full mesh and its bounds in mesh units, see MeshletBuilder::Meshlet
+struct MeshletRecord {
+    uint32_t first_index;
+    uint32_t index_count;
+    float center[3];
+    float radius;
+    float cone_axis[3];
+    float cone_cutoff;
+};
+
+struct MeshFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    MeshDesc desc;
+    uint64_t vertex_offset; // from the start of the file
+    uint64_t index_offset;
+    uint64_t lod_offset;
+    uint64_t meshlet_offset;
+};
+
+static_assert(sizeof(MeshDesc) == 56, "mesh description layout changed");
+static_assert(sizeof(MeshLodRecord) == 16, "mesh lod layout changed");
+static_assert(sizeof(MeshletRecord) == 40, "meshlet layout changed");
+static_assert(sizeof(MeshFileHeader) == 96, "mesh file header layout changed");
+
+// non-owning view of the streams of one mesh, valid for the lifetime of whatever provided it
+struct MeshStreams {
+    MeshDesc desc;
+    const uint8_t *vertices;
+    const uint8_t *indices;
+    const MeshLodRecord *lods;
+    const MeshletRecord *meshlets;
+
+    size_t vertex_bytes() const { return size_t{desc.vertex_count} * vertex_stride(desc.vertex_format); }
+    size_t index_bytes() const { return size_t{desc.index_count} * desc.index_size; }
+};
+
+// mesh read from a mapped file, the streams point into the mapping
+class MeshFile final {
+private:
+    std::unique_ptr<MappedFile> file_;
+    MeshStreams streams_;
+
+    MeshFile() : streams_{} {}
+
+    static uint64_t align_up(uint64_t value) { return (value + kMeshAlignment - 1) / kMeshAlignment * kMeshAlignment; }
+
+public:
+    MeshFile(const MeshFile &) = delete;
+    MeshFile &operator=(const MeshFile &) = delete;
+
+    const MeshStreams &streams() const { return streams_; }
+
+    // checks every table and range against the bytes without touching the streams, so only the header and the
+    // tables are paged in. index values are trusted, the converter wrote them
+    static bool parse(const uint8_t *data, size_t size, MeshStreams &streams, std::string &error) {
+        if (size < sizeof(MeshFileHeader)) {
+            error = "truncated mesh header";
+            return false;
+        }
+
+        MeshFileHeader header;
+        memcpy(&header, data, sizeof(header));
+
+        if (header.magic != kMeshMagic || header.version != kMeshVersion) {
+            error = "not a mesh file or unsupported version";
+            return false;
+        }
+
+        const auto &desc = header.desc;
+        if (desc.vertex_format != VertexFormat::Standard && desc.vertex_format != VertexFormat::Compact) {
+            error = "unknown vertex format";
+            return false;
+        }
+
+        if ((desc.index_size != 2 && desc.index_size != 4) || desc.index_count % 3 != 0 || desc.lod_count == 0) {
+            error = "malformed index stream";
+            return false;
+        }
+
+        streams = MeshStreams{};
+        streams.desc = desc;
+
+        auto inside = [&](uint64_t offset, uint64_t bytes) {
+            return offset % kMeshAlignment == 0 && offset <= size && bytes <= size - offset;
+        };
+
+        if (!inside(header.vertex_offset, streams.vertex_bytes()) ||
+            !inside(header.index_offset, streams.index_bytes()) ||
+            !inside(header.lod_offset, uint64_t{desc.lod_count} * sizeof(MeshLodRecord)) ||
+            !inside(header.meshlet_offset, uint64_t{desc.meshlet_count} * sizeof(MeshletRecord))) {
+            error = "stream out of bounds";
+            return false;
+        }
+
+        streams.vertices = data + header.vertex_offset;
+        streams.indices = data + header.index_offset;
+        streams.lods = reinterpret_cast<const MeshLodRecord *>(data + header.lod_offset);
+        streams.meshlets = reinterpret_cast<const MeshletRecord *>(data + header.meshlet_offset);
+
+        auto in_indices = [&](uint32_t first, uint32_t count) {
+            return first % 3 == 0 && count % 3 == 0 && uint64_t{first} + count <= desc.index_count;
+        };
+
+        for (uint32_t i = 0; i < desc.lod_count; ++i) {
+            if (!in_indices(streams.lods[i].first_index, streams.lods[i].index_count)) {
+                error = "level of detail " + std::to_string(i) + " is out of bounds";
+                return false;
+            }
+        }
+
+        for (uint32_t i = 0; i < desc.meshlet_count; ++i) {
+            if (!in_indices(streams.meshlets[i].first_index, streams.meshlets[i].index_count)) {
+                error = "meshlet " + std::to_string(i) + " is out of bounds";
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static std::unique_ptr<MeshFile> open(const std::string &path, std::string &error) {
+        std::unique_ptr<MeshFile> mesh{new MeshFile()};
+
+        // the streams are read front to back once, on their way into the staging buffer
+        mesh->file_ = MappedFile::open(path, error, /* sequential */ true);
+        if (!mesh->file_ || !parse(mesh->file_->data(), mesh->file_->size(), mesh->streams_, error)) {
+            return {};
+        }
+
+        return mesh;
+    }
+
+    // writes next to the output and renames, a running sample may have the old file mapped
+    static bool write(const std::string &path, const MeshStreams &streams, std::string &error) {
+        MeshFileHeader header = {};
+        header.magic = kMeshMagic;
+        header.version = kMeshVersion;
+        header.desc = streams.desc;
+        header.vertex_offset = align_up(sizeof(MeshFileHeader));
+        header.index_offset = align_up(header.vertex_offset + streams.vertex_bytes());
+        header.lod_offset = align_up(header.index_offset + streams.index_bytes());
+        header.meshlet_offset = align_up(header.lod_offset + sizeof(MeshLodRecord) * streams.desc.lod_count);
+
+        struct Section {
+            uint64_t offset;
+            const void *data;
+            size_t size;
+        };
+
+        Section sections[] = {
+            {0, &header, sizeof(header)},
+            {header.vertex_offset, streams.vertices, streams.vertex_bytes()},
+            {header.index_offset, streams.indices, streams.index_bytes()},
+            {header.lod_offset, streams.lods, sizeof(MeshLodRecord) * streams.desc.lod_count},
+            {header.meshlet_offset, streams.meshlets, sizeof(MeshletRecord) * streams.desc.meshlet_count},
+        };
+
+        std::filesystem::path temp = path;
+        temp += ".tmp";
+
+        {
+            std::ofstream fout{temp, std::ios::binary | std::ios::trunc};
+            if (!fout) {
+                error = "cannot open " + temp.string();
+                return false;
+            }
+
+            for (const auto &section : sections) {
+                static const char kZeros[kMeshAlignment] = {};
+                fout.write(kZeros, static_cast<std::streamsize>(section.offset - static_cast<uint64_t>(fout.tellp())));
+                fout.write(static_cast<const char *>(section.data), static_cast<std::streamsize>(section.size));
+            }
+
+            if (!fout) {
+                error = "cannot write " + temp.string();
+                return false;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(temp, path, ec);
+        if (ec) {
+            error = "cannot replace " + path + ": " + ec.message();
+            return false;
+        }
+
+        return true;
+    }
+};
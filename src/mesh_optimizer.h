@@ -0,0 +1,334 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// reorders indexed triangle lists for the gpu. triangles are ordered for the post transform vertex cache (tipsify,
+// sander et al. 2007), then clusters of them are ordered so outward facing ones draw first, and finally vertices are
+// reordered in the order the indices first use them so fetches walk the vertex buffer front to back
+class MeshOptimizer final {
+    // fifo cache the orderings are tuned for and measured with, smaller than most hardware caches so the result
+    // holds up on all of them
+    static constexpr uint32_t kCacheSize = 16;
+
+    // triangles around every vertex as offsets into one shared list
+    struct Adjacency {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> triangles;
+
+        Adjacency(const std::vector<uint32_t> &indices, size_t vertex_count) : offsets(vertex_count + 1, 0) {
+            for (auto v : indices) {
+                offsets[v + 1]++;
+            }
+
+            for (size_t v = 0; v < vertex_count; ++v) {
+                offsets[v + 1] += offsets[v];
+            }
+
+            triangles.resize(indices.size());
+            std::vector<uint32_t> fill{offsets.begin(), offsets.end() - 1};
+            for (size_t i = 0; i < indices.size(); ++i) {
+                triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+        }
+    };
+
+    // counts the cache misses of each triangle, a triangle missing all three vertices starts from a cold cache
+    static std::vector<uint8_t> triangle_misses(const uint32_t *indices, size_t index_count, size_t vertex_count) {
+        std::vector<uint32_t> cached_at(vertex_count, 0);
+        std::vector<uint8_t> misses(index_count / 3, 0);
+        uint32_t time = kCacheSize + 1;
+
+        for (size_t i = 0; i < index_count; ++i) {
+            uint32_t v = indices[i];
+            if (time - cached_at[v] > kCacheSize) {
+                cached_at[v] = time++;
+                misses[i / 3]++;
+            }
+        }
+
+        return misses;
+    }
+
+public:
+    // average cache miss ratio, transformed vertices per triangle (0.5 at best for large meshes, 3 at worst), and
+    // average transform to vertex ratio, transformed vertices per vertex used (1 at best)
+    struct CacheStatistics {
+        float acmr;
+        float atvr;
+    };
+
+    static CacheStatistics analyze_vertex_cache(const std::vector<uint32_t> &indices, size_t vertex_count) {
+        auto misses = triangle_misses(indices.data(), indices.size(), vertex_count);
+
+        size_t transformed = 0;
+        for (auto count : misses) {
+            transformed += count;
+        }
+
+        std::vector<uint8_t> used(vertex_count, 0);
+        size_t used_count = 0;
+        for (auto v : indices) {
+            used_count += used[v] ? 0 : 1;
+            used[v] = 1;
+        }
+
+        return CacheStatistics{misses.empty() ? 0.0f : static_cast<float>(transformed) / misses.size(),
+            used_count == 0 ? 0.0f : static_cast<float>(transformed) / used_count};
+    }
+
+    // tipsify, fans around one vertex at a time and picks the next one among the vertices just emitted, preferring
+    // the ones that stay in the cache for the triangles they have left. dead ends continue from the most recently
+    // emitted vertex that still has triangles, then from the lowest one
+    static void optimize_vertex_cache(std::vector<uint32_t> &indices, size_t vertex_count) {
+        size_t triangle_count = indices.size() / 3;
+        if (triangle_count == 0) {
+            return;
+        }
+
+        Adjacency adjacency{indices, vertex_count};
+
+        std::vector<uint32_t> live(vertex_count);
+        for (size_t v = 0; v < vertex_count; ++v) {
+            live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+        }
+
+        std::vector<uint32_t> cached_at(vertex_count, 0);
+        std::vector<uint8_t> emitted(triangle_count, 0);
+        std::vector<uint32_t> dead_ends, candidates, result;
+        result.reserve(triangle_count * 3);
+
+        uint32_t time = kCacheSize + 1;
+        size_t cursor = 0;
+
+        auto skip_dead_end = [&]() -> int64_t {
+            while (!dead_ends.empty()) {
+                uint32_t v = dead_ends.back();
+                dead_ends.pop_back();
+                if (live[v] > 0) {
+                    return v;
+                }
+            }
+
+            for (; cursor < vertex_count; ++cursor) {
+                if (live[cursor] > 0) {
+                    return static_cast<int64_t>(cursor);
+                }
+            }
+
+            return -1;
+        };
+
+        for (int64_t fan = skip_dead_end(); fan >= 0;) {
+            candidates.clear();
+
+            for (uint32_t t = adjacency.offsets[fan]; t < adjacency.offsets[fan + 1]; ++t) {
+                uint32_t triangle = adjacency.triangles[t];
+                if (emitted[triangle]) {
+                    continue;
+                }
+
+                for (size_t c = 0; c < 3; ++c) {
+                    uint32_t v = indices[triangle * 3 + c];
+                    result.push_back(v);
+                    dead_ends.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+
+                    if (time - cached_at[v] > kCacheSize) {
+                        cached_at[v] = time++;
+                    }
+                }
+
+                emitted[triangle] = 1;
+            }
+
+            // a candidate whose remaining triangles still fit before it is evicted is preferred, the one that has
+            // been in the cache longest first
+            int64_t next = -1;
+            int64_t best_priority = -1;
+
+            for (auto v : candidates) {
+                if (live[v] == 0) {
+                    continue;
+                }
+
+                int64_t priority = 0;
+                if (time - cached_at[v] + 2 * live[v] <= kCacheSize) {
+                    priority = time - cached_at[v];
+                }
+
+                if (priority > best_priority) {
+                    best_priority = priority;
+                    next = v;
+                }
+            }
+
+            fan = next >= 0 ? next : skip_dead_end();
+        }
+
+        indices = std::move(result);
+    }
+
+    // splits the cache ordered triangles into clusters and draws the clusters facing away from the mesh center
+    // first, since those are most likely in front of the rest. clusters end where the cache starts cold and wherever
+    // ending one keeps the cache miss ratio within threshold of what the cache order reached. positions are three
+    // floats at the start of every stride bytes
+    static void optimize_overdraw(std::vector<uint32_t> &indices, const void *positions, size_t vertex_count,
+        size_t stride, float threshold = 1.05f) {
+        size_t triangle_count = indices.size() / 3;
+        if (triangle_count == 0) {
+            return;
+        }
+
+        auto position = [&](uint32_t v) {
+            return reinterpret_cast<const float *>(static_cast<const uint8_t *>(positions) + v * stride);
+        };
+
+        // a triangle missing every vertex starts a cluster on its own
+        auto misses = triangle_misses(indices.data(), indices.size(), vertex_count);
+
+        std::vector<size_t> hard_starts;
+        for (size_t t = 0; t < triangle_count; ++t) {
+            if (t == 0 || misses[t] == 3) {
+                hard_starts.push_back(t);
+            }
+        }
+
+        hard_starts.push_back(triangle_count);
+
+        // restarting the cache at a split costs misses, so splits are only made where the ratio since the last one
+        // is already as good as the whole cluster's. moving time past the cache size empties the cache
+        std::vector<uint32_t> cached_at(vertex_count, 0);
+        uint32_t time = kCacheSize + 1;
+        std::vector<size_t> starts;
+
+        for (size_t h = 0; h + 1 < hard_starts.size(); ++h) {
+            size_t first = hard_starts[h], last = hard_starts[h + 1];
+
+            size_t total = 0;
+            for (size_t t = first; t < last; ++t) {
+                total += misses[t];
+            }
+
+            float limit = static_cast<float>(total) / (last - first) * threshold;
+            size_t start = first, running = 0;
+            starts.push_back(first);
+            time += kCacheSize + 1;
+
+            for (size_t t = first; t < last; ++t) {
+                for (size_t c = 0; c < 3; ++c) {
+                    uint32_t v = indices[t * 3 + c];
+                    if (time - cached_at[v] > kCacheSize) {
+                        cached_at[v] = time++;
+                        running++;
+                    }
+                }
+
+                if (t + 1 < last && static_cast<float>(running) / (t - start + 1) <= limit) {
+                    start = t + 1;
+                    running = 0;
+                    starts.push_back(start);
+                    time += kCacheSize + 1;
+                }
+            }
+        }
+
+        starts.push_back(triangle_count);
+
+        // area weighted centroid and normal of every cluster and of the whole mesh
+        struct Cluster {
+            size_t first, last;
+            float sort_key;
+        };
+
+        std::vector<Cluster> clusters;
+        std::vector<std::array<double, 6>> sums(starts.size() - 1, std::array<double, 6>{});
+        double mesh_center[3] = {}, mesh_area = 0.0;
+
+        for (size_t c = 0; c + 1 < starts.size(); ++c) {
+            double area_sum = 0.0;
+            auto &sum = sums[c];
+
+            for (size_t t = starts[c]; t < starts[c + 1]; ++t) {
+                const float *a = position(indices[t * 3]), *b = position(indices[t * 3 + 1]);
+                const float *p = position(indices[t * 3 + 2]);
+
+                double u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+                double v[3] = {p[0] - a[0], p[1] - a[1], p[2] - a[2]};
+                double n[3] = {u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0]};
+                double area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+                for (size_t k = 0; k < 3; ++k) {
+                    sum[k] += (a[k] + b[k] + p[k]) / 3.0 * area;
+                    sum[3 + k] += n[k];
+                }
+
+                area_sum += area;
+            }
+
+            for (size_t k = 0; k < 3; ++k) {
+                mesh_center[k] += sum[k];
+                sum[k] = area_sum > 0.0 ? sum[k] / area_sum : 0.0;
+            }
+
+            mesh_area += area_sum;
+        }
+
+        for (size_t k = 0; k < 3; ++k) {
+            mesh_center[k] = mesh_area > 0.0 ? mesh_center[k] / mesh_area : 0.0;
+        }
+
+        for (size_t c = 0; c + 1 < starts.size(); ++c) {
+            const auto &sum = sums[c];
+            double length = std::sqrt(sum[3] * sum[3] + sum[4] * sum[4] + sum[5] * sum[5]);
+            double key = 0.0;
+            if (length > 0.0) {
+                for (size_t k = 0; k < 3; ++k) {
+                    key += (sum[k] - mesh_center[k]) * sum[3 + k] / length;
+                }
+            }
+
+            clusters.push_back(Cluster{starts[c], starts[c + 1], static_cast<float>(key)});
+        }
+
+        std::stable_sort(clusters.begin(), clusters.end(),
+            [](const Cluster &a, const Cluster &b) { return a.sort_key > b.sort_key; });
+
+        std::vector<uint32_t> result;
+        result.reserve(indices.size());
+        for (const auto &cluster : clusters) {
+            result.insert(result.end(), indices.begin() + cluster.first * 3, indices.begin() + cluster.last * 3);
+        }
+
+        indices = std::move(result);
+    }
+
+    // moves vertices into the order the indices first use them and drops the unused ones, returns how many are left
+    template <typename Vertex>
+    static size_t optimize_vertex_fetch(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices) {
+        std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+        uint32_t next = 0;
+
+        for (auto &v : indices) {
+            if (remap[v] == UINT32_MAX) {
+                remap[v] = next++;
+            }
+
+            v = remap[v];
+        }
+
+        std::vector<Vertex> result(next);
+        for (size_t v = 0; v < vertices.size(); ++v) {
+            if (remap[v] != UINT32_MAX) {
+                result[remap[v]] = vertices[v];
+            }
+        }
+
+        vertices = std::move(result);
+        return next;
+    }
+};
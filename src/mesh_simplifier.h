@@ -0,0 +1,258 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// quadric error metric simplification of indexed triangle lists (garland-heckbert) by half edge collapses. a vertex
+// is only ever moved onto one of its neighbours, so every simplified index list still indexes the original vertices.
+// vertices on open borders, non-manifold edges or attribute seams, where several vertices share a position, never
+// move, which keeps outlines and uv layouts intact
+class MeshSimplifier final {
+    // symmetric 4x4 matrix summing area weighted plane equations, p^T Q p / weight is the mean squared distance of p
+    // from the planes
+    struct Quadric {
+        double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+        double weight;
+
+        static Quadric plane(double nx, double ny, double nz, double d, double weight) {
+            return Quadric{nx * nx * weight, nx * ny * weight, nx * nz * weight, nx * d * weight, ny * ny * weight,
+                ny * nz * weight, ny * d * weight, nz * nz * weight, nz * d * weight, d * d * weight, weight};
+        }
+
+        void add(const Quadric &q) {
+            a00 += q.a00, a01 += q.a01, a02 += q.a02, a03 += q.a03, a11 += q.a11;
+            a12 += q.a12, a13 += q.a13, a22 += q.a22, a23 += q.a23, a33 += q.a33;
+            weight += q.weight;
+        }
+
+        double error(const float *p) const {
+            double x = p[0], y = p[1], z = p[2];
+            double sum = a00 * x * x + a11 * y * y + a22 * z * z + a33 +
+                         2.0 * (a01 * x * y + a02 * x * z + a12 * y * z + a03 * x + a13 * y + a23 * z);
+            return weight > 0.0 ? std::max(sum, 0.0) / weight : 0.0;
+        }
+    };
+
+    struct PositionKey {
+        uint32_t bits[3];
+
+        bool operator==(const PositionKey &k) const {
+            return bits[0] == k.bits[0] && bits[1] == k.bits[1] && bits[2] == k.bits[2];
+        }
+    };
+
+    struct PositionHash {
+        size_t operator()(const PositionKey &k) const {
+            return (size_t{k.bits[0]} * 73856093u) ^ (size_t{k.bits[1]} * 19349663u) ^ (size_t{k.bits[2]} * 83492791u);
+        }
+    };
+
+    struct Collapse {
+        uint32_t from, to;
+        double cost;
+    };
+
+    static void cross(const float *a, const float *b, const float *c, float *n) {
+        float u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+        float v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+        n[0] = u[1] * v[2] - u[2] * v[1];
+        n[1] = u[2] * v[0] - u[0] * v[2];
+        n[2] = u[0] * v[1] - u[1] * v[0];
+    }
+
+public:
+    // reduces the triangle list to at most target_index_count indices where it can. positions are three floats at
+    // the start of every stride bytes. error receives the largest root mean squared distance a moved vertex has from
+    // the planes of the surface it replaced, in the units of the positions
+    static std::vector<uint32_t> simplify(const void *positions, size_t vertex_count, size_t stride,
+        const std::vector<uint32_t> &indices, size_t target_index_count, float &error) {
+        auto position = [&](uint32_t v) {
+            return reinterpret_cast<const float *>(static_cast<const uint8_t *>(positions) + v * stride);
+        };
+
+        // vertices sharing a position are one vertex of the surface, the first of them stands for all
+        std::vector<uint32_t> canonical(vertex_count);
+        std::vector<uint8_t> locked(vertex_count, 0);
+        std::unordered_map<PositionKey, uint32_t, PositionHash> first_at;
+
+        for (uint32_t v = 0; v < vertex_count; ++v) {
+            PositionKey key;
+            memcpy(key.bits, position(v), sizeof(key.bits));
+
+            canonical[v] = first_at.emplace(key, v).first->second;
+            if (canonical[v] != v) {
+                locked[canonical[v]] = 1;
+            }
+        }
+
+        std::vector<Quadric> quadrics(vertex_count, Quadric{});
+        std::unordered_map<uint64_t, uint32_t> edge_uses;
+
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            uint32_t corners[3] = {canonical[indices[i]], canonical[indices[i + 1]], canonical[indices[i + 2]]};
+
+            float n[3];
+            cross(position(corners[0]), position(corners[1]), position(corners[2]), n);
+
+            double length = std::sqrt(double{n[0]} * n[0] + double{n[1]} * n[1] + double{n[2]} * n[2]);
+            if (length > 0.0) {
+                const float *p = position(corners[0]);
+                double nx = n[0] / length, ny = n[1] / length, nz = n[2] / length;
+                auto quadric = Quadric::plane(nx, ny, nz, -(nx * p[0] + ny * p[1] + nz * p[2]), length * 0.5);
+
+                for (auto corner : corners) {
+                    quadrics[corner].add(quadric);
+                }
+            }
+
+            for (size_t e = 0; e < 3; ++e) {
+                uint32_t a = corners[e], b = corners[(e + 1) % 3];
+                edge_uses[uint64_t{std::min(a, b)} << 32 | std::max(a, b)]++;
+            }
+        }
+
+        // edges of a closed manifold surface are shared by exactly two triangles
+        for (const auto &[edge, uses] : edge_uses) {
+            if (uses != 2) {
+                locked[static_cast<uint32_t>(edge >> 32)] = 1;
+                locked[static_cast<uint32_t>(edge)] = 1;
+            }
+        }
+
+        std::vector<uint32_t> result{indices.begin(), indices.begin() + indices.size() / 3 * 3};
+        std::vector<uint32_t> remap(vertex_count);
+        std::vector<uint8_t> touched(vertex_count);
+        std::vector<uint32_t> adjacency_offsets(vertex_count + 1), adjacency;
+        std::vector<Collapse> collapses;
+        double max_error = 0.0;
+
+        while (result.size() > target_index_count) {
+            // every free vertex may move onto any neighbour, cheapest first
+            collapses.clear();
+            for (size_t i = 0; i < result.size(); i += 3) {
+                for (size_t e = 0; e < 3; ++e) {
+                    uint32_t a = result[i + e], b = result[i + (e + 1) % 3];
+                    for (auto [from, to] : {std::make_pair(a, b), std::make_pair(b, a)}) {
+                        if (locked[canonical[from]]) {
+                            continue;
+                        }
+
+                        Quadric quadric = quadrics[canonical[from]];
+                        quadric.add(quadrics[canonical[to]]);
+                        collapses.push_back(Collapse{from, to, quadric.error(position(to))});
+                    }
+                }
+            }
+
+            std::sort(collapses.begin(), collapses.end(),
+                [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+            // triangles around every vertex
+            std::fill(adjacency_offsets.begin(), adjacency_offsets.end(), 0);
+            for (auto v : result) {
+                adjacency_offsets[v + 1]++;
+            }
+
+            for (size_t v = 0; v < vertex_count; ++v) {
+                adjacency_offsets[v + 1] += adjacency_offsets[v];
+            }
+
+            adjacency.resize(result.size());
+            std::vector<uint32_t> fill{adjacency_offsets.begin(), adjacency_offsets.end() - 1};
+            for (size_t i = 0; i < result.size(); ++i) {
+                adjacency[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+
+            // each collapse removes about two triangles. the neighbourhood of a collapse is left alone for the rest
+            // of the pass, so the orientation checks only ever see triangles as they are in result. collapses
+            // costlier than what the whole budget would take without that are left to a later pass
+            std::iota(remap.begin(), remap.end(), 0);
+            std::fill(touched.begin(), touched.end(), 0);
+
+            size_t budget = (result.size() - target_index_count) / 3;
+            size_t removed = 0, applied = 0;
+
+            // every edge is listed once per direction and once per triangle sharing it
+            double cost_limit = collapses.empty() ? 0.0 : collapses[std::min(collapses.size() - 1, budget * 2)].cost;
+
+            for (const auto &collapse : collapses) {
+                if (removed >= budget || (collapse.cost > cost_limit && applied > 0)) {
+                    break;
+                }
+
+                if (touched[collapse.from] || touched[collapse.to]) {
+                    continue;
+                }
+
+                // moving the vertex must not fold any remaining triangle over
+                bool folds = false;
+                for (uint32_t t = adjacency_offsets[collapse.from]; t < adjacency_offsets[collapse.from + 1]; ++t) {
+                    const uint32_t *triangle = &result[adjacency[t] * 3];
+                    if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                        continue;
+                    }
+
+                    const float *before[3], *after[3];
+                    for (size_t c = 0; c < 3; ++c) {
+                        before[c] = position(triangle[c]);
+                        after[c] = triangle[c] == collapse.from ? position(collapse.to) : before[c];
+                    }
+
+                    float n0[3], n1[3];
+                    cross(before[0], before[1], before[2], n0);
+                    cross(after[0], after[1], after[2], n1);
+                    if (n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0f) {
+                        folds = true;
+                        break;
+                    }
+                }
+
+                if (folds) {
+                    continue;
+                }
+
+                remap[collapse.from] = collapse.to;
+                quadrics[canonical[collapse.to]].add(quadrics[canonical[collapse.from]]);
+                max_error = std::max(max_error, collapse.cost);
+
+                touched[collapse.to] = 1;
+                for (uint32_t t = adjacency_offsets[collapse.from]; t < adjacency_offsets[collapse.from + 1]; ++t) {
+                    for (size_t c = 0; c < 3; ++c) {
+                        touched[result[adjacency[t] * 3 + c]] = 1;
+                    }
+                }
+
+                removed += 2;
+                ++applied;
+            }
+
+            if (applied == 0) {
+                break;
+            }
+
+            // triangles that lost an edge are dropped
+            size_t write = 0;
+            for (size_t i = 0; i < result.size(); i += 3) {
+                uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+                if (canonical[a] == canonical[b] || canonical[b] == canonical[c] || canonical[a] == canonical[c]) {
+                    continue;
+                }
+
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+
+            result.resize(write);
+        }
+
+        error = static_cast<float>(std::sqrt(max_error));
+        return result;
+    }
+};
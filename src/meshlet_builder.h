@@ -0,0 +1,155 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// splits an indexed triangle list into meshlets, runs of consecutive triangles touching a bounded number of vertices.
+// the triangles are taken in the order given, so lists already ordered for the vertex cache give compact meshlets.
+// every meshlet carries the bounds culling needs: a sphere around its vertices and a cone around its normals
+class MeshletBuilder final {
+public:
+    // the limits mesh shading hardware is commonly tuned for, 124 triangles leave room for 4 byte aligned
+    // primitive indices in 128 entries
+    static constexpr size_t kMaxVertices = 64;
+    static constexpr size_t kMaxTriangles = 124;
+
+    struct Meshlet {
+        uint32_t first_index;
+        uint32_t index_count;
+        uint32_t vertex_count;
+
+        float center[3];
+        float radius;
+
+        // every triangle normal is within the cone, cone_cutoff is the cosine of its half angle and is -1 when the
+        // normals spread too far for the cone to cull anything
+        float cone_axis[3];
+        float cone_cutoff;
+    };
+
+    // positions are three floats at the start of every stride bytes
+    static std::vector<Meshlet> build(const uint32_t *indices, size_t index_count, const void *positions,
+        size_t vertex_count, size_t stride, size_t max_vertices = kMaxVertices, size_t max_triangles = kMaxTriangles) {
+        auto position = [&](uint32_t v) {
+            return reinterpret_cast<const float *>(static_cast<const uint8_t *>(positions) + v * stride);
+        };
+
+        std::vector<Meshlet> meshlets;
+        std::vector<uint32_t> used_by(vertex_count, UINT32_MAX);
+        std::vector<uint32_t> vertices;
+
+        Meshlet current = {};
+
+        auto finish = [&]() {
+            if (current.index_count == 0) {
+                return;
+            }
+
+            bound(current, indices, vertices, position);
+            meshlets.push_back(current);
+
+            current = Meshlet{};
+            current.first_index = static_cast<uint32_t>(meshlets.back().first_index + meshlets.back().index_count);
+            vertices.clear();
+        };
+
+        for (size_t i = 0; i + 2 < index_count; i += 3) {
+            auto id = static_cast<uint32_t>(meshlets.size());
+
+            size_t new_vertices = 0;
+            for (size_t c = 0; c < 3; ++c) {
+                new_vertices += used_by[indices[i + c]] != id ? 1 : 0;
+            }
+
+            // repeated corners of a degenerate triangle are counted twice, which only ever ends a meshlet early
+            if (vertices.size() + new_vertices > max_vertices || current.index_count / 3 + 1 > max_triangles) {
+                finish();
+                id = static_cast<uint32_t>(meshlets.size());
+            }
+
+            for (size_t c = 0; c < 3; ++c) {
+                uint32_t v = indices[i + c];
+                if (used_by[v] != id) {
+                    used_by[v] = id;
+                    vertices.push_back(v);
+                }
+            }
+
+            current.index_count += 3;
+        }
+
+        finish();
+        return meshlets;
+    }
+
+private:
+    template <typename Position>
+    static void bound(Meshlet &meshlet, const uint32_t *indices, const std::vector<uint32_t> &vertices,
+        const Position &position) {
+        meshlet.vertex_count = static_cast<uint32_t>(vertices.size());
+
+        float min[3] = {INFINITY, INFINITY, INFINITY}, max[3] = {-INFINITY, -INFINITY, -INFINITY};
+        for (auto v : vertices) {
+            for (size_t k = 0; k < 3; ++k) {
+                min[k] = std::min(min[k], position(v)[k]);
+                max[k] = std::max(max[k], position(v)[k]);
+            }
+        }
+
+        float radius_squared = 0.0f;
+        for (size_t k = 0; k < 3; ++k) {
+            meshlet.center[k] = (min[k] + max[k]) * 0.5f;
+        }
+
+        for (auto v : vertices) {
+            const float *p = position(v);
+            float dx = p[0] - meshlet.center[0], dy = p[1] - meshlet.center[1], dz = p[2] - meshlet.center[2];
+            radius_squared = std::max(radius_squared, dx * dx + dy * dy + dz * dz);
+        }
+
+        meshlet.radius = std::sqrt(radius_squared);
+
+        // the axis is the mean of the unit normals, degenerate triangles have no normal and are left out
+        std::vector<float> normals;
+        float axis[3] = {0.0f, 0.0f, 0.0f};
+
+        for (uint32_t i = meshlet.first_index; i < meshlet.first_index + meshlet.index_count; i += 3) {
+            const float *a = position(indices[i]), *b = position(indices[i + 1]), *c = position(indices[i + 2]);
+            float u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+            float w[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+            float n[3] = {u[1] * w[2] - u[2] * w[1], u[2] * w[0] - u[0] * w[2], u[0] * w[1] - u[1] * w[0]};
+
+            float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (length <= 0.0f) {
+                continue;
+            }
+
+            for (size_t k = 0; k < 3; ++k) {
+                normals.push_back(n[k] / length);
+                axis[k] += n[k] / length;
+            }
+        }
+
+        float axis_length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        if (axis_length <= 0.0f) {
+            meshlet.cone_axis[0] = 0.0f, meshlet.cone_axis[1] = 0.0f, meshlet.cone_axis[2] = 1.0f;
+            meshlet.cone_cutoff = -1.0f;
+            return;
+        }
+
+        float cutoff = 1.0f;
+        for (size_t k = 0; k < 3; ++k) {
+            meshlet.cone_axis[k] = axis[k] / axis_length;
+        }
+
+        for (size_t i = 0; i < normals.size(); i += 3) {
+            float d = normals[i] * meshlet.cone_axis[0] + normals[i + 1] * meshlet.cone_axis[1] +
+                      normals[i + 2] * meshlet.cone_axis[2];
+            cutoff = std::min(cutoff, d);
+        }
+
+        meshlet.cone_cutoff = cutoff <= 0.0f ? -1.0f : cutoff;
+    }
+};
@@ -0,0 +1,137 @@
+#version 450
+
+// one invocation per cluster, x walks the clusters of a mesh and every workgroup row is one expanded object
+layout(local_size_x = 64) in;
+
+// set by the scene, without draw count support every cluster keeps its own command and culled ones draw nothing
+layout(constant_id = 0) const bool kCompact = true;
+
+// cluster commands every phase has room for
+layout(constant_id = 2) const uint kMaxClusterCommands = 65536;
+
+// shared with the object pass, see cull.glsl
+layout(push_constant) uniform CullConstants {
+    vec4 planes[6];
+    uint first_record;
+    uint object_count;
+    uint phase;
+    uint occlusion;
+} constants;
+
+struct CullObject {
+    vec4 sphere;
+    vec4 extents;
+    uvec4 draw;
+    uvec4 clusters;
+    vec4 transform[3];
+};
+
+// bounds of one cluster in mesh units, every triangle normal is within cone.w (the cosine of the half angle) of the
+// cone axis, cones with w <= 0 hold too many directions to ever face away
+struct MeshCluster {
+    vec4 sphere;
+    vec4 cone;
+    uint first_index;
+    uint index_count;
+    uint padding[2];
+};
+
+struct DrawCommand {
+    uint index_count;
+    uint instance_count;
+    uint first_index;
+    int vertex_offset;
+    uint first_instance;
+};
+
+layout(set = 0, binding = 0, std430) readonly buffer CullObjects {
+    CullObject objects[];
+} cullObjects;
+
+layout(set = 0, binding = 2, std430) buffer DrawCounts {
+    uint counts[];
+} drawCounts;
+
+layout(set = 0, binding = 4) uniform CullView {
+    mat4 occlusion_view_proj[2];
+    uvec4 depth_size;
+    vec4 camera;
+    vec4 lod_error;
+} cullView;
+
+layout(set = 0, binding = 8, std430) readonly buffer MeshClusters {
+    MeshCluster clusters[];
+} meshClusters;
+
+layout(set = 0, binding = 9, std430) readonly buffer ExpandedObjects {
+    uint slots[];
+} expandedObjects;
+
+layout(set = 0, binding = 10, std430) writeonly buffer ClusterCommands {
+    DrawCommand commands[];
+} clusterCommands;
+
+bool visible(vec3 center, float radius) {
+    for (uint i = 0; i < 6; ++i) {
+        vec4 plane = constants.planes[i];
+        if (dot(plane.xyz, center) + plane.w + radius < 0.0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// every triangle faces away when the whole sphere is seen from outside the cone widened by a right angle. the test
+// runs in mesh space where the normals were measured, which keeps the facing of every triangle for transforms that
+// do not mirror
+bool backfacing(CullObject object, MeshCluster cluster) {
+    if (object.clusters.w == 0 || cullView.camera.w <= 0.0 || cluster.cone.w <= 0.0) {
+        return false;
+    }
+
+    mat3 linear = transpose(mat3(object.transform[0].xyz, object.transform[1].xyz, object.transform[2].xyz));
+    vec3 translation = vec3(object.transform[0].w, object.transform[1].w, object.transform[2].w);
+    vec3 camera = inverse(linear) * (cullView.camera.xyz - translation);
+
+    vec3 to_center = cluster.sphere.xyz - camera;
+    float sin_angle = sqrt(max(1.0 - cluster.cone.w * cluster.cone.w, 0.0));
+
+    return dot(to_center, cluster.cone.xyz) - cluster.sphere.w >= sin_angle * (length(to_center) + cluster.sphere.w);
+}
+
+void main() {
+    uint base = constants.phase * constants.object_count;
+    uint slot = expandedObjects.slots[base + gl_WorkGroupID.y];
+    CullObject object = cullObjects.objects[slot];
+
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= object.clusters.y) {
+        return;
+    }
+
+    MeshCluster cluster = meshClusters.clusters[object.clusters.x + index];
+
+    vec4 local = vec4(cluster.sphere.xyz, 1.0);
+    vec3 center = vec3(dot(object.transform[0], local), dot(object.transform[1], local), dot(object.transform[2], local));
+    bool inside = visible(center, cluster.sphere.w * object.extents.w) && !backfacing(object, cluster);
+
+    uint command = constants.phase * kMaxClusterCommands + object.clusters.z;
+
+    if (kCompact) {
+        if (!inside) {
+            return;
+        }
+
+        // cluster counts follow the object counts of both phases
+        command += atomicAdd(drawCounts.counts[(2 + constants.phase) * constants.object_count + object.draw.y], 1);
+    } else {
+        command += index;
+    }
+
+    clusterCommands.commands[command].index_count = cluster.index_count;
+    clusterCommands.commands[command].instance_count = inside ? 1 : 0;
+    clusterCommands.commands[command].first_index = cluster.first_index;
+    clusterCommands.commands[command].vertex_offset = 0;
+    clusterCommands.commands[command].first_instance = constants.first_record + slot;
+}
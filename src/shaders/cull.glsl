@@ -0,0 +1,245 @@
+#version 450
+
+layout(local_size_x = 64) in;
+
+// set by the scene, without draw count support every object keeps its own command and culled ones draw nothing
+layout(constant_id = 0) const bool kCompact = true;
+
+// levels of detail every mesh has room for in the lod table
+layout(constant_id = 1) const uint kMaxMeshLods = 8;
+
+// objects are culled in two phases. the first draws what the previous frame's depth does not hide and defers the
+// rest, the second tests the deferred objects again against the depth of the first and draws what became visible
+layout(push_constant) uniform CullConstants {
+    vec4 planes[6]; // xyz normal and distance, a point is inside when dot(normal, p) + distance >= 0
+    uint first_record;
+    uint object_count;
+    uint phase;
+    uint occlusion; // 0 when there is no depth to test against, nothing is occluded then
+} constants;
+
+// one entry per object slot, slots with a negative radius are never drawn
+struct CullObject {
+    vec4 sphere;  // center and radius
+    vec4 extents; // half size of the world space box around the same center, w is the largest axis scale
+    uvec4 draw;   // mesh, batch, first command of the batch or the object's own command
+
+    // first cluster and cluster count of the mesh, 0 when it is drawn whole, then the first cluster command of the
+    // batch or the object's own, and 1 when back facing clusters may be dropped. read by the cluster pass
+    uvec4 clusters;
+    vec4 transform[3]; // rows of the object transform
+};
+
+// index range of one level of detail, error is in mesh units. a range without indices ends the mesh's chain
+struct MeshLod {
+    uint first_index;
+    uint index_count;
+    float error;
+    uint padding;
+};
+
+struct DrawCommand {
+    uint index_count;
+    uint instance_count;
+    uint first_index;
+    int vertex_offset;
+    uint first_instance;
+};
+
+layout(set = 0, binding = 0, std430) readonly buffer CullObjects {
+    CullObject objects[];
+} cullObjects;
+
+layout(set = 0, binding = 1, std430) writeonly buffer DrawCommands {
+    DrawCommand commands[];
+} drawCommands;
+
+// one counter per batch, cleared before the dispatch
+layout(set = 0, binding = 2, std430) buffer DrawCounts {
+    uint counts[];
+} drawCounts;
+
+// objects the first phase found occluded, only these are drawn by the second
+layout(set = 0, binding = 3, std430) buffer DeferredObjects {
+    uint deferred[];
+} deferredObjects;
+
+// the camera the pyramid was rendered with for each phase, the size of the depth buffer and what levels of detail
+// are picked by
+layout(set = 0, binding = 4) uniform CullView {
+    mat4 occlusion_view_proj[2];
+    uvec4 depth_size; // width, height, pyramid levels
+    vec4 camera;      // position and pixels per world unit at distance one, 0 without a camera
+    vec4 lod_error;   // pixels a level may stray from the full mesh, and the share of it a coarser level must meet
+} cullView;
+
+// farthest depth of every 2x2 texels of the level below, the first level halves the depth buffer
+layout(set = 0, binding = 5) uniform sampler2D depthPyramid;
+
+// kMaxMeshLods entries per mesh, the full mesh first
+layout(set = 0, binding = 6, std430) readonly buffer MeshLods {
+    MeshLod lods[];
+} meshLods;
+
+// level each object slot was last drawn with, shared by all frames
+layout(set = 0, binding = 7, std430) buffer ObjectLods {
+    uint lods[];
+} objectLods;
+
+// object slots the cluster pass culls cluster by cluster, one range per phase
+layout(set = 0, binding = 9, std430) writeonly buffer ExpandedObjects {
+    uint slots[];
+} expandedObjects;
+
+// x, y and z workgroups of the cluster pass for each phase, y counts the expanded objects
+layout(set = 0, binding = 11, std430) buffer ClusterDispatch {
+    uint args[];
+} clusterDispatch;
+
+bool visible(CullObject object) {
+    for (uint i = 0; i < 6; ++i) {
+        vec4 plane = constants.planes[i];
+        float distance = dot(plane.xyz, object.sphere.xyz) + plane.w;
+        float reach = min(dot(abs(plane.xyz), object.extents.xyz), object.sphere.w);
+
+        if (distance + reach < 0.0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// projects the box with the camera the pyramid was rendered with and compares its nearest depth against the farthest
+// depth under its screen rectangle, read from the level where the rectangle spans at most 2x2 texels
+bool occluded(CullObject object) {
+    mat4 view_proj = cullView.occlusion_view_proj[constants.phase];
+    vec3 box_min = object.sphere.xyz - object.extents.xyz;
+    vec3 box_max = object.sphere.xyz + object.extents.xyz;
+
+    vec2 lo = vec2(1.0), hi = vec2(-1.0);
+    float nearest = 1.0;
+
+    for (uint i = 0; i < 8; ++i) {
+        vec3 corner = mix(box_min, box_max, vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+        vec4 clip = view_proj * vec4(corner, 1.0);
+
+        // boxes reaching behind the near plane cannot be projected, they are never occluded
+        if (clip.w <= 0.0 || clip.z < 0.0) {
+            return false;
+        }
+
+        vec3 ndc = clip.xyz / clip.w;
+        lo = min(lo, ndc.xy);
+        hi = max(hi, ndc.xy);
+        nearest = min(nearest, ndc.z);
+    }
+
+    vec2 size = vec2(cullView.depth_size.xy);
+    ivec2 first = ivec2(clamp((lo * 0.5 + 0.5) * size, vec2(0.0), size - 1.0));
+    ivec2 last = ivec2(clamp((hi * 0.5 + 0.5) * size, vec2(0.0), size - 1.0));
+
+    // a texel of level n covers 2^(n + 1) pixels
+    int pixels = max(last.x - first.x, last.y - first.y) + 1;
+    int level = pixels <= 2 ? 0 : findMSB(pixels - 1);
+    if (level >= int(cullView.depth_size.z)) {
+        return false;
+    }
+
+    ivec2 level_last = textureSize(depthPyramid, level) - 1;
+    first = min(first >> (level + 1), level_last);
+    last = min(last >> (level + 1), level_last);
+
+    float farthest = max(max(texelFetch(depthPyramid, first, level).r, texelFetch(depthPyramid, last, level).r),
+        max(texelFetch(depthPyramid, ivec2(first.x, last.y), level).r,
+            texelFetch(depthPyramid, ivec2(last.x, first.y), level).r));
+
+    return nearest > farthest;
+}
+
+// coarsest level whose error stays under the pixel limit when projected at the object's nearest distance. levels
+// coarser than the current one have to meet a lower limit, so objects near a switching distance do not flicker
+uint select_lod(CullObject object, uint current) {
+    if (cullView.camera.w <= 0.0) {
+        return 0;
+    }
+
+    float distance = max(length(object.sphere.xyz - cullView.camera.xyz) - object.sphere.w, 1e-4);
+    float pixels_per_unit = cullView.camera.w * object.extents.w / distance;
+
+    uint first = object.draw.x * kMaxMeshLods;
+    uint lod = 0;
+
+    for (uint i = 1; i < kMaxMeshLods && meshLods.lods[first + i].index_count != 0; ++i) {
+        float limit = cullView.lod_error.x * (i > current ? cullView.lod_error.y : 1.0);
+        if (meshLods.lods[first + i].error * pixels_per_unit > limit) {
+            break;
+        }
+
+        lod = i;
+    }
+
+    return lod;
+}
+
+void main() {
+    uint slot = gl_GlobalInvocationID.x;
+    if (slot >= constants.object_count) {
+        return;
+    }
+
+    CullObject object = cullObjects.objects[slot];
+    if (object.sphere.w < 0.0) {
+        return;
+    }
+
+    // each phase has its own range of commands and counts
+    uint base = constants.phase * constants.object_count;
+    bool inside;
+    uint lod;
+
+    // the level is picked once per frame, the second phase draws with what the first picked
+    if (constants.phase == 0) {
+        bool in_frustum = visible(object);
+
+        bool hidden = in_frustum && constants.occlusion != 0 && occluded(object);
+        deferredObjects.deferred[slot] = hidden ? 1 : 0;
+        inside = in_frustum && !hidden;
+
+        lod = objectLods.lods[slot];
+        if (in_frustum) {
+            lod = select_lod(object, lod);
+            objectLods.lods[slot] = lod;
+        }
+    } else {
+        inside = deferredObjects.deferred[slot] != 0 && !(constants.occlusion != 0 && occluded(object));
+        lod = objectLods.lods[slot];
+    }
+
+    MeshLod range = meshLods.lods[object.draw.x * kMaxMeshLods + min(lod, kMaxMeshLods - 1)];
+
+    // objects drawn with the full mesh of a clustered mesh leave their draws to the cluster pass
+    bool expand = inside && lod == 0 && object.clusters.y != 0;
+    if (expand) {
+        uint index = atomicAdd(clusterDispatch.args[constants.phase * 3 + 1], 1);
+        expandedObjects.slots[base + index] = slot;
+    }
+
+    bool draw = inside && !expand;
+    uint command = base + object.draw.z;
+
+    if (kCompact) {
+        if (!draw) {
+            return;
+        }
+
+        command += atomicAdd(drawCounts.counts[base + object.draw.y], 1);
+    }
+
+    // the vertex shader finds the object record through the instance index
+    drawCommands.commands[command].index_count = range.index_count;
+    drawCommands.commands[command].instance_count = draw ? 1 : 0;
+    drawCommands.commands[command].first_index = range.first_index;
+    drawCommands.commands[command].vertex_offset = 0;
+    drawCommands.commands[command].first_instance = constants.first_record + slot;
+}
@@ -0,0 +1,31 @@
+#version 450
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(push_constant) uniform PyramidConstants {
+    ivec2 source_size;
+    ivec2 level_size;
+} constants;
+
+// the depth buffer for the first level, the level below for every other
+layout(set = 0, binding = 0) uniform sampler2D source;
+layout(set = 0, binding = 1, r32f) uniform writeonly image2D level;
+
+// each texel keeps the farthest depth of the 2x2 texels below it, sizes are rounded up so an odd last row or
+// column is covered by clamping
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, constants.level_size))) {
+        return;
+    }
+
+    ivec2 last = constants.source_size - 1;
+    ivec2 base = texel * 2;
+
+    float depth = texelFetch(source, min(base, last), 0).r;
+    depth = max(depth, texelFetch(source, min(base + ivec2(1, 0), last), 0).r);
+    depth = max(depth, texelFetch(source, min(base + ivec2(0, 1), last), 0).r);
+    depth = max(depth, texelFetch(source, min(base + ivec2(1, 1), last), 0).r);
+
+    imageStore(level, texel, vec4(depth));
+}
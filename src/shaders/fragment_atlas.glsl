@@ -0,0 +1,35 @@
+#version 450
+
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_normal;
+layout(location = 2) in vec2 in_uv;
+layout(location = 4) flat in uint in_texture_layer;
+layout(location = 5) flat in vec4 in_uv_rect;
+layout(location = 6) flat in uint in_uv_wrap;
+
+layout(location = 0) out vec4 frag_color;
+
+// set per pipeline variant, see ShaderFeatures
+layout(constant_id = 2) const bool kTextured = true;
+layout(constant_id = 3) const bool kAlphaTest = false;
+layout(constant_id = 4) const float kAlphaCutoff = 0.5;
+
+layout(set = 1, binding = 0) uniform sampler2DArray u_atlas;
+
+void main() {
+    vec4 albedo = vec4(vec3(0.5 + 0.5 * normalize(in_normal).y), 1.0);
+
+    if (kTextured) {
+        // keep the coordinate inside the packed rect, repeat wraps and every other mode clamps
+        vec2 uv = in_uv_wrap != 0 ? fract(in_uv) : clamp(in_uv, 0.0, 1.0);
+        uv = in_uv_rect.xy + uv * in_uv_rect.zw;
+
+        albedo = texture(u_atlas, vec3(uv, float(in_texture_layer)));
+    }
+
+    if (kAlphaTest && albedo.a < kAlphaCutoff) {
+        discard;
+    }
+
+    frag_color = albedo;
+}
@@ -0,0 +1,27 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_normal;
+layout(location = 2) in vec2 in_uv;
+layout(location = 3) flat in uint in_material_index;
+
+layout(location = 0) out vec4 frag_color;
+
+// set per pipeline variant, see ShaderFeatures
+layout(constant_id = 2) const bool kTextured = true;
+layout(constant_id = 3) const bool kAlphaTest = false;
+layout(constant_id = 4) const float kAlphaCutoff = 0.5;
+
+layout(set = 1, binding = 0) uniform sampler2D u_albedo[];
+
+void main() {
+    vec4 albedo = kTextured ? texture(u_albedo[nonuniformEXT(in_material_index)], in_uv)
+                            : vec4(vec3(0.5 + 0.5 * normalize(in_normal).y), 1.0);
+
+    if (kAlphaTest && albedo.a < kAlphaCutoff) {
+        discard;
+    }
+
+    frag_color = albedo;
+}
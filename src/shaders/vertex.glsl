@@ -7,6 +7,17 @@ layout(location = 2) in vec2 in_uv;
 layout(location = 0) out vec3 out_position;
 layout(location = 1) out vec3 out_normal;
 layout(location = 2) out vec2 out_uv;
+layout(location = 3) flat out uint out_material_index;
+layout(location = 4) flat out uint out_texture_layer;
+layout(location = 5) flat out vec4 out_uv_rect;
+layout(location = 6) flat out uint out_uv_wrap;
+
+// set per pipeline variant, see ShaderFeatures
+layout(constant_id = 0) const bool kInstanced = false;
+layout(constant_id = 1) const uint kObjectStride = 6;
+
+// compact meshes store octahedral normals, their snorm positions are scaled back by the world matrix
+layout(constant_id = 5) const bool kCompactVertices = false;
 
 layout(set = 0, binding = 0) uniform CbPerFrame {
     mat4 view;
@@ -15,14 +26,51 @@ layout(set = 0, binding = 0) uniform CbPerFrame {
 
 layout(set = 2, binding = 0) uniform CbPerObject {
     mat4 world;
+    vec4 uv_rect;
+    uint material_index;
+    uint texture_layer;
+    uint uv_wrap;
 } cbPerObject;
 
+// the same records as an array, instanced variants find theirs through the instance index
+layout(set = 2, binding = 1, std430) readonly buffer ObjectRecords {
+    uvec4 words[];
+} objectRecords;
+
+// unfolds the lower hemisphere from the corners of the octahedron
+vec3 octahedral_decode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
 void main() {
-    vec4 world_pos = cbPerObject.world * vec4(in_position, 1.0);
+    mat4 world;
+    vec4 uv_rect;
+    uvec3 object_info;
+
+    if (kInstanced) {
+        uint base = uint(gl_InstanceIndex) * kObjectStride;
+        world = mat4(uintBitsToFloat(objectRecords.words[base + 0]), uintBitsToFloat(objectRecords.words[base + 1]),
+            uintBitsToFloat(objectRecords.words[base + 2]), uintBitsToFloat(objectRecords.words[base + 3]));
+        uv_rect = uintBitsToFloat(objectRecords.words[base + 4]);
+        object_info = objectRecords.words[base + 5].xyz;
+    } else {
+        world = cbPerObject.world;
+        uv_rect = cbPerObject.uv_rect;
+        object_info = uvec3(cbPerObject.material_index, cbPerObject.texture_layer, cbPerObject.uv_wrap);
+    }
+
+    vec4 world_pos = world * vec4(in_position, 1.0);
 
     out_position = world_pos.xyz;
-    out_normal = in_normal;
+    out_normal = kCompactVertices ? octahedral_decode(in_normal.xy) : in_normal;
     out_uv = in_uv;
+    out_material_index = object_info.x;
+    out_texture_layer = object_info.y;
+    out_uv_rect = uv_rect;
+    out_uv_wrap = object_info.z;
 
     gl_Position = cbPerFrame.proj * cbPerFrame.view * world_pos;
 }
@@ -0,0 +1,345 @@
+// host tool that compares the scene bvh against brute force culling, see src/bvh.h
+//
+// bvh_bench [object counts...]
+// objects are random boxes spread at constant density, the camera sits in the middle of them and looks along -z.
+// defaults to 10k, 100k and 1M objects
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#include "../bvh.h"
+
+using Clock = std::chrono::steady_clock;
+
+// the brute force culling the bvh is measured against. world space bounds of every slot, one array per component so
+// a batch of slots loads with one instruction per component. each slot has an axis aligned box and a sphere around
+// the same center, a slot is only culled when one of them lies fully behind a frustum plane. cleared slots never pass
+class CullingBounds final {
+public:
+    static constexpr size_t kBatch = 8;
+
+private:
+    size_t size_;
+    std::vector<float> center_x_, center_y_, center_z_;
+    std::vector<float> extent_x_, extent_y_, extent_z_;
+    std::vector<float> radius_;
+
+    // min(box projected onto the plane normal, sphere radius), the slot is visible when distance + reach >= 0
+    static float reach(const Frustum &frustum, size_t plane, float ex, float ey, float ez, float radius) {
+        float box = std::abs(frustum.nx[plane]) * ex + std::abs(frustum.ny[plane]) * ey +
+                    std::abs(frustum.nz[plane]) * ez;
+        return std::min(box, radius);
+    }
+
+public:
+    CullingBounds() : size_{0} {}
+
+    // number of slots, the arrays are padded to a whole batch with cleared slots
+    size_t size() const { return size_; }
+    size_t capacity() const { return radius_.size(); }
+
+    void resize(size_t size) {
+        size_ = size;
+
+        size_t padded = (size + kBatch - 1) / kBatch * kBatch;
+        for (auto *component : {&center_x_, &center_y_, &center_z_, &extent_x_, &extent_y_, &extent_z_}) {
+            component->resize(padded, 0.0f);
+        }
+
+        radius_.resize(padded, -std::numeric_limits<float>::infinity());
+    }
+
+    void set(size_t slot, const float center[3], const float extents[3], float radius) {
+        center_x_[slot] = center[0];
+        center_y_[slot] = center[1];
+        center_z_[slot] = center[2];
+        extent_x_[slot] = extents[0];
+        extent_y_[slot] = extents[1];
+        extent_z_[slot] = extents[2];
+        radius_[slot] = radius;
+    }
+
+    void clear(size_t slot) {
+        const float zero[3] = {0.0f, 0.0f, 0.0f};
+        set(slot, zero, zero, -std::numeric_limits<float>::infinity());
+    }
+
+    // writes the slots that intersect the frustum to visible in ascending order and returns their count.
+    // visible must have room for capacity() entries, whole batches are written before they are compacted
+    size_t cull(const Frustum &frustum, uint32_t *visible) const {
+        size_t num_visible = 0;
+        size_t slot = 0;
+
+#if defined(__AVX__)
+        const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+
+        for (; slot + kBatch <= center_x_.size(); slot += kBatch) {
+            __m256 cx = _mm256_loadu_ps(&center_x_[slot]);
+            __m256 cy = _mm256_loadu_ps(&center_y_[slot]);
+            __m256 cz = _mm256_loadu_ps(&center_z_[slot]);
+            __m256 ex = _mm256_loadu_ps(&extent_x_[slot]);
+            __m256 ey = _mm256_loadu_ps(&extent_y_[slot]);
+            __m256 ez = _mm256_loadu_ps(&extent_z_[slot]);
+            __m256 radius = _mm256_loadu_ps(&radius_[slot]);
+
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (size_t plane = 0; plane < Frustum::kPlanes; ++plane) {
+                __m256 nx = _mm256_set1_ps(frustum.nx[plane]);
+                __m256 ny = _mm256_set1_ps(frustum.ny[plane]);
+                __m256 nz = _mm256_set1_ps(frustum.nz[plane]);
+
+                __m256 distance = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)),
+                    _mm256_add_ps(_mm256_mul_ps(nz, cz), _mm256_set1_ps(frustum.d[plane])));
+
+                __m256 box = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(sign_mask, nx), ex),
+                        _mm256_mul_ps(_mm256_andnot_ps(sign_mask, ny), ey)),
+                    _mm256_mul_ps(_mm256_andnot_ps(sign_mask, nz), ez));
+
+                __m256 reach = _mm256_min_ps(box, radius);
+                inside = _mm256_and_ps(
+                    inside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), _mm256_setzero_ps(), _CMP_GE_OQ));
+            }
+
+            // branchless compaction of the visible lanes
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+            for (uint32_t lane = 0; lane < kBatch; ++lane) {
+                visible[num_visible] = static_cast<uint32_t>(slot + lane);
+                num_visible += (mask >> lane) & 1;
+            }
+        }
+#endif
+
+        for (; slot < size_; ++slot) {
+            bool inside = true;
+            for (size_t plane = 0; plane < Frustum::kPlanes && inside; ++plane) {
+                float distance = frustum.nx[plane] * center_x_[slot] + frustum.ny[plane] * center_y_[slot] +
+                                 frustum.nz[plane] * center_z_[slot] + frustum.d[plane];
+                inside = distance + reach(frustum, plane, extent_x_[slot], extent_y_[slot], extent_z_[slot],
+                                        radius_[slot]) >= 0.0f;
+            }
+
+            if (inside) {
+                visible[num_visible++] = static_cast<uint32_t>(slot);
+            }
+        }
+
+        return num_visible;
+    }
+};
+
+// milliseconds per call of fn, averaged over enough calls to take a measurable time
+template <typename Fn> static double time_ms(Fn &&fn) {
+    size_t calls = 0;
+    auto start = Clock::now();
+    auto elapsed = Clock::duration{0};
+
+    do {
+        fn();
+        ++calls;
+        elapsed = Clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(200) && calls < 1000);
+
+    return std::chrono::duration<double, std::milli>(elapsed).count() / static_cast<double>(calls);
+}
+
+// column major perspective with 0..1 depth looking along -z from eye
+static void view_projection(const float eye[3], float far_plane, float out[16]) {
+    const float near_plane = 0.1f;
+    const float f = 1.0f / std::tan(0.5f * 1.0471976f); // 60 degrees
+
+    float proj[16] = {};
+    proj[0] = f / (16.0f / 9.0f);
+    proj[5] = -f;
+    proj[10] = far_plane / (near_plane - far_plane);
+    proj[11] = -1.0f;
+    proj[14] = near_plane * far_plane / (near_plane - far_plane);
+
+    // the view is a pure translation, so only the last column changes
+    for (size_t i = 0; i < 16; ++i) {
+        out[i] = proj[i];
+    }
+
+    for (size_t row = 0; row < 4; ++row) {
+        out[12 + row] = proj[12 + row] - eye[0] * proj[row] - eye[1] * proj[4 + row] - eye[2] * proj[8 + row];
+    }
+}
+
+static void run(size_t count) {
+    std::mt19937 random{1234};
+
+    // about one object per 1000 cubic units, whatever the count
+    float side = std::cbrt(static_cast<float>(count) * 1000.0f);
+    std::uniform_real_distribution<float> position{0.0f, side};
+    std::uniform_real_distribution<float> size{0.5f, 3.0f};
+
+    std::vector<Aabb> boxes(count);
+    for (auto &box : boxes) {
+        float extent = size(random);
+        for (size_t axis = 0; axis < 3; ++axis) {
+            float center = position(random);
+            box.min[axis] = center - extent;
+            box.max[axis] = center + extent;
+        }
+    }
+
+    CullingBounds flat;
+    flat.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        float center[3], extents[3];
+        for (size_t axis = 0; axis < 3; ++axis) {
+            center[axis] = boxes[i].center(axis);
+            extents[axis] = (boxes[i].max[axis] - boxes[i].min[axis]) * 0.5f;
+        }
+
+        flat.set(i, center, extents, std::sqrt(extents[0] * extents[0] * 3.0f));
+    }
+
+    Bvh tree;
+    auto start = Clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        tree.insert(static_cast<uint32_t>(i), boxes[i]);
+    }
+
+    double insert_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    size_t insert_depth = tree.depth();
+
+    start = Clock::now();
+    tree.rebuild();
+    double build_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    float eye[3] = {side * 0.5f, side * 0.5f, side * 0.5f};
+    float matrix[16];
+    view_projection(eye, side * 0.25f, matrix);
+    Frustum frustum = Frustum::from_matrix(matrix);
+
+    std::vector<uint32_t> visible(flat.capacity());
+    size_t flat_visible = 0, tree_visible = 0;
+
+    double flat_ms = time_ms([&]() { flat_visible = flat.cull(frustum, visible.data()); });
+    double tree_ms = time_ms([&]() {
+        tree_visible = 0;
+        tree.query(frustum, [&](uint32_t) { ++tree_visible; });
+    });
+
+    // a ray through the middle, brute force checks the ray against every box
+    float direction[3] = {0.3f, 0.2f, -1.0f};
+    uint32_t hit_id = 0;
+    float hit_distance = 0.0f;
+    bool hit = false;
+
+    double brute_ray_ms = time_ms([&]() {
+        hit = false;
+        hit_distance = side * 4.0f;
+        for (size_t i = 0; i < count; ++i) {
+            float enter = 0.0f, exit = hit_distance;
+            for (size_t axis = 0; axis < 3 && enter <= exit; ++axis) {
+                float t0 = (boxes[i].min[axis] - eye[axis]) / direction[axis];
+                float t1 = (boxes[i].max[axis] - eye[axis]) / direction[axis];
+                enter = std::max(enter, std::min(t0, t1));
+                exit = std::min(exit, std::max(t0, t1));
+            }
+
+            if (enter <= exit) {
+                hit = true;
+                hit_id = static_cast<uint32_t>(i);
+                hit_distance = enter;
+            }
+        }
+    });
+
+    uint32_t tree_hit_id = 0;
+    float tree_hit_distance = 0.0f;
+    double tree_ray_ms =
+        time_ms([&]() { tree.raycast(eye, direction, side * 4.0f, tree_hit_id, tree_hit_distance); });
+
+    // everything within 20 units of the camera
+    Aabb range{{eye[0] - 20.0f, eye[1] - 20.0f, eye[2] - 20.0f}, {eye[0] + 20.0f, eye[1] + 20.0f, eye[2] + 20.0f}};
+    size_t brute_in_range = 0, tree_in_range = 0;
+
+    double brute_range_ms = time_ms([&]() {
+        brute_in_range = 0;
+        for (const auto &box : boxes) {
+            brute_in_range += box.overlaps(range) ? 1 : 0;
+        }
+    });
+
+    double tree_range_ms = time_ms([&]() {
+        tree_in_range = 0;
+        tree.query(range, [&](uint32_t) { ++tree_in_range; });
+    });
+
+    // 1% of the objects drift a little every frame, the same objects teleport
+    std::uniform_real_distribution<float> drift{-0.2f, 0.2f};
+    size_t num_moved = std::max<size_t>(count / 100, 1);
+
+    double drift_ms = time_ms([&]() {
+        for (size_t i = 0; i < num_moved; ++i) {
+            auto &box = boxes[i * 100 % count];
+            float offset = drift(random);
+            for (size_t axis = 0; axis < 3; ++axis) {
+                box.min[axis] += offset;
+                box.max[axis] += offset;
+            }
+
+            tree.update(static_cast<uint32_t>(i * 100 % count), box);
+        }
+    });
+
+    double teleport_ms = time_ms([&]() {
+        for (size_t i = 0; i < num_moved; ++i) {
+            auto &box = boxes[i * 100 % count];
+            float offset = position(random) - box.center(0);
+            box.min[0] += offset;
+            box.max[0] += offset;
+
+            tree.update(static_cast<uint32_t>(i * 100 % count), box);
+        }
+    });
+
+    printf("%zu objects\n", count);
+    printf("  insert one by one   %10.2f ms, depth %zu\n", insert_ms, insert_depth);
+    printf("  sah rebuild         %10.2f ms, depth %zu\n", build_ms, tree.depth());
+    printf("  frustum  brute %10.4f ms  bvh %10.4f ms  visible %zu / %zu\n", flat_ms, tree_ms, flat_visible,
+        tree_visible);
+    printf("  ray      brute %10.4f ms  bvh %10.4f ms  hit %s %u / %u\n", brute_ray_ms, tree_ray_ms,
+        hit ? "yes" : "no", hit_id, tree_hit_id);
+    printf("  range    brute %10.4f ms  bvh %10.4f ms  found %zu / %zu\n", brute_range_ms, tree_range_ms,
+        brute_in_range, tree_in_range);
+    printf("  update %zu objects, drift %.4f ms  teleport %.4f ms\n", num_moved, drift_ms, teleport_ms);
+}
+
+int main(int argc, char **argv) {
+    std::vector<size_t> counts;
+    for (int i = 1; i < argc; ++i) {
+        size_t count = static_cast<size_t>(strtoull(argv[i], nullptr, 10));
+        if (count == 0) {
+            fprintf(stderr, "usage: %s [object counts...]\n", argv[0]);
+            return 1;
+        }
+
+        counts.push_back(count);
+    }
+
+    if (counts.empty()) {
+        counts = {10000, 100000, 1000000};
+    }
+
+    for (size_t count : counts) {
+        run(count);
+    }
+
+    return 0;
+}
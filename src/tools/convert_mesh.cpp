@@ -0,0 +1,183 @@
+// host tool that turns wavefront obj files into mesh files loaded at runtime, see src/mesh_file.h
+//
+// convert_mesh <input.obj> <output.kmesh>
+// all objects and groups of the input end up in one mesh. polygons are triangulated as fans, vertices without a
+// normal get the area weighted normal of the faces around their position, texture coordinates are flipped to the
+// top left origin the sample samples with
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "../mesh_builder.h"
+
+// levels of detail the sample keeps per mesh, see SceneState::kMaxMeshLods
+constexpr size_t kMaxLods = 8;
+
+// one corner of a face, indices into the position, uv and normal lists or -1 when the corner has none
+using Corner = std::tuple<int64_t, int64_t, int64_t>;
+
+// obj indices start at 1, negative ones count back from the end of the list read so far
+static bool resolve(const std::string &token, size_t count, int64_t &index) {
+    if (token.empty()) {
+        index = -1;
+        return true;
+    }
+
+    char *end = nullptr;
+    long long value = strtoll(token.c_str(), &end, 10);
+    if (*end != '\0' || value == 0) {
+        return false;
+    }
+
+    index = value > 0 ? value - 1 : static_cast<int64_t>(count) + value;
+    return index >= 0 && static_cast<size_t>(index) < count;
+}
+
+static std::optional<Geometry> read_obj(const std::string &path) {
+    std::ifstream fin{path};
+    if (!fin) {
+        fprintf(stderr, "%s is not a valid input file\n", path.c_str());
+        return {};
+    }
+
+    std::vector<glm::fvec3> positions, normals;
+    std::vector<glm::fvec2> uvs;
+
+    Geometry geometry;
+    std::map<Corner, uint32_t> corners;
+    std::vector<bool> has_normal;
+
+    std::string line;
+    for (size_t line_number = 1; std::getline(fin, line); ++line_number) {
+        std::istringstream in{line};
+        std::string keyword;
+        in >> keyword;
+
+        if (keyword == "v") {
+            glm::fvec3 position{0.0f};
+            in >> position.x >> position.y >> position.z;
+            positions.push_back(position);
+        } else if (keyword == "vt") {
+            glm::fvec2 uv{0.0f};
+            in >> uv.x >> uv.y;
+            uvs.push_back(glm::fvec2{uv.x, 1.0f - uv.y});
+        } else if (keyword == "vn") {
+            glm::fvec3 normal{0.0f};
+            in >> normal.x >> normal.y >> normal.z;
+            normals.push_back(normal);
+        } else if (keyword == "f") {
+            std::vector<uint32_t> face;
+            std::string token;
+
+            while (in >> token) {
+                // v, v/vt, v//vn or v/vt/vn
+                std::string parts[3];
+                size_t part = 0;
+                for (char c : token) {
+                    if (c == '/' && part < 2) {
+                        ++part;
+                    } else {
+                        parts[part] += c;
+                    }
+                }
+
+                int64_t v, vt, vn;
+                if (parts[0].empty() || !resolve(parts[0], positions.size(), v) ||
+                    !resolve(parts[1], uvs.size(), vt) || !resolve(parts[2], normals.size(), vn)) {
+                    fprintf(stderr, "%s:%zu: invalid face corner %s\n", path.c_str(), line_number, token.c_str());
+                    return {};
+                }
+
+                auto [it, inserted] = corners.emplace(Corner{v, vt, vn}, static_cast<uint32_t>(corners.size()));
+                if (inserted) {
+                    geometry.vertices.push_back(Vertex{positions[v], vn >= 0 ? normals[vn] : glm::fvec3{0.0f},
+                        vt >= 0 ? uvs[vt] : glm::fvec2{0.0f}});
+                    has_normal.push_back(vn >= 0);
+                }
+
+                face.push_back(it->second);
+            }
+
+            if (face.size() < 3) {
+                fprintf(stderr, "%s:%zu: face with less than 3 corners\n", path.c_str(), line_number);
+                return {};
+            }
+
+            for (size_t i = 2; i < face.size(); ++i) {
+                geometry.indices.insert(geometry.indices.end(), {face[0], face[i - 1], face[i]});
+            }
+        }
+    }
+
+    // the cross product is twice the area, so summing it weights the faces by area
+    std::map<std::tuple<float, float, float>, glm::fvec3> smooth;
+    for (size_t i = 0; i < geometry.indices.size(); i += 3) {
+        const auto &a = geometry.vertices[geometry.indices[i + 0]].position;
+        const auto &b = geometry.vertices[geometry.indices[i + 1]].position;
+        const auto &c = geometry.vertices[geometry.indices[i + 2]].position;
+
+        glm::fvec3 normal = glm::cross(b - a, c - a);
+        for (const auto &position : {a, b, c}) {
+            smooth[{position.x, position.y, position.z}] += normal;
+        }
+    }
+
+    for (size_t i = 0; i < geometry.vertices.size(); ++i) {
+        auto &vertex = geometry.vertices[i];
+        const auto &p = vertex.position;
+        glm::fvec3 normal = has_normal[i] ? vertex.normal : smooth[{p.x, p.y, p.z}];
+        float length = glm::length(normal);
+        vertex.normal = length > 0.0f ? normal / length : glm::fvec3{0.0f, 1.0f, 0.0f};
+    }
+
+    return geometry;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: convert_mesh <input.obj> <output.kmesh>\n");
+        return 1;
+    }
+
+    auto geometry = read_obj(argv[1]);
+    if (!geometry) {
+        return 1;
+    }
+
+    if (geometry->indices.empty()) {
+        fprintf(stderr, "%s has no faces\n", argv[1]);
+        return 1;
+    }
+
+    auto mesh = MeshBuilder::build(*geometry, kMaxLods, /* split meshlets */ true);
+
+    std::string error;
+    if (!MeshFile::write(argv[2], mesh.streams(), error)) {
+        fprintf(stderr, "failed to write %s: %s\n", argv[2], error.c_str());
+        return 1;
+    }
+
+    const auto &desc = mesh.desc;
+    printf("%s: %u vertices, %u triangles\n", argv[1], desc.vertex_count, mesh.lods[0].index_count / 3);
+    printf("  acmr %.3f -> %.3f, atvr %.3f -> %.3f\n", mesh.cache_before.acmr, mesh.cache_after.acmr,
+        mesh.cache_before.atvr, mesh.cache_after.atvr);
+    printf("  %s vertices, %u bit indices, %u levels of detail, %u meshlets\n",
+        desc.vertex_format == VertexFormat::Compact ? "compact" : "full", desc.index_size * 8, desc.lod_count,
+        desc.meshlet_count);
+
+    for (uint32_t i = 0; i < desc.lod_count; ++i) {
+        printf("  lod %u: %u triangles, error %f\n", i, mesh.lods[i].index_count / 3, mesh.lods[i].error);
+    }
+
+    printf("wrote %s\n", argv[2]);
+    return 0;
+}
@@ -0,0 +1,219 @@
+// host tool that links binary files into the executable without spelling every byte out in c++
+//
+// embed_file header <input> <output.h>       declarations, depend only on the file name so they never change
+// embed_file source <input> <output.cpp>     the data itself, through #embed or assembler .incbin
+// embed_file manifest <output.h> <inputs...> sizes and hashes of all embedded files
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../embedded_resource.h"
+
+namespace fs = std::filesystem;
+
+// same naming as the old embed_file.py, bricks.png becomes Bricks_png
+static std::string convert_to_var_name(const fs::path &path) {
+    std::string file_name = path.filename().string();
+    std::string var_name;
+    bool next_upper = true;
+
+    for (char c : file_name) {
+        if (c == '_') {
+            next_upper = true;
+        } else if (c >= 'a' && c <= 'z') {
+            var_name += next_upper ? static_cast<char>(c - 'a' + 'A') : c;
+            next_upper = false;
+        } else if (c >= 'A' && c <= 'Z') {
+            var_name += c;
+            next_upper = false;
+        } else {
+            var_name += '_';
+        }
+    }
+
+    return var_name;
+}
+
+static std::optional<std::vector<uint8_t>> read_file(const fs::path &path) {
+    std::ifstream fin{path, std::ios::binary | std::ios::ate};
+    if (!fin) {
+        fprintf(stderr, "%s is not a valid input file\n", path.string().c_str());
+        return {};
+    }
+
+    std::vector<uint8_t> data(static_cast<size_t>(fin.tellg()));
+    fin.seekg(0);
+
+    if (!data.empty() && !fin.read(reinterpret_cast<char *>(data.data()), data.size())) {
+        fprintf(stderr, "failed to read %s\n", path.string().c_str());
+        return {};
+    }
+
+    return data;
+}
+
+// only touch the output when its contents change, so dependents are not rebuilt needlessly
+static bool write_if_changed(const fs::path &path, const std::string &contents) {
+    std::ifstream fin{path, std::ios::binary};
+    if (fin) {
+        std::stringstream existing;
+        existing << fin.rdbuf();
+        if (existing.str() == contents) {
+            return true;
+        }
+    }
+
+    if (path.has_parent_path()) {
+        std::error_code ec;
+        fs::create_directories(path.parent_path(), ec);
+    }
+
+    std::ofstream fout{path, std::ios::binary | std::ios::trunc};
+    if (!fout || !fout.write(contents.data(), contents.size())) {
+        fprintf(stderr, "failed to write %s\n", path.string().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+// absolute path usable inside a quoted string in both c++ and assembler
+static std::string quoted_path(const fs::path &path) {
+    std::string result;
+    for (char c : fs::absolute(path).generic_string()) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+
+        result += c;
+    }
+
+    return result;
+}
+
+static std::string hex64(uint64_t value) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "0x%016llxull", static_cast<unsigned long long>(value));
+    return buffer;
+}
+
+static int write_header(const fs::path &input, const fs::path &output) {
+    auto var = "k" + convert_to_var_name(input);
+
+    std::string out;
+    out += "#pragma once\n";
+    out += "#include \"../embedded_resource.h\"\n\n";
+    out += "extern \"C\" const uint8_t " + var + "_data[];\n";
+    out += "extern \"C\" const size_t " + var + "_size;\n";
+    out += "extern \"C\" const uint64_t " + var + "_hash;\n\n";
+    out += "constexpr EmbeddedResource " + var + "{" + var + "_data, &" + var + "_size, &" + var + "_hash};\n";
+
+    return write_if_changed(output, out) ? 0 : 1;
+}
+
+static int write_source(const fs::path &input, const fs::path &output) {
+    auto data = read_file(input);
+    if (!data) {
+        return 1;
+    }
+
+    auto var = "k" + convert_to_var_name(input);
+    auto path = quoted_path(input);
+    auto size = std::to_string(data->size());
+
+    // the hash also makes the source change whenever the input does, which forces a recompile
+    auto hash = hex64(fnv1a_64(data->data(), data->size()));
+
+    std::string out;
+    out += "// generated by embed_file from " + input.filename().string() + ", do not edit\n";
+    out += "#include <cstddef>\n#include <cstdint>\n\n";
+    out += "extern \"C\" const size_t " + var + "_size = " + size + ";\n";
+    out += "extern \"C\" const uint64_t " + var + "_hash = " + hash + ";\n\n";
+
+    if (data->empty()) {
+        out += "extern \"C\" alignas(16) const uint8_t " + var + "_data[1] = {0};\n";
+        return write_if_changed(output, out) ? 0 : 1;
+    }
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    // msvc has neither #embed nor .incbin, fall back to an initializer list written in one go
+    out += "extern \"C\" alignas(16) const uint8_t " + var + "_data[] = {\n";
+    for (size_t i = 0; i < data->size(); ++i) {
+        out += std::to_string((*data)[i]);
+        out += (i % 32 == 31) ? ",\n" : ",";
+    }
+
+    out += "\n};\n";
+    return write_if_changed(output, out) ? 0 : 1;
+#endif
+
+    out += "#if defined(__has_embed)\n";
+    out += "extern \"C\" alignas(16) const uint8_t " + var + "_data[] = {\n";
+    out += "#embed \"" + path + "\"\n";
+    out += "};\n";
+    out += "#elif defined(__GNUC__)\n";
+    out += "#if defined(__APPLE__)\n";
+    out += "#define EMBED_SECTION \".const_data\"\n#define EMBED_SYMBOL(name) \"_\" #name\n";
+    out += "#elif defined(_WIN32)\n";
+    out += "#define EMBED_SECTION \".section .rdata, \\\"dr\\\"\"\n#define EMBED_SYMBOL(name) #name\n";
+    out += "#else\n";
+    out += "#define EMBED_SECTION \".section .rodata\"\n#define EMBED_SYMBOL(name) #name\n";
+    out += "#endif\n";
+    out += "__asm__(EMBED_SECTION \"\\n\"\n";
+    out += "        \".balign 16\\n\"\n";
+    out += "        \".globl \" EMBED_SYMBOL(" + var + "_data) \"\\n\"\n";
+    out += "        EMBED_SYMBOL(" + var + "_data) \":\\n\"\n";
+    out += "        \".incbin \\\"" + path + "\\\"\\n\"\n";
+    out += "        \".text\\n\");\n";
+    out += "#else\n";
+    out += "#error \"embedding resources requires #embed or .incbin support\"\n";
+    out += "#endif\n";
+
+    return write_if_changed(output, out) ? 0 : 1;
+}
+
+static int write_manifest(const fs::path &output, const std::vector<fs::path> &inputs) {
+    std::string out;
+    out += "// generated by embed_file, do not edit\n";
+    out += "#pragma once\n";
+    out += "#include \"../embedded_resource.h\"\n\n";
+    out += "constexpr ResourceManifestEntry kResourceManifest[] = {\n";
+
+    for (const auto &input : inputs) {
+        auto data = read_file(input);
+        if (!data) {
+            return 1;
+        }
+
+        out += "    {\"" + input.filename().generic_string() + "\", " + std::to_string(data->size()) + ", " +
+               hex64(fnv1a_64(data->data(), data->size())) + "},\n";
+    }
+
+    out += "};\n";
+    return write_if_changed(output, out) ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 4 && 0 == strcmp(argv[1], "header")) {
+        return write_header(argv[2], argv[3]);
+    }
+
+    if (argc >= 4 && 0 == strcmp(argv[1], "source")) {
+        return write_source(argv[2], argv[3]);
+    }
+
+    if (argc >= 3 && 0 == strcmp(argv[1], "manifest")) {
+        return write_manifest(argv[2], std::vector<fs::path>(argv + 3, argv + argc));
+    }
+
+    fprintf(stderr, "usage: %s header|source <input> <output>\n", argv[0]);
+    fprintf(stderr, "       %s manifest <output> <inputs...>\n", argv[0]);
+    return 1;
+}
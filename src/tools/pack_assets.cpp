@@ -0,0 +1,161 @@
+// host tool that writes the asset pack loaded at runtime, see src/asset_pack.h
+//
+// pack_assets [--lz4] <output.pak> <inputs...>
+// entries are named after the input file name, --lz4 compresses every entry that gets meaningfully smaller
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../asset_pack.h"
+
+namespace fs = std::filesystem;
+
+struct InputFile {
+    std::string name;
+    uint64_t name_hash;
+    uint64_t size;
+    PackCompression compression;
+    std::vector<uint8_t> stored;
+};
+
+static std::optional<std::vector<uint8_t>> read_file(const fs::path &path) {
+    std::ifstream fin{path, std::ios::binary | std::ios::ate};
+    if (!fin) {
+        fprintf(stderr, "%s is not a valid input file\n", path.string().c_str());
+        return {};
+    }
+
+    std::vector<uint8_t> data(static_cast<size_t>(fin.tellg()));
+    fin.seekg(0);
+
+    if (!data.empty() && !fin.read(reinterpret_cast<char *>(data.data()), data.size())) {
+        fprintf(stderr, "failed to read %s\n", path.string().c_str());
+        return {};
+    }
+
+    return data;
+}
+
+static uint64_t align_up(uint64_t value, uint64_t alignment) { return (value + alignment - 1) / alignment * alignment; }
+
+int main(int argc, char **argv) {
+    bool compress = false;
+    int first = 1;
+
+    if (argc > 1 && 0 == strcmp(argv[1], "--lz4")) {
+        compress = true;
+        ++first;
+    }
+
+    if (argc - first < 1) {
+        fprintf(stderr, "usage: %s [--lz4] <output.pak> <inputs...>\n", argv[0]);
+        return 1;
+    }
+
+    fs::path output = argv[first];
+    std::vector<InputFile> inputs;
+
+    for (int i = first + 1; i < argc; ++i) {
+        fs::path path = argv[i];
+        auto data = read_file(path);
+        if (!data) {
+            return 1;
+        }
+
+        InputFile input;
+        input.name = path.filename().generic_string();
+        input.name_hash = pack_name_hash(input.name.c_str());
+        input.size = data->size();
+        input.compression = PackCompression::None;
+
+        // keep incompressible data (png) raw so it can be used straight from the mapping
+        if (compress && !data->empty()) {
+            auto compressed = lz4::compress(data->data(), data->size());
+            if (!compressed.empty() && compressed.size() < data->size() - data->size() / 8) {
+                input.compression = PackCompression::LZ4;
+                input.stored = std::move(compressed);
+            }
+        }
+
+        if (input.compression == PackCompression::None) {
+            input.stored = std::move(data.value());
+        }
+
+        printf("%s: %llu -> %zu bytes\n", input.name.c_str(), static_cast<unsigned long long>(input.size),
+            input.stored.size());
+        inputs.push_back(std::move(input));
+    }
+
+    std::sort(inputs.begin(), inputs.end(),
+        [](const InputFile &a, const InputFile &b) { return a.name_hash < b.name_hash; });
+
+    for (size_t i = 1; i < inputs.size(); ++i) {
+        if (inputs[i - 1].name_hash == inputs[i].name_hash) {
+            fprintf(stderr, "name hash collision between %s and %s\n", inputs[i - 1].name.c_str(),
+                inputs[i].name.c_str());
+            return 1;
+        }
+    }
+
+    PackHeader header = {};
+    header.magic = kPackMagic;
+    header.version = kPackVersion;
+    header.entry_count = static_cast<uint32_t>(inputs.size());
+
+    std::vector<PackEntry> entries(inputs.size());
+    uint64_t offset = align_up(sizeof(PackHeader) + sizeof(PackEntry) * entries.size(), kPackAlignment);
+
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        entries[i] = {};
+        entries[i].name_hash = inputs[i].name_hash;
+        entries[i].offset = offset;
+        entries[i].size = inputs[i].size;
+        entries[i].stored_size = inputs[i].stored.size();
+        entries[i].compression = inputs[i].compression;
+
+        offset = align_up(offset + inputs[i].stored.size(), kPackAlignment);
+    }
+
+    // write next to the output and rename, a running sample may have the old pack mapped
+    fs::path temp = output;
+    temp += ".tmp";
+
+    {
+        std::ofstream fout{temp, std::ios::binary | std::ios::trunc};
+        if (!fout) {
+            fprintf(stderr, "failed to open %s\n", temp.string().c_str());
+            return 1;
+        }
+
+        fout.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        fout.write(reinterpret_cast<const char *>(entries.data()), sizeof(PackEntry) * entries.size());
+
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            auto padding = static_cast<size_t>(entries[i].offset - static_cast<uint64_t>(fout.tellp()));
+            static const char kZeros[kPackAlignment] = {};
+            fout.write(kZeros, padding);
+            fout.write(reinterpret_cast<const char *>(inputs[i].stored.data()), inputs[i].stored.size());
+        }
+
+        if (!fout) {
+            fprintf(stderr, "failed to write %s\n", temp.string().c_str());
+            return 1;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(temp, output, ec);
+    if (ec) {
+        fprintf(stderr, "failed to replace %s: %s\n", output.string().c_str(), ec.message().c_str());
+        return 1;
+    }
+
+    return 0;
+}